@@ -0,0 +1,313 @@
+#include <argparse/argparse.hpp>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <random>
+
+#include "holo_recons.h"
+#include "io_utils.h"
+#include "image_utils.h"
+#include "art_utils.h"
+#include "IRPSolver.h"
+
+// Timings of one benchmark case in milliseconds
+struct BenchResult
+{
+    std::string name;
+    std::string variant;
+    int size;
+    int distances;
+    int repeats;
+    double minimum, median, mean;
+};
+
+/* Run func warmup times untimed, then repeats times timed. GPU work is synchronised
+   after every call so that the time covers the kernels and not only their launch */
+template <typename Func>
+BenchResult measure(const std::string &name, const std::string &variant, int size, int distances,
+                    int warmup, int repeats, bool gpu, Func func)
+{
+    for (int i = 0; i < warmup; i++) {
+        func();
+    }
+    if (gpu) cudaDeviceSynchronize();
+
+    DArray times;
+    for (int i = 0; i < repeats; i++) {
+        auto start = std::chrono::high_resolution_clock::now();
+        func();
+        if (gpu) cudaDeviceSynchronize();
+        auto end = std::chrono::high_resolution_clock::now();
+        times.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+    }
+
+    std::sort(times.begin(), times.end());
+    double mean = 0.0;
+    for (double time: times) mean += time / times.size();
+    return {name, variant, size, distances, repeats, times.front(), times[times.size() / 2], mean};
+}
+
+// One JSON object per line, easy to collect and compare between commits
+void writeResult(std::ostream &os, const BenchResult &result)
+{
+    os << "{\"benchmark\": \"" << result.name << "\", \"variant\": \"" << result.variant << "\", \"size\": " << result.size
+       << ", \"distances\": " << result.distances << ", \"repeats\": " << result.repeats << ", \"min_ms\": " << result.minimum
+       << ", \"median_ms\": " << result.median << ", \"mean_ms\": " << result.mean << "}" << std::endl;
+}
+
+FArray randomArray(size_t n, float low, float high, unsigned seed)
+{
+    std::mt19937 generator(seed);
+    std::uniform_real_distribution<float> distribution(low, high);
+    FArray data(n);
+    for (auto &value: data) value = distribution(generator);
+    return data;
+}
+
+// Fresnel numbers of numImages distances, decreasing with the distance as in a usual scan
+F2DArray benchFresnelNumbers(int numImages)
+{
+    F2DArray fresnelNumbers;
+    for (int i = 0; i < numImages; i++) {
+        float fresnel = 2e-3f / (1.0f + 0.5f * i);
+        fresnelNumbers.push_back({fresnel, fresnel});
+    }
+    return fresnelNumbers;
+}
+
+int main(int argc, char* argv[])
+{
+    // IOUtils batch functions are collective, the benchmark runs on a single process
+    MPI_Init(&argc, &argv);
+
+    argparse::ArgumentParser program("hiholo_bench");
+    program.set_usage_max_line_width(120);
+
+    program.add_argument("--sizes", "-s")
+           .help("square image sizes to benchmark")
+           .nargs(argparse::nargs_pattern::at_least_one)
+           .default_value(IntArray{256, 512, 1024}).scan<'i', int>();
+
+    program.add_argument("--distances", "-n")
+           .help("numbers of distances to benchmark")
+           .nargs(argparse::nargs_pattern::at_least_one)
+           .default_value(IntArray{1, 4}).scan<'i', int>();
+
+    program.add_argument("--repeats", "-r")
+           .help("timed runs of every case")
+           .default_value(10).scan<'i', int>();
+
+    program.add_argument("--warmup", "-w")
+           .help("untimed runs before the timed ones")
+           .default_value(2).scan<'i', int>();
+
+    program.add_argument("--filter", "-F")
+           .help("only run benchmarks whose name contains this string")
+           .default_value(std::string(""));
+
+    program.add_argument("--art_size")
+           .help("grid width, slices and angles of the ART benchmark")
+           .nargs(3).default_value(IntArray{128, 16, 90}).scan<'i', int>();
+
+    program.add_argument("--io_file")
+           .help("scratch hdf5 file of the I/O benchmarks")
+           .default_value(std::string("hiholo_bench.h5"));
+
+    program.add_argument("--io_batch")
+           .help("angles per batch of the I/O benchmarks")
+           .default_value(8).scan<'i', int>();
+
+    program.add_argument("--output", "-O")
+           .help("file of the JSON lines results [default: stdout]");
+
+    try {
+        program.parse_args(argc, argv);
+    } catch (const std::runtime_error& err) {
+        std::cerr << err.what() << std::endl;
+        std::cerr << program;
+        MPI_Finalize();
+        return 1;
+    }
+
+    IntArray sizes = program.get<IntArray>("-s");
+    IntArray distanceCounts = program.get<IntArray>("-n");
+    int repeats = program.get<int>("-r");
+    int warmup = program.get<int>("-w");
+    std::string filter = program.get<std::string>("-F");
+    auto selected = [&](const std::string &name) { return name.find(filter) != std::string::npos; };
+
+    std::ofstream file;
+    if (program.is_used("-O")) {
+        file.open(program.get<std::string>("-O"));
+        if (!file) {
+            throw std::runtime_error("Cannot open output file!");
+        }
+    }
+    std::ostream &out = file.is_open() ? file : std::cout;
+
+    int deviceCount;
+    bool hasGPU = cudaGetDeviceCount(&deviceCount) == cudaSuccess && deviceCount > 0;
+    if (!hasGPU) {
+        std::cerr << "No CUDA capable GPU device found, GPU benchmarks are skipped" << std::endl;
+    }
+
+    for (int size: sizes) {
+        IntArray imSize {size, size};
+        int numPixels = size * size;
+
+        for (int numImages: distanceCounts) {
+            if (!hasGPU) break;
+            F2DArray fresnelNumbers = benchFresnelNumbers(numImages);
+            FArray hostWave = randomArray(2 * static_cast<size_t>(numPixels), 0.0f, 1.0f, 1);
+            FArray hostGrams = randomArray(static_cast<size_t>(numPixels) * numImages, 0.5f, 1.5f, 2);
+
+            cuFloatComplex *d_wave, *d_propagated;
+            float *d_holograms, *d_phase, *d_regWeights;
+            cudaMalloc(&d_wave, numPixels * sizeof(cuFloatComplex));
+            cudaMalloc(&d_propagated, numImages * numPixels * sizeof(cuFloatComplex));
+            cudaMalloc(&d_holograms, numImages * numPixels * sizeof(float));
+            cudaMalloc(&d_phase, numPixels * sizeof(float));
+            cudaMalloc(&d_regWeights, numPixels * sizeof(float));
+            cudaMemcpy(d_wave, hostWave.data(), numPixels * sizeof(cuFloatComplex), cudaMemcpyHostToDevice);
+            cudaMemcpy(d_holograms, hostGrams.data(), hostGrams.size() * sizeof(float), cudaMemcpyHostToDevice);
+
+            if (selected("propagate")) {
+                Propagator propagator(imSize, fresnelNumbers, CUDAPropKernel::Fourier);
+                writeResult(out, measure("propagate", "fourier", size, numImages, warmup, repeats, true,
+                                         [&] { propagator.propagate(d_wave, d_propagated); }));
+                writeResult(out, measure("back_propagate", "fourier", size, numImages, warmup, repeats, true,
+                                         [&] { propagator.backPropagate(d_propagated, d_wave); }));
+            }
+
+            if (selected("project")) {
+                const std::pair<PMagnitudeCons::Type, std::string> types[] {{PMagnitudeCons::Averaged, "averaged"},
+                                                                            {PMagnitudeCons::Sequential, "sequential"},
+                                                                            {PMagnitudeCons::Cyclic, "cyclic"}};
+                for (const auto &type: types) {
+                    // Averaged propagates all distances at once, the others keep one propagator per distance
+                    std::vector<PropagatorPtr> propagators;
+                    if (type.first == PMagnitudeCons::Averaged) {
+                        propagators.push_back(std::make_shared<Propagator>(imSize, fresnelNumbers, CUDAPropKernel::Fourier));
+                    } else {
+                        for (const auto &fresnel: fresnelNumbers) {
+                            propagators.push_back(std::make_shared<Propagator>(imSize, F2DArray{fresnel}, CUDAPropKernel::Fourier));
+                        }
+                    }
+                    PMagnitudeCons projector(d_holograms, numImages, imSize, propagators, type.first);
+                    WaveField waveField(size, size, d_wave);
+                    writeResult(out, measure("magnitude_project", type.second, size, numImages, warmup, repeats, true,
+                                             [&] { projector.project(waveField); }));
+                }
+            }
+
+            if (selected("ctf")) {
+                CUDAUtils::ctfRegWeights(d_regWeights, imSize, fresnelNumbers[0], 1e-3f, 1e-1f);
+                writeResult(out, measure("ctf_recons_kernel", "", size, numImages, warmup, repeats, true,
+                                         [&] { CUDAUtils::ctf_recons_kernel(d_holograms, d_phase, imSize, numImages, fresnelNumbers,
+                                                                            0.0f, d_regWeights); }));
+            }
+
+            cudaFree(d_wave); cudaFree(d_propagated); cudaFree(d_holograms); cudaFree(d_phase); cudaFree(d_regWeights);
+        }
+
+        // Image cleaning on the host, the copy of the image is part of the timing
+        cv::Mat image = ImageUtils::convertVecToMat(randomArray(numPixels, 0.5f, 1.5f, 3), size, size);
+        if (selected("remove_outliers")) {
+            writeResult(out, measure("remove_outliers", "kernel3", size, 1, warmup, repeats, false, [&] {
+                cv::Mat copy = image.clone();
+                ImageUtils::removeOutliers(copy, 3, 2.0f);
+            }));
+        }
+        if (selected("remove_stripes")) {
+            writeResult(out, measure("remove_stripes", "mul", size, 1, warmup, repeats, false, [&] {
+                cv::Mat copy = image.clone();
+                ImageUtils::removeStripes(copy, size / 8, size / 8, 5, "mul");
+            }));
+        }
+
+        // Batches of angles written and read back through the collective HDF5 functions
+        std::string ioFile = program.get<std::string>("--io_file");
+        int ioBatch = program.get<int>("--io_batch");
+        for (int numImages: distanceCounts) {
+            if (!selected("io")) break;
+            std::vector<hsize_t> dims3 {static_cast<hsize_t>(ioBatch), static_cast<hsize_t>(size), static_cast<hsize_t>(size)};
+            std::vector<hsize_t> dims4 {static_cast<hsize_t>(ioBatch), static_cast<hsize_t>(numImages),
+                                        static_cast<hsize_t>(size), static_cast<hsize_t>(size)};
+            FArray phases = randomArray(static_cast<size_t>(ioBatch) * numPixels, -1.0f, 1.0f, 4);
+            FArray holograms = randomArray(static_cast<size_t>(ioBatch) * numImages * numPixels, 0.5f, 1.5f, 5);
+            FArray buffer(holograms.size());
+
+            IOUtils::createFileDataset(ioFile, "holodata", dims4, MPI_COMM_WORLD);
+            writeResult(out, measure("io_write4d", "batch" + std::to_string(ioBatch), size, numImages, warmup, repeats, false,
+                                     [&] { IOUtils::write4DimData(ioFile, "holodata", holograms, dims4, 0, MPI_COMM_WORLD); }));
+            writeResult(out, measure("io_read4d", "batch" + std::to_string(ioBatch), size, numImages, warmup, repeats, false,
+                                     [&] { IOUtils::read4DimData(ioFile, "holodata", buffer, 0, ioBatch, MPI_COMM_WORLD); }));
+
+            // Phase maps do not depend on the number of distances
+            if (numImages != distanceCounts.front()) continue;
+            IOUtils::createFileDataset(ioFile, "phasedata", dims3, MPI_COMM_WORLD);
+            writeResult(out, measure("io_write3d", "batch" + std::to_string(ioBatch), size, 1, warmup, repeats, false,
+                                     [&] { IOUtils::write3DimData(ioFile, "phasedata", phases, dims3, 0, MPI_COMM_WORLD); }));
+            writeResult(out, measure("io_read3d", "batch" + std::to_string(ioBatch), size, 1, warmup, repeats, false,
+                                     [&] { IOUtils::read3DimData(ioFile, "phasedata", buffer, 0, ioBatch, MPI_COMM_WORLD); }));
+        }
+    }
+
+    // One ART pass per timed run from the projections of a random grid, with the CUDA engine of the IRP
+    // reconstruction and with the host engine, each recomputing the weights or reading the system matrix
+    if (selected("art")) {
+        IntArray artSize = program.get<IntArray>("--art_size");
+        int nx = artSize[0], nz = artSize[1], numAngles = artSize[2];
+        FArray angles(numAngles);
+        for (int i = 0; i < numAngles; i++) {
+            angles[i] = i * static_cast<float>(M_PI) / numAngles;
+        }
+        FArray phantom = randomArray(static_cast<size_t>(nx) * nx * nz, 0.0f, 1.0f, 6);
+        FArray measured(static_cast<size_t>(numAngles) * nx * nz);
+        for (int i = 0; i < numAngles; i++) {
+            ARTUtils::gridProject(phantom.data(), measured.data() + static_cast<size_t>(i) * nx * nz, nx, nx, nz, angles[i]);
+        }
+        ARTUtils::SystemMatrix matrix = ARTUtils::buildSystemMatrix(nx, nx, angles);
+        std::string suffix = "_z" + std::to_string(nz) + "_a" + std::to_string(numAngles);
+
+        // All angles on this rank, the slab is the whole grid and the exchange stays local
+        if (hasGPU) {
+            ARTOptions gpuOptions = {1, 10, ARTOptions::BitReversal};
+            Grid deviceGrid(nx, nx, nz);
+            SlabExchange exchange(nx, nz, numAngles, MPI_COMM_SELF);
+            float *angleProjs = nullptr, *slabProjs = nullptr;
+            if (cudaMalloc((void**)&angleProjs, measured.size() * sizeof(float)) != cudaSuccess ||
+                cudaMalloc((void**)&slabProjs, measured.size() * sizeof(float)) != cudaSuccess) {
+                cudaFree(angleProjs);
+                throw std::runtime_error("Cannot allocate the ART projections on the GPU!");
+            }
+            for (bool cache: {false, true}) {
+                gpuOptions.cacheMatrix = cache;
+                std::string variant = std::string(cache ? "gpu_cached" : "gpu") + suffix;
+                writeResult(out, measure("reproject_art", variant, nx, 1, warmup, repeats, true, [&] {
+                    deviceGrid.setZeros();
+                    cudaMemcpy(angleProjs, measured.data(), measured.size() * sizeof(float), cudaMemcpyHostToDevice);
+                    reprojectART(deviceGrid, exchange, angleProjs, slabProjs, 1, angles, gpuOptions, cache ? &matrix : nullptr);
+                }));
+            }
+            cudaFree(angleProjs);
+            cudaFree(slabProjs);
+        }
+
+        ARTOptions options = {1, 10, ARTOptions::BitReversal};
+        options.device = ARTOptions::CPU;
+        FArray grid(phantom.size()), projects;
+        for (bool cache: {false, true}) {
+            options.cacheMatrix = cache;
+            std::string variant = std::string(cache ? "cpu_cached" : "cpu") + suffix;
+            writeResult(out, measure("reproject_art", variant, nx, 1, warmup, repeats, false, [&] {
+                std::fill(grid.begin(), grid.end(), 0.0f);
+                projects = measured;
+                ARTUtils::reprojectART(grid, projects, nx, nx, nz, angles, options, cache ? &matrix : nullptr);
+            }));
+        }
+    }
+
+    MPI_Finalize();
+    return 0;
+}
@@ -0,0 +1,208 @@
+#include <argparse/argparse.hpp>
+#include <chrono>
+#include <iostream>
+
+#include "io_utils.h"
+#include "synthetic_data.h"
+
+int main(int argc, char* argv[])
+{
+    // Initialize MPI
+    MPI_Init(&argc, &argv);
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    argparse::ArgumentParser program("holo_gen_data");
+    program.set_usage_max_line_width(120);
+
+    // Add arguments to ArgumentParser object
+    program.add_argument("--output_file", "-O")
+           .help("output hdf5 file of the synthetic data")
+           .required();
+
+    program.add_argument("--image_size", "-s")
+           .help("rows and columns of holograms, rows run along the rotation axis")
+           .nargs(2).default_value(IntArray{256, 256}).scan<'i', int>();
+
+    program.add_argument("--angles", "-a")
+           .help("number of equally spaced projection angles")
+           .default_value(180).scan<'i', int>();
+
+    program.add_argument("--angle_range")
+           .help("range of the projection angles in degrees [default: 180]")
+           .default_value(180.0f).scan<'g', float>();
+
+    program.add_argument("--fresnel_numbers", "-f")
+           .help("list of fresnel numbers of the distances")
+           .required().nargs(argparse::nargs_pattern::at_least_one)
+           .scan<'g', float>();
+
+    program.add_argument("--spheres")
+           .help("number of random spheres in the phantom")
+           .default_value(20).scan<'i', int>();
+
+    program.add_argument("--phase_scale")
+           .help("phase shift per voxel of unit density, negative phases for positive decrements")
+           .default_value(0.02f).scan<'g', float>();
+
+    program.add_argument("--ratio", "-r")
+           .help("fixed ratio between absorption and phase shifts")
+           .default_value(0.0f).scan<'g', float>();
+
+    program.add_argument("--flux")
+           .help("photons per pixel of the flat field, 0 writes noise-free holograms only")
+           .default_value(1e4f).scan<'g', float>();
+
+    program.add_argument("--dark_level")
+           .help("mean counts of the dark frame")
+           .default_value(100.0f).scan<'g', float>();
+
+    program.add_argument("--read_noise")
+           .help("standard deviation of the read-out noise in counts, 0 for none")
+           .default_value(2.0f).scan<'g', float>();
+
+    program.add_argument("--beam_width")
+           .help("standard deviation of the gaussian beam relative to the image, 0 is uniform")
+           .default_value(0.0f).scan<'g', float>();
+
+    program.add_argument("--raw")
+           .help("also write the raw counts data, dark and flat besides holodata")
+           .default_value(false).implicit_value(true);
+
+    program.add_argument("--seed")
+           .help("seed of the phantom and the noise")
+           .default_value(1).scan<'i', int>();
+
+    program.add_argument("--batch_size", "-b")
+           .help("batch size of angles generated at a time")
+           .default_value(16).scan<'i', int>();
+
+    try {
+        program.parse_args(argc, argv);
+    } catch (const std::runtime_error& err) {
+        if (rank == 0) {
+            std::cerr << err.what() << std::endl;
+            std::cerr << program;
+        }
+        MPI_Finalize();
+        return 1;
+    }
+
+    int deviceCount;
+    cudaError_t error = cudaGetDeviceCount(&deviceCount);
+    if (error != cudaSuccess || deviceCount == 0) {
+        throw std::runtime_error("No CUDA capable GPU device found!");
+    }
+    cudaSetDevice(rank % deviceCount);
+
+    IntArray imSize = program.get<IntArray>("-s");
+    int rows = imSize[0];
+    int cols = imSize[1];
+    int totalAngles = program.get<int>("-a");
+    int batchSize = program.get<int>("-b");
+    if (rows <= 0 || cols <= 0 || totalAngles <= 0 || batchSize <= 0) {
+        throw std::runtime_error("Invalid image size, number of angles or batch size!");
+    }
+
+    F2DArray fresnelNumbers;
+    for (float fresnel: program.get<FArray>("-f")) {
+        fresnelNumbers.push_back({fresnel});
+    }
+    int numHolograms = static_cast<int>(fresnelNumbers.size());
+    int numPixels = rows * cols;
+
+    SyntheticData::DetectorModel model;
+    model.flux = program.get<float>("--flux");
+    model.darkLevel = program.get<float>("--dark_level");
+    model.readNoise = program.get<float>("--read_noise");
+    model.beamWidth = program.get<float>("--beam_width");
+    bool writeRaw = program.get<bool>("--raw");
+    if (writeRaw && model.flux <= 0.0f) {
+        throw std::runtime_error("Raw data needs a positive flux!");
+    }
+
+    // Every process builds the same phantom and detector fields from the seed
+    unsigned seed = static_cast<unsigned>(program.get<int>("--seed"));
+    FArray phantom = SyntheticData::spherePhantom(cols, rows, program.get<int>("--spheres"), seed);
+    FArray profile = SyntheticData::beamProfile(imSize, model.beamWidth);
+    U16Array dark, flat;
+    if (model.flux > 0.0f) {
+        std::mt19937 generator(seed);
+        SyntheticData::detectorFields(imSize, numHolograms, model, dark, flat, generator);
+    }
+
+    std::string output = program.get<std::string>("-O");
+    std::vector<hsize_t> dims {static_cast<hsize_t>(totalAngles), static_cast<hsize_t>(numHolograms),
+                               static_cast<hsize_t>(rows), static_cast<hsize_t>(cols)};
+    std::vector<hsize_t> darkDims {1, static_cast<hsize_t>(rows), static_cast<hsize_t>(cols)};
+    std::vector<hsize_t> flatDims {static_cast<hsize_t>(numHolograms), static_cast<hsize_t>(rows), static_cast<hsize_t>(cols)};
+    if (!IOUtils::createFileDataset(output, "holodata", dims, MPI_COMM_WORLD)) {
+        throw std::runtime_error("Failed to create output file or dataset!");
+    }
+    if (writeRaw) {
+        IOUtils::addFileDataset(output, "data", dims, H5T_NATIVE_UINT16, MPI_COMM_WORLD);
+        IOUtils::addFileDataset(output, "dark", darkDims, H5T_NATIVE_UINT16, MPI_COMM_WORLD);
+        IOUtils::addFileDataset(output, "flat", flatDims, H5T_NATIVE_UINT16, MPI_COMM_WORLD);
+        IOUtils::write3DimData(output, "dark", rank == 0 ? dark : U16Array(), darkDims, 0, MPI_COMM_WORLD);
+        IOUtils::write3DimData(output, "flat", rank == 0 ? flat : U16Array(), flatDims, 0, MPI_COMM_WORLD);
+    }
+
+    // Each process generates a contiguous block of angles, the first ranks take one more if they do not divide evenly
+    int angleStart = rank * (totalAngles / size) + std::min(rank, totalAngles % size);
+    int numAngles = totalAngles / size + (rank < totalAngles % size ? 1 : 0);
+    int numBatches = (numAngles + batchSize - 1) / batchSize;
+    int maxBatches;
+    MPI_Allreduce(&numBatches, &maxBatches, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+
+    float angleRange = program.get<float>("--angle_range") * static_cast<float>(M_PI) / 180.0f;
+    float phaseScale = program.get<float>("--phase_scale");
+    float ratio = program.get<float>("-r");
+    auto start = std::chrono::high_resolution_clock::now();
+
+    // Writes are collective, processes without angles left write empty batches
+    for (int i = 0; i < maxBatches; i++) {
+        if (rank == 0) {
+            std::cout << "Generating batch " << i + 1 << "/" << maxBatches << std::endl;
+        }
+        int first = std::min(i * batchSize, numAngles);
+        int count = std::min(batchSize, numAngles - first);
+        FArray angles(count);
+        for (int j = 0; j < count; j++) {
+            angles[j] = (angleStart + first + j) * angleRange / totalAngles;
+        }
+        FArray phases = SyntheticData::projectPhantom(phantom, cols, rows, angles, phaseScale);
+
+        FArray holograms;
+        U16Array counts;
+        for (int j = 0; j < count; j++) {
+            FArray phase(phases.begin() + static_cast<size_t>(j) * numPixels, phases.begin() + static_cast<size_t>(j + 1) * numPixels);
+            FArray intensities = SyntheticData::propagateObject(phase, ratio, imSize, fresnelNumbers);
+            if (model.flux > 0.0f) {
+                // The noise of an angle only depends on the seed and its index, not on the number of processes
+                std::mt19937 generator(seed + 1000003u * static_cast<unsigned>(angleStart + first + j + 1));
+                U16Array angleCounts = SyntheticData::detectorCounts(intensities, profile, model, generator);
+                intensities = SyntheticData::flatFieldCorrect(angleCounts, dark, flat, numHolograms);
+                counts.insert(counts.end(), angleCounts.begin(), angleCounts.end());
+            }
+            holograms.insert(holograms.end(), intensities.begin(), intensities.end());
+        }
+
+        IOUtils::write4DimData(output, "holodata", holograms, dims, angleStart + first, MPI_COMM_WORLD);
+        if (writeRaw) {
+            IOUtils::write4DimData(output, "data", counts, dims, angleStart + first, MPI_COMM_WORLD);
+        }
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    auto end = std::chrono::high_resolution_clock::now();
+
+    if (rank == 0) {
+        std::cout << "Generated " << totalAngles << " angles at " << numHolograms << " distances of " << rows << "x" << cols << std::endl;
+        auto duration = std::chrono::duration_cast<std::chrono::duration<double>>(end - start);
+        std::cout << "Elapsed time: " << duration.count() << " seconds" << std::endl;
+    }
+
+    MPI_Finalize();
+    return 0;
+}
@@ -1,8 +1,10 @@
 #include <argparse/argparse.hpp>
 #include <chrono>
+#include <memory>
 
 #include "holo_recons.h"
 #include "io_utils.h"
+#include "StreamingTomography.h"
 
 int main(int argc, char* argv[])
 {
@@ -20,13 +22,33 @@ int main(int argc, char* argv[])
            .required().nargs(2);
 
     program.add_argument("--output_files", "-O")
-           .help("output hdf5 file and dataset")
-           .required().nargs(2);
+           .help("output hdf5 file and dataset of phase maps")
+           .nargs(2);
+
+    program.add_argument("--volume_output")
+           .help("hdf5 file and dataset of the volume, phase maps are back projected as they are retrieved")
+           .nargs(2);
+
+    program.add_argument("--angle_range")
+           .help("range of equally spaced projection angles in degrees [default: 180]")
+           .default_value(180.0f).scan<'g', float>();
+
+    program.add_argument("--tomo_threads")
+           .help("number of CPU threads of the back projection [default: all cores]")
+           .default_value(0).scan<'i', int>();
 
     program.add_argument("--batch_size", "-b")
            .help("batch size of holograms processed at a time")
            .required().scan<'i', int>();
 
+    program.add_argument("--auto_batch")
+           .help("use the largest batch size up to --batch_size which divides the angles and fits the device memory")
+           .default_value(false).implicit_value(true);
+
+    program.add_argument("--memory_budget")
+           .help("device memory in MB available to --auto_batch [default: 90% of the free memory]")
+           .scan<'g', float>();
+
     program.add_argument("--fresnel_numbers", "-f")
            .help("list of fresnel numbers corresponding to holograms")
            .required().nargs(argparse::nargs_pattern::at_least_one)
@@ -60,6 +82,13 @@ int main(int argc, char* argv[])
            .help("value to pad on holograms and initial phase")
            .default_value(0.0f).scan<'g', float>();
 
+    program.add_argument("--perf")
+           .help("report bytes, flops and FFTs of every reconstruction stage with their throughput, synchronises between stages")
+           .default_value(false).implicit_value(true);
+
+    program.add_argument("--trace")
+           .help("write a Chrome trace of IO, kernels and communication of all processes to this json file");
+
     try {
         program.parse_args(argc, argv);
     } catch (const std::runtime_error& err) {
@@ -101,12 +130,16 @@ int main(int argc, char* argv[])
     int cols = static_cast<int>(dims[3]);
     IntArray imSize {rows, cols};
 
-    // Each process handles the same number of angles
+    // Each process handles the same number of angles, the volume needs all of them
+    if (program.is_used("--volume_output") && totalAngles % size != 0) {
+        throw std::runtime_error("Number of angles must be divisible by the number of processes for volume output!");
+    }
     int numAngles = totalAngles / size;
     int startAngle = rank * numAngles;
     int batchSize = program.get<int>("-b");
     batchSize = std::min(batchSize, numAngles);
-    if (numAngles % batchSize != 0) {
+    bool autoBatch = program.get<bool>("--auto_batch");
+    if (!autoBatch && numAngles % batchSize != 0) {
         throw std::runtime_error("Number of angles must be divisible by batch size!");
     }
     FArray holograms(batchSize * numHolograms * rows * cols);
@@ -128,23 +161,82 @@ int main(int argc, char* argv[])
        padValue = program.get<float>("-V");
     }
 
+    // Every process plans on its own device, all use the smallest plan
+    if (autoBatch) {
+        size_t budget = program.is_used("--memory_budget") ? static_cast<size_t>(program.get<float>("--memory_budget") * (1 << 20))
+                                                           : PhaseRetrieval::deviceBudget();
+        auto footprint = [&](int batch) {
+            return PhaseRetrieval::ctfFootprint(batch, numHolograms, imSize, padSize);
+        };
+        int planned = PhaseRetrieval::planBatchSize(footprint, budget, batchSize, numAngles);
+        MPI_Allreduce(MPI_IN_PLACE, &planned, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+        if (planned == 0) {
+            throw std::runtime_error("A single angle does not fit into the device memory budget!");
+        }
+        batchSize = planned;
+        holograms.resize(batchSize * numHolograms * rows * cols);
+        if (rank == 0) {
+            std::cout << "Planned batch size " << batchSize << " needing " << (footprint(batchSize) >> 20) << " MB of "
+                      << (budget >> 20) << " MB" << std::endl;
+        }
+    }
+
     // Read regularisation parameters
     float lowFreqLim = program.get<float>("-L");
     float highFreqLim = program.get<float>("-H");
 
-    std::vector<std::string> outputs = program.get<std::vector<std::string>>("-O");
-    if (outputs[0] == inputs[0]) {
-       throw std::runtime_error("Input and output files cannot be the same!");
+    bool savePhases = program.is_used("-O");
+    bool streamVolume = program.is_used("--volume_output");
+    if (!savePhases && !streamVolume) {
+        throw std::runtime_error("Either phase maps or volume output must be given!");
+    }
+    std::vector<std::string> outputs, volumeOutputs;
+    if (savePhases) {
+        outputs = program.get<std::vector<std::string>>("-O");
+        if (outputs[0] == inputs[0]) {
+           throw std::runtime_error("Input and output files cannot be the same!");
+        }
+    }
+    if (streamVolume) {
+        volumeOutputs = program.get<std::vector<std::string>>("--volume_output");
+        if (volumeOutputs[0] == inputs[0] || (savePhases && volumeOutputs[0] == outputs[0])) {
+           throw std::runtime_error("Volume output file must differ from the other files!");
+        }
     }
     std::vector<hsize_t> outputDims {dims[0], dims[2], dims[3]};
 
+    // Every rank back projects its slab of rows of all phase maps, which are exchanged after each batch
+    std::unique_ptr<StreamingTomography> tomography;
+    IntArray rowStarts;
+    if (streamVolume) {
+        if (size > rows) {
+            throw std::runtime_error("The number of processes exceeds the number of rows!");
+        }
+        for (int r = 0; r <= size; r++) {
+            rowStarts.push_back(r * rows / size);
+        }
+        FArray angles(totalAngles);
+        float angleRange = program.get<float>("--angle_range") * static_cast<float>(M_PI) / 180.0f;
+        for (int i = 0; i < totalAngles; i++) {
+            angles[i] = i * angleRange / totalAngles;
+        }
+        tomography.reset(new StreamingTomography(cols, rowStarts[rank], rowStarts[rank + 1], angles,
+                                                 program.get<int>("--tomo_threads")));
+    }
+
     auto reconstructor = new PhaseRetrieval::CTFReconstructor(batchSize, numHolograms, imSize, fresnelNumbers,
                                                               lowFreqLim, highFreqLim, ratio, padSize, padType, padValue);
     
     // Create output dataset before processing
-    if(!IOUtils::createFileDataset(outputs[0], outputs[1], outputDims, MPI_COMM_WORLD)) {
+    if (savePhases && !IOUtils::createFileDataset(outputs[0], outputs[1], outputDims, MPI_COMM_WORLD)) {
         throw std::runtime_error("Failed to create output file or dataset!");
-    }  
+    }
+    bool perf = program.get<bool>("--perf");
+    PerfUtils::PerfReport report;
+    if (program.is_used("--trace")) {
+        MPI_Barrier(MPI_COMM_WORLD);
+        TraceUtils::enable(rank, [] { cudaDeviceSynchronize(); });
+    }
     auto start = std::chrono::high_resolution_clock::now();    
 
     for (int i = 0; i < numAngles / batchSize; i++) {
@@ -153,17 +245,75 @@ int main(int argc, char* argv[])
        }
        int globalIndex = startAngle + i * batchSize;
        IOUtils::read4DimData(inputs[0], inputs[1], holograms, globalIndex, batchSize, MPI_COMM_WORLD);
-       auto result = reconstructor->reconsBatch(holograms);
-       IOUtils::write3DimData(outputs[0], outputs[1], result, outputDims, globalIndex, MPI_COMM_WORLD);
+       auto result = reconstructor->reconsBatch(holograms, perf ? &report : nullptr);
+       if (savePhases) {
+           IOUtils::write3DimData(outputs[0], outputs[1], result, outputDims, globalIndex, MPI_COMM_WORLD);
+       }
+
+       if (streamVolume) {
+           // Send the rows of every phase map of the batch to the rank owning them
+           IntArray sendCounts, sendDispls, recvCounts, recvDispls;
+           FArray sendRows;
+           for (int r = 0; r < size; r++) {
+               sendDispls.push_back(static_cast<int>(sendRows.size()));
+               for (int j = 0; j < batchSize; j++) {
+                   const float *first = result.data() + (static_cast<size_t>(j) * rows + rowStarts[r]) * cols;
+                   sendRows.insert(sendRows.end(), first, first + (rowStarts[r + 1] - rowStarts[r]) * cols);
+               }
+               sendCounts.push_back(static_cast<int>(sendRows.size()) - sendDispls[r]);
+           }
+           int depth = tomography->getDepth();
+           for (int r = 0; r < size; r++) {
+               recvCounts.push_back(batchSize * depth * cols);
+               recvDispls.push_back(r * batchSize * depth * cols);
+           }
+           FArray recvRows(static_cast<size_t>(size) * batchSize * depth * cols);
+           TRACE_SCOPE("row exchange", "mpi");
+           MPI_Alltoallv(sendRows.data(), sendCounts.data(), sendDispls.data(), MPI_FLOAT, recvRows.data(),
+                         recvCounts.data(), recvDispls.data(), MPI_FLOAT, MPI_COMM_WORLD);
+
+           // The back projection runs in the background while the next batch is retrieved
+           for (int r = 0; r < size; r++) {
+               for (int j = 0; j < batchSize; j++) {
+                   tomography->addProjection(r * numAngles + i * batchSize + j,
+                                             recvRows.data() + (static_cast<size_t>(r) * batchSize + j) * depth * cols);
+               }
+           }
+       }
+    }
+
+    if (streamVolume) {
+        FArray slices = tomography->finish();
+        std::vector<hsize_t> volumeDims {dims[2], dims[3], dims[3]};
+        if (!IOUtils::createFileDataset(volumeOutputs[0], volumeOutputs[1], volumeDims, MPI_COMM_WORLD)) {
+            throw std::runtime_error("Failed to create volume file or dataset!");
+        }
+        IOUtils::write3DimData(volumeOutputs[0], volumeOutputs[1], slices, volumeDims, rowStarts[rank], MPI_COMM_WORLD);
     }
     
     MPI_Barrier(MPI_COMM_WORLD);
     auto end = std::chrono::high_resolution_clock::now();
+    size_t peakMemory = reconstructor->getPeakMemory();
+    MPI_Allreduce(MPI_IN_PLACE, &peakMemory, 1, MPI_UNSIGNED_LONG, MPI_MAX, MPI_COMM_WORLD);
 
     if (rank == 0) {
         std::cout << "Finished CTF reconstruction for " << totalAngles << " angles on " << devices << " GPUs!" << std::endl;
         auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
         std::cout << "Elapsed time: " << duration.count() << " milliseconds" << std::endl;
+        std::cout << "Peak device memory: " << (peakMemory >> 20) << " MB" << std::endl;
+    }
+
+    if (perf) {
+        IOUtils::reduceReport(report, MPI_COMM_WORLD);
+        if (rank == 0) {
+            report.print(std::cout);
+            std::cout << report.toJson() << std::endl;
+        }
+    }
+
+    if (program.is_used("--trace")) {
+        TraceUtils::disable();
+        IOUtils::writeTrace(program.get<std::string>("--trace"), MPI_COMM_WORLD);
     }
 
     delete reconstructor;
@@ -3,6 +3,7 @@
 #include <thread>
 
 #include "holo_recons.h"
+#include "image_utils.h"
 #include "io_utils.h"
 
 int main(int argc, char* argv[])
@@ -240,75 +241,66 @@ int main(int argc, char* argv[])
        newSize = {rows + 2 * padSize[0], cols + 2 * padSize[1]};
     }
 
-    F2DArray result, residuals;
+    PhaseRetrieval::ReconsResult result;
     bool calcError = program.get<bool>("-e");
-    if (calcError) {
-        residuals = F2DArray(2, FArray(iterations));
-    }
+
+    // Show the phase of the current wave field every plotInterval iterations, cropped to the holograms except for EPI
+    IntArray fieldSize = algorithm == ProjectionSolver::EPI ? newSize : imSize;
+    FArray currentPhase(fieldSize[0] * fieldSize[1]);
+    auto observer = [&](const IterationState &state) {
+        float *d_phase, *d_cropped;
+        cudaMalloc((void**)&d_phase, state.psi.getSize() * sizeof(float));
+        state.psi.getPhase(d_phase);
+        if (state.psi.getRows() != fieldSize[0] || state.psi.getColumns() != fieldSize[1]) {
+            cudaMalloc((void**)&d_cropped, currentPhase.size() * sizeof(float));
+            CUDAUtils::cropMatrix(d_phase, d_cropped, state.psi.getRows(), state.psi.getColumns(), padSize[0], padSize[1], padSize[0], padSize[1]);
+            cudaMemcpy(currentPhase.data(), d_cropped, currentPhase.size() * sizeof(float), cudaMemcpyDeviceToHost);
+            cudaFree(d_cropped);
+        } else {
+            cudaMemcpy(currentPhase.data(), d_phase, currentPhase.size() * sizeof(float), cudaMemcpyDeviceToHost);
+        }
+        cudaFree(d_phase);
+
+        ImageUtils::displayPhase(currentPhase, fieldSize[0], fieldSize[1], "phase reconstructed by " + \
+                                 std::to_string(state.iteration) + " iterations");
+        return true;
+    };
     
 //     auto start = std::chrono::high_resolution_clock::now();
     
-    for (int i = 0; i < iterations / plotInterval; ++i) {
-       if (algorithm == ProjectionSolver::EPI) {
-           result = PhaseRetrieval::reconstruct_epi(holograms, numHolograms, imSize, fresnelNumbers, plotInterval, newSize,
-                                                    initialPhase, initialAmplitude, phaLimits[0], phaLimits[1], ampLimits[0], 
-                                                    ampLimits[1], support, outsideValue, projectionType, kernelMethod, calcError);
-
-           initialPhase = result[0];
-           initialAmplitude = result[1];
-           if (calcError) {
-              std::copy(result[2].begin(), result[2].end(), residuals[0].begin() + i * plotInterval);
-              std::copy(result[3].begin(), result[3].end(), residuals[1].begin() + i * plotInterval);
-           }
-
-           ImageUtils::displayPhase(result[0], newSize[0], newSize[1], "phase reconstructed by " + \
-                                    std::to_string((i + 1) * plotInterval) + " iterations");
-       } else {
-           result = PhaseRetrieval::reconstruct_iter(holograms, numHolograms, imSize, fresnelNumbers, plotInterval, initialPhase,
-                                                     algorithm, parameters, phaLimits[0], phaLimits[1], ampLimits[0], ampLimits[1],
-                                                     support, outsideValue,  padSize, padType, padValue, projectionType, kernelMethod,
-                                                     probeGrams, initProbePhase, calcError);
-       
-           initialPhase = result[0];
-           if (algorithm == ProjectionSolver::APWP) {
-              initProbePhase = result[2];
-           }
-
-           if (calcError) {
-              std::copy(result[3].begin(), result[3].end(), residuals[0].begin() + i * plotInterval);
-              std::copy(result[4].begin(), result[4].end(), residuals[1].begin() + i * plotInterval);
-           }
-
-           ImageUtils::displayPhase(result[0], imSize[0], imSize[1], "phase reconstructed by " + \
-                                    std::to_string((i + 1) * plotInterval) + " iterations");
-       }
+    if (algorithm == ProjectionSolver::EPI) {
+       result = PhaseRetrieval::reconstruct_epi(holograms, numHolograms, imSize, fresnelNumbers, iterations, newSize,
+                                                initialPhase, initialAmplitude, phaLimits[0], phaLimits[1], ampLimits[0], 
+                                                ampLimits[1], support, outsideValue, projectionType, kernelMethod, calcError,
+                                                observer, plotInterval);
+    } else {
+       result = PhaseRetrieval::reconstruct_iter(holograms, numHolograms, imSize, fresnelNumbers, iterations, initialPhase,
+                                                 initialAmplitude, algorithm, parameters, phaLimits[0], phaLimits[1], ampLimits[0],
+                                                 ampLimits[1], support, outsideValue,  padSize, padType, padValue, projectionType,
+                                                 kernelMethod, probeGrams, initProbePhase, calcError, observer, plotInterval);
     }
     
 //     auto end = std::chrono::high_resolution_clock::now();
 //     auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
 //     std::cout << "Time taken: " << duration.count() << " milliseconds" << std::endl;
 //     std::cout << std::endl << "Step Error: ";
-//     for (float residual: residuals[0]) {
+//     for (float residual: result.residuals[0]) {
 //         std::cout << residual << " ";
 //     }
 //     std::cout << std::endl << std::endl << "PM Error: ";
-//     for (float residual: residuals[1]) {
+//     for (float residual: result.residuals[1]) {
 //         std::cout << residual << " ";
 //     }
 //     std::cout << std::endl;
 
-    if (algorithm == ProjectionSolver::EPI) {
-       imSize = newSize;
-    }
-
     std::vector<std::string> outputs = program.get<std::vector<std::string>>("-O");
     if (outputs[0] == inputs[0]) {
         throw std::runtime_error("Input and output files cannot be the same!");
     }
 
-    IOUtils::savePhaseGram(outputs[0], outputs[1], result[0], imSize[0], imSize[1]);
-    ImageUtils::saveImage("phase.png", result[0], imSize[0], imSize[1]);
-    ImageUtils::saveImage("amplitude.png", result[1], imSize[0], imSize[1]);
+    IOUtils::savePhaseGram(outputs[0], outputs[1], result.planes.slice(0));
+    ImageUtils::saveImage("phase.png", result.planes.slice(0));
+    ImageUtils::saveImage("amplitude.png", result.planes.slice(1));
 
     return 0;
 }
\ No newline at end of file
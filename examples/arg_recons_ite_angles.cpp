@@ -1,8 +1,12 @@
 #include <argparse/argparse.hpp>
+#include <algorithm>
 #include <chrono>
+#include <memory>
 
 #include "holo_recons.h"
 #include "io_utils.h"
+#include "StreamingTomography.h"
+#include "TiledReconstructor.h"
 
 int main(int argc, char* argv[])
 {
@@ -21,12 +25,32 @@ int main(int argc, char* argv[])
            .required().nargs(2);
 
     program.add_argument("--output_files", "-O")
-           .help("output hdf5 file and dataset")
-           .required().nargs(2);
+           .help("output hdf5 file and dataset of phase maps")
+           .nargs(2);
+
+    program.add_argument("--volume_output")
+           .help("hdf5 file and dataset of the volume, phase maps are back projected as they are retrieved")
+           .nargs(2);
+
+    program.add_argument("--angle_range")
+           .help("range of equally spaced projection angles in degrees [default: 180]")
+           .default_value(180.0f).scan<'g', float>();
+
+    program.add_argument("--tomo_threads")
+           .help("number of CPU threads of the back projection [default: all cores]")
+           .default_value(0).scan<'i', int>();
     
     program.add_argument("--batch_size", "-b")
-           .help("batch size of angles processed at a time")
-           .required().scan<'i', int>();
+           .help("batch size of angles processed at a time [default: tuned batch size]")
+           .scan<'i', int>();
+
+    program.add_argument("--auto_batch")
+           .help("use the largest batch size up to --batch_size which divides the angles and fits the device memory, not in tiled mode")
+           .default_value(false).implicit_value(true);
+
+    program.add_argument("--memory_budget")
+           .help("device memory in MB available to --auto_batch [default: 90% of the free memory]")
+           .scan<'g', float>();
 
     program.add_argument("--device_numbers", "-d")
            .help("number of GPUs to use [default: all GPU resources]")
@@ -90,6 +114,38 @@ int main(int argc, char* argv[])
            .help("propagation kernel method [0: fourier, 1: chirp, 2: chirplimited]")
            .default_value(0).scan<'i', int>();
 
+    program.add_argument("--tile_size", "-T")
+           .help("core size of tiles for holograms exceeding memory, guard bands are added from fresnel numbers")
+           .nargs(2).scan<'i', int>();
+
+    program.add_argument("--tile_batch", "-tb")
+           .help("number of tiles reconstructed at a time in tiled mode")
+           .default_value(1).scan<'i', int>();
+
+    program.add_argument("--resume", "-R")
+           .help("record finished angles and skip them when the output of an interrupted run exists")
+           .default_value(false).implicit_value(true);
+
+    program.add_argument("--tune")
+           .help("time short trials of the projection types, kernel types and batch sizes on the middle angle and store the best\n"
+                 "in the tuning cache, later runs of the same image size and number of holograms use it unless given explicitly")
+           .default_value(false).implicit_value(true);
+
+    program.add_argument("--tune_iterations")
+           .help("iterations of every tuning trial")
+           .default_value(20).scan<'i', int>();
+
+    program.add_argument("--tune_cache")
+           .help("tuning cache file [default: $HIHOLO_TUNE_CACHE or ~/.hiholo_tune]")
+           .default_value(TuneUtils::defaultCachePath());
+
+    program.add_argument("--perf")
+           .help("report bytes, flops and FFTs of every reconstruction stage with their throughput, synchronises between stages")
+           .default_value(false).implicit_value(true);
+
+    program.add_argument("--trace")
+           .help("write a Chrome trace of IO, kernels and communication of all processes to this json file");
+
     try {
         program.parse_args(argc, argv);
     } catch (const std::runtime_error& err) {
@@ -130,15 +186,13 @@ int main(int argc, char* argv[])
     int cols = static_cast<int>(dims[3]);
     IntArray imSize {rows, cols};
 
-    // Each process handles the same number of angles
+    // Each process handles the same number of angles, the volume needs all of them
+    if (program.is_used("--volume_output") && totalAngles % size != 0) {
+        throw std::runtime_error("Number of angles must be divisible by the number of processes for volume output!");
+    }
     int numAngles = totalAngles / size;
     int startAngle = rank * numAngles;
-    int batchSize = program.get<int>("-b");
-    batchSize = std::min(batchSize, numAngles);
-    if (numAngles % batchSize != 0) {
-        throw std::runtime_error("Number of angles must be divisible by batch size!");
-    }
-    FArray holograms(batchSize * numHolograms * rows * cols);
+    int batchSize = program.is_used("-b") ? std::min(program.get<int>("-b"), numAngles) : numAngles;
 
     auto fresnel_input = program.get<FArray>("-f");
     F2DArray fresnelNumbers;
@@ -153,7 +207,6 @@ int main(int argc, char* argv[])
     std::vector<std::string> inputPhase;
     if (program.is_used("-g")) {
        inputPhase = program.get<std::vector<std::string>>("-g");
-       initialPhase.resize(batchSize * rows * cols);
     }
 
     // Read algorithm parameters
@@ -196,6 +249,72 @@ int main(int argc, char* argv[])
     auto projectionType = static_cast<PMagnitudeCons::Type>(program.get<int>("-t"));
     auto kernelMethod = static_cast<CUDAPropKernel::Type>(program.get<int>("-m"));
 
+    // Tuned projection type, kernel type and batch size of the first process, explicit options take precedence
+    bool tuning = program.get<bool>("--tune");
+    if (tuning && program.is_used("-T")) {
+        throw std::runtime_error("Tuning is not supported in tiled mode!");
+    }
+    std::string tuneCache = program.get<std::string>("--tune_cache");
+    int tuned[4] {0, projectionType, kernelMethod, batchSize};
+    if (tuning) {
+        // Every process reads the middle angle collectively, the first one runs the trials on its device
+        FArray sample(numHolograms * rows * cols);
+        IOUtils::read4DimData(inputs[0], inputs[1], sample, totalAngles / 2, 1, MPI_COMM_WORLD);
+        if (rank == 0) {
+            std::vector<TuneUtils::Trial> trials;
+            auto best = PhaseRetrieval::tune(sample, numHolograms, imSize, fresnelNumbers, program.get<int>("--tune_iterations"), algorithm,
+                                             parameters, phaseLimits[0], phaseLimits[1], ampLimits[0], ampLimits[1], support, outsideValue,
+                                             padSize, padType, padValue, batchSize, numAngles, &trials);
+            std::cout << "Tuning trials (projection, kernel, batch, ms per iteration, error decrease per second):" << std::endl;
+            for (const auto &trial: trials) {
+                std::cout << "  " << TuneUtils::projectionName(trial.projectionType) << " " << TuneUtils::kernelName(trial.kernelType) << " "
+                          << trial.batchSize << " " << trial.iterationSeconds * 1e3 << " " << trial.errorDecrease << std::endl;
+            }
+            if (!TuneUtils::saveConfig(tuneCache, imSize, numHolograms, best)) {
+                std::cerr << "Failed to write tuning cache " << tuneCache << std::endl;
+            }
+            tuned[0] = 1;
+            tuned[1] = best.projectionType;
+            tuned[2] = best.kernelType;
+            tuned[3] = best.batchSize;
+        }
+    } else if (rank == 0) {
+        TuneUtils::Trial cached;
+        if (TuneUtils::loadConfig(tuneCache, imSize, numHolograms, cached)) {
+            tuned[0] = 1;
+            tuned[1] = cached.projectionType;
+            tuned[2] = cached.kernelType;
+            tuned[3] = cached.batchSize;
+        }
+    }
+    MPI_Bcast(tuned, 4, MPI_INT, 0, MPI_COMM_WORLD);
+
+    if (tuned[0]) {
+        if (!program.is_used("-t")) {
+            projectionType = static_cast<PMagnitudeCons::Type>(tuned[1]);
+        }
+        if (!program.is_used("-m")) {
+            kernelMethod = static_cast<CUDAPropKernel::Type>(tuned[2]);
+        }
+        if (!program.is_used("-b") || tuning) {
+            // A cached batch size may stem from another number of angles
+            batchSize = std::min(tuned[3], numAngles);
+            while (numAngles % batchSize != 0) {
+                batchSize--;
+            }
+        }
+    } else if (!program.is_used("-b") && !program.is_used("-T")) {
+        throw std::runtime_error("Batch size is required without a tuned configuration!");
+    }
+
+    bool autoBatch = program.get<bool>("--auto_batch") && !program.is_used("-T");
+    if (!autoBatch && numAngles % batchSize != 0) {
+        throw std::runtime_error("Number of angles must be divisible by batch size!");
+    }
+    if (!inputPhase.empty()) {
+        initialPhase.resize(batchSize * rows * cols);
+    }
+
     if (rank == 0) {
         std::cout << "Choosing algorithm: ";
         switch (algorithm) {
@@ -224,50 +343,256 @@ int main(int argc, char* argv[])
         std::cout << std::endl;
     }
 
-    std::vector<std::string> outputs = program.get<std::vector<std::string>>("-O");
-    if (outputs[0] == inputs[0]) {
-        throw std::runtime_error("Input and output files cannot be the same!");
+    bool savePhases = program.is_used("-O");
+    bool streamVolume = program.is_used("--volume_output");
+    if (!savePhases && !streamVolume) {
+        throw std::runtime_error("Either phase maps or volume output must be given!");
+    }
+    std::vector<std::string> outputs, volumeOutputs;
+    if (savePhases) {
+        outputs = program.get<std::vector<std::string>>("-O");
+        if (outputs[0] == inputs[0]) {
+            throw std::runtime_error("Input and output files cannot be the same!");
+        }
+    }
+    if (streamVolume) {
+        volumeOutputs = program.get<std::vector<std::string>>("--volume_output");
+        if (volumeOutputs[0] == inputs[0] || (savePhases && volumeOutputs[0] == outputs[0])) {
+            throw std::runtime_error("Volume output file must differ from the other files!");
+        }
     }
     std::vector<hsize_t> outputDims = {dims[0], dims[2], dims[3]};
-    
-    auto reconstructor = PhaseRetrieval::Reconstructor(batchSize, numHolograms, imSize, fresnelNumbers, iterations, algorithm,
+
+    // Every process plans on its own device, all use the smallest plan
+    if (autoBatch) {
+        size_t budget = program.is_used("--memory_budget") ? static_cast<size_t>(program.get<float>("--memory_budget") * (1 << 20))
+                                                           : PhaseRetrieval::deviceBudget();
+        bool objectConstraints = phaseLimits[0] != -FloatInf || phaseLimits[1] != FloatInf || !support.empty();
+        auto footprint = [&](int batch) {
+            return PhaseRetrieval::iterFootprint(batch, numHolograms, imSize, padSize, projectionType, objectConstraints, !support.empty());
+        };
+        int planned = PhaseRetrieval::planBatchSize(footprint, budget, batchSize, numAngles);
+        MPI_Allreduce(MPI_IN_PLACE, &planned, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+        if (planned == 0) {
+            throw std::runtime_error("A single angle does not fit into the device memory budget!");
+        }
+        batchSize = planned;
+        if (!initialPhase.empty()) {
+            initialPhase.resize(batchSize * rows * cols);
+        }
+        if (rank == 0) {
+            std::cout << "Planned batch size " << batchSize << " needing " << (footprint(batchSize) >> 20) << " MB of "
+                      << (budget >> 20) << " MB" << std::endl;
+        }
+    }
+
+    // In tiled mode only windows of one angle are held in memory, angles are processed one by one
+    std::unique_ptr<PhaseRetrieval::TiledReconstructor> tiler;
+    IntArray reconsSize = imSize;
+    int reconsBatch = batchSize;
+    if (program.is_used("-T")) {
+        if (!support.empty()) {
+            throw std::runtime_error("Support constraint is not supported in tiled mode!");
+        }
+        tiler = std::make_unique<PhaseRetrieval::TiledReconstructor>(imSize, numHolograms, fresnelNumbers, program.get<IntArray>("-T"),
+                                                                     program.get<int>("-tb"));
+        reconsSize = tiler->getWindowSize();
+        reconsBatch = tiler->getTileBatch();
+        if (!initialPhase.empty()) {
+            initialPhase.resize(rows * cols);
+        }
+        if (rank == 0) {
+            std::cout << "Tiled mode: " << tiler->getTiles().size() << " tiles of " << reconsSize[0] << "x" << reconsSize[1]
+                      << " with guard band " << tiler->getGuardBand() << std::endl;
+        }
+    }
+
+    auto reconstructor = PhaseRetrieval::Reconstructor(reconsBatch, numHolograms, reconsSize, fresnelNumbers, iterations, algorithm,
                                                        parameters, phaseLimits[0], phaseLimits[1], ampLimits[0], ampLimits[1],
                                                        support, outsideValue, padSize, padType, padValue, projectionType, kernelMethod);
     
-    // Create output dataset before processing
-    if(!IOUtils::createFileDataset(outputs[0], outputs[1], outputDims, MPI_COMM_WORLD)) {
+    // Every rank back projects its slab of rows of all phase maps, which are exchanged after each batch
+    std::unique_ptr<StreamingTomography> tomography;
+    IntArray rowStarts;
+    if (streamVolume) {
+        if (size > rows) {
+            throw std::runtime_error("The number of processes exceeds the number of rows!");
+        }
+        for (int r = 0; r <= size; r++) {
+            rowStarts.push_back(r * rows / size);
+        }
+        FArray angles(totalAngles);
+        float angleRange = program.get<float>("--angle_range") * static_cast<float>(M_PI) / 180.0f;
+        for (int i = 0; i < totalAngles; i++) {
+            angles[i] = i * angleRange / totalAngles;
+        }
+        tomography.reset(new StreamingTomography(cols, rowStarts[rank], rowStarts[rank + 1], angles,
+                                                 program.get<int>("--tomo_threads")));
+    }
+
+    // Sends the rows of count phase maps, starting at the local angle first, to the ranks owning them
+    auto streamPhases = [&](const FArray &result, int first, int count) {
+        IntArray sendCounts, sendDispls, recvCounts, recvDispls;
+        FArray sendRows;
+        for (int r = 0; r < size; r++) {
+            sendDispls.push_back(static_cast<int>(sendRows.size()));
+            for (int j = 0; j < count; j++) {
+                const float *rowsOf = result.data() + (static_cast<size_t>(j) * rows + rowStarts[r]) * cols;
+                sendRows.insert(sendRows.end(), rowsOf, rowsOf + (rowStarts[r + 1] - rowStarts[r]) * cols);
+            }
+            sendCounts.push_back(static_cast<int>(sendRows.size()) - sendDispls[r]);
+        }
+        int depth = tomography->getDepth();
+        for (int r = 0; r < size; r++) {
+            recvCounts.push_back(count * depth * cols);
+            recvDispls.push_back(r * count * depth * cols);
+        }
+        FArray recvRows(static_cast<size_t>(size) * count * depth * cols);
+        TRACE_SCOPE("row exchange", "mpi");
+        MPI_Alltoallv(sendRows.data(), sendCounts.data(), sendDispls.data(), MPI_FLOAT, recvRows.data(),
+                      recvCounts.data(), recvDispls.data(), MPI_FLOAT, MPI_COMM_WORLD);
+
+        // The back projection runs in the background while the next batch is retrieved
+        for (int r = 0; r < size; r++) {
+            for (int j = 0; j < count; j++) {
+                tomography->addProjection(r * numAngles + first + j,
+                                          recvRows.data() + (static_cast<size_t>(r) * count + j) * depth * cols);
+            }
+        }
+    };
+
+    // Create output dataset before processing, or reopen it with the progress of a previous run
+    bool resume = program.get<bool>("-R");
+    if (resume && (!savePhases || streamVolume)) {
+        throw std::runtime_error("Resuming needs the phase map output and no volume output!");
+    }
+    if (savePhases && !IOUtils::createFileDataset(outputs[0], outputs[1], outputDims, MPI_COMM_WORLD, resume)) {
         throw std::runtime_error("Failed to create output file or dataset!");
     }
 
+    U8Array done;
+    if (resume && !IOUtils::readProgress(outputs[0], outputs[1], done, MPI_COMM_WORLD)) {
+        throw std::runtime_error("Failed to read progress of output dataset!");
+    }
+
+    // Reads and writes are collective, so a step is only skipped once it is finished on every process
+    auto finished = [&](int offset, int count) {
+        int local = resume && std::all_of(done.begin() + offset, done.begin() + offset + count,
+                                          [](uint8_t flag) { return flag != 0; }) ? 1 : 0;
+        int global;
+        TRACE_SCOPE("progress reduce", "mpi");
+        MPI_Allreduce(&local, &global, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+        return global == 1;
+    };
+
+    bool perf = program.get<bool>("--perf");
+    PerfUtils::PerfReport report;
+    if (program.is_used("--trace")) {
+        MPI_Barrier(MPI_COMM_WORLD);
+        TraceUtils::enable(rank, [] { cudaDeviceSynchronize(); });
+    }
     auto totalStart = std::chrono::high_resolution_clock::now();
     auto totalComputeTime = std::chrono::duration<double>::zero();
 
-    for (int i = 0; i < numAngles / batchSize; i++) {
+    for (int i = 0; tiler && i < numAngles; i++) {
+       int globalIndex = startAngle + i;
+       if (finished(globalIndex, 1)) {
+           continue;
+       }
        if (rank == 0) {
-           std::cout << "Processing batch " << i + 1 << "/" << numAngles / batchSize << std::endl;
+           std::cout << "Processing angle " << i + 1 << "/" << numAngles << std::endl;
+       }
+       if (!initialPhase.empty()) {
+           IOUtils::read3DimData(inputPhase[0], inputPhase[1], initialPhase, globalIndex, 1, MPI_COMM_WORLD);
+       }
+
+       auto reader = [&](const PhaseRetrieval::Tile &tile, float *window) {
+           if (!IOUtils::read4DimTile(inputs[0], inputs[1], window, globalIndex, tile.row, tile.col, reconsSize[0], reconsSize[1])) {
+               throw std::runtime_error("Failed to read hologram tile!");
+           }
+       };
+
+       auto start = std::chrono::high_resolution_clock::now();
+       auto result = tiler->reconstruct(reader, initialPhase, [&](const FArray &windows, const FArray &phases) {
+           return reconstructor.reconsBatch(windows, phases, perf ? &report : nullptr);
+       });
+       auto end = std::chrono::high_resolution_clock::now();
+       totalComputeTime += std::chrono::duration_cast<std::chrono::duration<double>>(end - start);
+
+       if (savePhases) {
+           IOUtils::write3DimData(outputs[0], outputs[1], result, outputDims, globalIndex, MPI_COMM_WORLD);
+       }
+       if (resume) {
+           IOUtils::markProgress(outputs[0], outputs[1], globalIndex, 1, MPI_COMM_WORLD);
        }
+       if (streamVolume) {
+           streamPhases(result, i, 1);
+       }
+    }
+
+    FArray holograms(tiler ? 0 : batchSize * numHolograms * rows * cols);
+    for (int i = 0; !tiler && i < numAngles / batchSize; i++) {
        int globalIndex = startAngle + i * batchSize;
+       if (finished(globalIndex, batchSize)) {
+           continue;
+       }
+       if (rank == 0) {
+           std::cout << "Processing batch " << i + 1 << "/" << numAngles / batchSize << std::endl;
+       }
        IOUtils::read4DimData(inputs[0], inputs[1], holograms, globalIndex, batchSize, MPI_COMM_WORLD);
        if (!initialPhase.empty()) {
            IOUtils::read3DimData(inputPhase[0], inputPhase[1], initialPhase, globalIndex, batchSize, MPI_COMM_WORLD);
        }
        
        auto start = std::chrono::high_resolution_clock::now();
-       auto result = reconstructor.reconsBatch(holograms, initialPhase);
+       auto result = reconstructor.reconsBatch(holograms, initialPhase, perf ? &report : nullptr);
        auto end = std::chrono::high_resolution_clock::now();
        totalComputeTime += std::chrono::duration_cast<std::chrono::duration<double>>(end - start);
 
-       IOUtils::write3DimData(outputs[0], outputs[1], result, outputDims, globalIndex, MPI_COMM_WORLD);
+       if (savePhases) {
+           IOUtils::write3DimData(outputs[0], outputs[1], result, outputDims, globalIndex, MPI_COMM_WORLD);
+       }
+       if (resume) {
+           IOUtils::markProgress(outputs[0], outputs[1], globalIndex, batchSize, MPI_COMM_WORLD);
+       }
+       if (streamVolume) {
+           streamPhases(result, i * batchSize, batchSize);
+       }
+    }
+
+    if (streamVolume) {
+        FArray slices = tomography->finish();
+        std::vector<hsize_t> volumeDims {dims[2], dims[3], dims[3]};
+        if (!IOUtils::createFileDataset(volumeOutputs[0], volumeOutputs[1], volumeDims, MPI_COMM_WORLD)) {
+            throw std::runtime_error("Failed to create volume file or dataset!");
+        }
+        IOUtils::write3DimData(volumeOutputs[0], volumeOutputs[1], slices, volumeDims, rowStarts[rank], MPI_COMM_WORLD);
     }
 
     MPI_Barrier(MPI_COMM_WORLD);
     auto totalEnd = std::chrono::high_resolution_clock::now();
+    size_t peakMemory = reconstructor.getPeakMemory();
+    MPI_Allreduce(MPI_IN_PLACE, &peakMemory, 1, MPI_UNSIGNED_LONG, MPI_MAX, MPI_COMM_WORLD);
 
     if (rank == 0) {
         std::cout << "Finished phase retrieval for " << totalAngles << " angles on " << devices << " GPUs" << std::endl;
         auto totalDuration = std::chrono::duration_cast<std::chrono::duration<double>>(totalEnd - totalStart);
         std::cout << "Total computation time: " << totalComputeTime.count() << " seconds" << std::endl;
         std::cout << "Total elapsed time: " << totalDuration.count() << " seconds" << std::endl;
+        std::cout << "Peak device memory: " << (peakMemory >> 20) << " MB" << std::endl;
+    }
+
+    if (perf) {
+        IOUtils::reduceReport(report, MPI_COMM_WORLD);
+        if (rank == 0) {
+            report.print(std::cout);
+            std::cout << report.toJson() << std::endl;
+        }
+    }
+
+    if (program.is_used("--trace")) {
+        TraceUtils::disable();
+        IOUtils::writeTrace(program.get<std::string>("--trace"), MPI_COMM_WORLD);
     }
 
     MPI_Finalize();
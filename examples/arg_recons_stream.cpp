@@ -0,0 +1,232 @@
+#include <argparse/argparse.hpp>
+#include <chrono>
+#include <memory>
+#include <thread>
+
+#include "holo_recons.h"
+#include "io_utils.h"
+
+int main(int argc, char* argv[])
+{
+    argparse::ArgumentParser program("holo_recons_stream");
+    program.set_usage_max_line_width(120);
+
+    // Add arguments to ArgumentParser object
+    program.add_argument("--input_files", "-I")
+           .help("hdf5 file and dataset growing during acquisition, written in SWMR mode as\n"
+                 "[angles][distances][rows][cols] extended by complete angles, or [frames][rows][cols] angle by angle")
+           .required().nargs(2);
+
+    program.add_argument("--output_files", "-O")
+           .help("output hdf5 file and dataset, phase maps are appended as angles are reconstructed")
+           .required().nargs(2);
+
+    program.add_argument("--fresnel_numbers", "-f")
+           .help("list of fresnel numbers corresponding to holograms")
+           .required().nargs(argparse::nargs_pattern::at_least_one)
+           .scan<'g', float>();
+
+    program.add_argument("--total_angles", "-n")
+           .help("stop after this number of angles [default: when no frames arrive within the idle timeout]")
+           .default_value(0).scan<'i', int>();
+
+    program.add_argument("--poll_interval")
+           .help("milliseconds between checks for new frames")
+           .default_value(500).scan<'i', int>();
+
+    program.add_argument("--idle_timeout")
+           .help("seconds without new frames after which the acquisition is considered finished")
+           .default_value(60).scan<'i', int>();
+
+    program.add_argument("--device", "-d")
+           .help("GPU to use")
+           .default_value(0).scan<'i', int>();
+
+    program.add_argument("--iterations", "-i")
+           .help("iterations of the iterative reconstruction, 0 keeps the CTF quick look")
+           .default_value(0).scan<'i', int>();
+
+    program.add_argument("--algorithm", "-a")
+           .help("phase retrieval algorithm of the iterative reconstruction [0: ap, 1: raar, 2: hio, 3: drap]")
+           .default_value(0).scan<'i', int>();
+
+    program.add_argument("--ratio", "-r")
+           .help("fixed ratio between absorption and phase shifts")
+           .default_value(0.0f).scan<'g', float>();
+
+    program.add_argument("--low_freq_lim", "-L")
+           .help("regularisation parameters for low frequencies [default: 1e-3]")
+           .default_value(1e-3f).scan<'g', float>();
+
+    program.add_argument("--high_freq_lim", "-H")
+           .help("regularisation parameters for high frequencies [default: 1e-1]")
+           .default_value(1e-1f).scan<'g', float>();
+
+    program.add_argument("--padding_size", "-S")
+           .help("size to pad on holograms")
+           .nargs(2).scan<'i', int>();
+
+    program.add_argument("--padding_type", "-p")
+           .help("type of padding matrix around [0: constant, 1: replicate, 2: fadeout]")
+           .default_value(1).scan<'i', int>();
+
+    program.add_argument("--padding_value", "-V")
+           .help("value to pad on holograms and initial phase")
+           .default_value(0.0f).scan<'g', float>();
+
+    try {
+        program.parse_args(argc, argv);
+    } catch (const std::runtime_error& err) {
+        std::cerr << err.what() << std::endl;
+        std::cerr << program;
+        return 1;
+    }
+
+    int deviceCount;
+    cudaError_t error = cudaGetDeviceCount(&deviceCount);
+    if (error != cudaSuccess || deviceCount == 0) {
+        throw std::runtime_error("No CUDA capable GPU device found!");
+    }
+    int deviceId = program.get<int>("-d");
+    if (deviceId < 0 || deviceId >= deviceCount) {
+        throw std::runtime_error("Invalid GPU to use!");
+    }
+    cudaSetDevice(deviceId);
+
+    std::vector<std::string> inputs = program.get<std::vector<std::string>>("-I");
+    std::vector<std::string> outputs = program.get<std::vector<std::string>>("-O");
+    if (outputs[0] == inputs[0]) {
+        throw std::runtime_error("Input and output files cannot be the same!");
+    }
+
+    auto fresnel_input = program.get<FArray>("-f");
+    F2DArray fresnelNumbers;
+    for (const auto &group: fresnel_input) {
+        fresnelNumbers.push_back({group});
+    }
+    int numHolograms = static_cast<int>(fresnelNumbers.size());
+
+    int totalAngles = program.get<int>("-n");
+    auto pollInterval = std::chrono::milliseconds(program.get<int>("--poll_interval"));
+    auto idleTimeout = std::chrono::seconds(program.get<int>("--idle_timeout"));
+    int iterations = program.get<int>("-i");
+    auto algorithm = static_cast<ProjectionSolver::Algorithm>(program.get<int>("-a"));
+
+    FArray parameters;
+    if (algorithm == ProjectionSolver::Algorithm::RAAR) {
+       parameters = {0.75, 0.99, 20};
+    } else if (algorithm == ProjectionSolver::Algorithm::HIO ||
+               algorithm == ProjectionSolver::Algorithm::DRAP) {
+       parameters = {0.7};
+    }
+
+    IntArray padSize;
+    CUDAUtils::PaddingType padType = CUDAUtils::PaddingType::Replicate;
+    float padValue = 0.0f;
+    if (program.is_used("-S")) {
+       padSize = program.get<IntArray>("-S");
+       padType = static_cast<CUDAUtils::PaddingType>(program.get<int>("-p"));
+       padValue = program.get<float>("-V");
+    }
+
+    // Reconstructors and output are set up once the first frames reveal the image size
+    std::unique_ptr<PhaseRetrieval::CTFReconstructor> ctfReconstructor;
+    std::unique_ptr<PhaseRetrieval::Reconstructor> reconstructor;
+    IntArray imSize;
+    // Input and output stay open in SWMR read and write mode for the whole run
+    hid_t inputFile = H5I_INVALID_HID, inputDataset = H5I_INVALID_HID;
+    hid_t outputFile = H5I_INVALID_HID, outputDataset = H5I_INVALID_HID;
+    bool frameLayout = false;
+    FArray holograms;
+
+    int processed = 0;
+    auto start = std::chrono::high_resolution_clock::now();
+    auto lastArrival = start;
+    auto totalComputeTime = std::chrono::duration<double>::zero();
+
+    while (totalAngles <= 0 || processed < totalAngles) {
+        // An angle is complete once all of its distances are in the dataset
+        std::vector<hsize_t> dims;
+        int available = 0;
+        if (inputDataset < 0) {
+            IOUtils::openStreamDataset(inputs[0], inputs[1], inputFile, inputDataset);
+        }
+        if (inputDataset >= 0) {
+            if (!IOUtils::readStreamDims(inputDataset, dims)) {
+                throw std::runtime_error("Failed to read dimensions of holograms!");
+            }
+            if (dims.size() != 3 && dims.size() != 4) {
+                throw std::runtime_error("Invalid holograms or dimensions!");
+            }
+            // Only the first dimension may grow during the acquisition
+            if (!imSize.empty() && (static_cast<int>(dims[dims.size() - 2]) != imSize[0] ||
+                                    static_cast<int>(dims[dims.size() - 1]) != imSize[1] || (dims.size() == 3) != frameLayout)) {
+                throw std::runtime_error("The hologram dimensions changed during the acquisition!");
+            }
+            frameLayout = dims.size() == 3;
+            if (!frameLayout && static_cast<int>(dims[1]) != numHolograms) {
+                throw std::runtime_error("Number of distances does not match fresnel numbers!");
+            }
+            available = static_cast<int>(frameLayout ? dims[0] / numHolograms : dims[0]);
+            if (totalAngles > 0) {
+                available = std::min(available, totalAngles);
+            }
+        }
+
+        if (processed >= available) {
+            if (std::chrono::high_resolution_clock::now() - lastArrival > idleTimeout) {
+                std::cout << "No new frames within " << idleTimeout.count() << " seconds, stopping" << std::endl;
+                break;
+            }
+            std::this_thread::sleep_for(pollInterval);
+            continue;
+        }
+
+        if (imSize.empty()) {
+            imSize = {static_cast<int>(dims[dims.size() - 2]), static_cast<int>(dims[dims.size() - 1])};
+            if (iterations > 0) {
+                reconstructor.reset(new PhaseRetrieval::Reconstructor(1, numHolograms, imSize, fresnelNumbers, iterations, algorithm, parameters,
+                                                                      -FloatInf, FloatInf, 0, FloatInf, IntArray(), 1.0f, padSize, padType,
+                                                                      padValue, PMagnitudeCons::Averaged, CUDAPropKernel::Fourier));
+            } else {
+                ctfReconstructor.reset(new PhaseRetrieval::CTFReconstructor(1, numHolograms, imSize, fresnelNumbers, program.get<float>("-L"),
+                                                                            program.get<float>("-H"), program.get<float>("-r"), padSize,
+                                                                            padType, padValue));
+            }
+            if (!IOUtils::createStreamDataset(outputs[0], outputs[1], imSize[0], imSize[1], outputFile, outputDataset)) {
+                throw std::runtime_error("Failed to create output file or dataset!");
+            }
+        }
+
+        // Reconstruct every angle that arrived since the last check
+        for (; processed < available; processed++) {
+            hsize_t offset = frameLayout ? static_cast<hsize_t>(processed) * numHolograms : processed;
+            hsize_t count = frameLayout ? numHolograms : 1;
+            if (!IOUtils::readStreamSlices(inputDataset, holograms, offset, count)) {
+                throw std::runtime_error("Failed to read holograms of angle " + std::to_string(processed) + "!");
+            }
+
+            auto computeStart = std::chrono::high_resolution_clock::now();
+            FArray result = reconstructor ? reconstructor->reconsBatch(holograms, FArray()) : ctfReconstructor->reconsBatch(holograms);
+            auto computeEnd = std::chrono::high_resolution_clock::now();
+            totalComputeTime += std::chrono::duration_cast<std::chrono::duration<double>>(computeEnd - computeStart);
+
+            if (!IOUtils::appendStreamSlices(outputDataset, result, processed, imSize[0], imSize[1])) {
+                throw std::runtime_error("Failed to write phase of angle " + std::to_string(processed) + "!");
+            }
+            std::cout << "Reconstructed angle " << processed + 1 << std::endl;
+        }
+        lastArrival = std::chrono::high_resolution_clock::now();
+    }
+
+    IOUtils::closeStreamDataset(inputFile, inputDataset);
+    IOUtils::closeStreamDataset(outputFile, outputDataset);
+
+    auto end = std::chrono::high_resolution_clock::now();
+    std::cout << "Finished phase retrieval for " << processed << " angles" << std::endl;
+    std::cout << "Total computation time: " << totalComputeTime.count() << " seconds" << std::endl;
+    std::cout << "Total elapsed time: " << std::chrono::duration_cast<std::chrono::duration<double>>(end - start).count()
+              << " seconds" << std::endl;
+
+    return 0;
+}
@@ -1,7 +1,9 @@
+#include <argparse/argparse.hpp>
 #include <iostream>
 #include <chrono>
 
 #include "IRPSolver.h"
+#include "io_utils.h"
 
 int main(int argc, char* argv[])
 {
@@ -11,6 +13,87 @@ int main(int argc, char* argv[])
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &size);
 
+    argparse::ArgumentParser program("holo_recons_pirp");
+    program.set_usage_max_line_width(120);
+
+    program.add_argument("--input_pattern", "-I")
+           .help("printf pattern of raw float hologram files, numbered from 1")
+           .default_value(std::string("/home/hujiarui/workspace/irp_code/data/detector_intensity%02d_130x130px.raw"));
+
+    program.add_argument("--output_file", "-O")
+           .help("raw float file of the reconstructed volume")
+           .default_value(std::string("../result.raw"));
+
+    program.add_argument("--image_size", "-s")
+           .help("rows and columns of holograms")
+           .nargs(2).default_value(IntArray{130, 130}).scan<'i', int>();
+
+    program.add_argument("--angles", "-a")
+           .help("total number of equally spaced projection angles over 180 degrees")
+           .default_value(90).scan<'i', int>();
+
+    program.add_argument("--angles_file", "-A")
+           .help("hdf5 file and dataset of projection angles in degrees, replaces --angles")
+           .nargs(2);
+
+    program.add_argument("--fresnel_numbers", "-f")
+           .help("fresnel number of the holograms")
+           .default_value(1.0f).scan<'g', float>();
+
+    program.add_argument("--kmax", "-k")
+           .help("maximum number of outer iterations")
+           .default_value(2).scan<'i', int>();
+
+    program.add_argument("--epsilon", "-e")
+           .help("error decrease below which the ART iterations double [default: 1e-5]")
+           .default_value(1e-5f).scan<'g', float>();
+
+    program.add_argument("--art_iterations", "-i")
+           .help("initial number of ART iterations per outer iteration")
+           .default_value(100).scan<'i', int>();
+
+    program.add_argument("--max_art_iterations", "-m")
+           .help("stop once the doubled ART iterations would exceed this limit")
+           .default_value(1000).scan<'i', int>();
+
+    program.add_argument("--subsets", "-n")
+           .help("number of ordered subsets of angles in ART")
+           .default_value(10).scan<'i', int>();
+
+    program.add_argument("--subset_order", "-o")
+           .help("order of visiting subsets [0: sequential, 1: interleaved, 2: bit-reversal, 3: golden-ratio, 4: max-spread]")
+           .default_value(2).scan<'i', int>();
+
+    program.add_argument("--streams", "-S")
+           .help("number of CUDA streams of the projectors")
+           .default_value(1).scan<'i', int>();
+
+    program.add_argument("--cpu_threads", "-t")
+           .help("run ART on the CPU with this number of threads [0: all cores]")
+           .scan<'i', int>();
+
+    program.add_argument("--cache_matrix", "-c")
+           .help("precompute the projection weights as a sparse matrix")
+           .default_value(false).implicit_value(true);
+
+    program.add_argument("--fbp_init", "-F")
+           .help("start ART from the filtered back projection bounded by the max map")
+           .default_value(false).implicit_value(true);
+
+    program.add_argument("--trace")
+           .help("write a Chrome trace of IO, kernels and communication of all processes to this json file");
+
+    try {
+        program.parse_args(argc, argv);
+    } catch (const std::runtime_error& err) {
+        if (rank == 0) {
+            std::cerr << err.what() << std::endl;
+            std::cerr << program;
+        }
+        MPI_Finalize();
+        return 1;
+    }
+
     int deviceCount;
     cudaError_t error = cudaGetDeviceCount(&deviceCount);
     if (error != cudaSuccess || deviceCount == 0) {
@@ -20,44 +103,76 @@ int main(int argc, char* argv[])
     int deviceId = rank % deviceCount;
     cudaSetDevice(deviceId);
 
-    int rows = 130;
-    int cols = 130;
-    IntArray imSize {rows, cols};
+    IntArray imSize = program.get<IntArray>("-s");
+    int rows = imSize[0];
+    int cols = imSize[1];
 
-    // Each process handles the same number of angles
-    int totalAngles = 90;
-    int numAngles = totalAngles / size;
+    // Angles in radians, read from file or equally spaced
+    FArray angles;
+    if (program.is_used("-A")) {
+        std::vector<std::string> angleInputs = program.get<std::vector<std::string>>("-A");
+        if (!IOUtils::readAngles(angleInputs[0], angleInputs[1], angles)) {
+            throw std::runtime_error("Failed to read projection angles!");
+        }
+        for (auto &angle: angles) {
+            angle *= static_cast<float>(M_PI) / 180.0f;
+        }
+    } else {
+        int numAll = program.get<int>("-a");
+        for (int i = 0; i < numAll; i++) {
+            angles.push_back(i * static_cast<float>(M_PI) / numAll);
+        }
+    }
+
+    // Each process handles a contiguous block of angles, the first ranks take one more if they do not divide evenly
+    int totalAngles = static_cast<int>(angles.size());
+    int angleStart = rank * (totalAngles / size) + std::min(rank, totalAngles % size);
+    int numAngles = totalAngles / size + (rank < totalAngles % size ? 1 : 0);
+    FArray localAngles(angles.begin() + angleStart, angles.begin() + angleStart + numAngles);
     int numImages = 1;
-    F2DArray fresnelNumbers(1, FArray(1, 1.0f));
+    F2DArray fresnelNumbers(1, FArray(1, program.get<float>("-f")));
+
+    ARTOptions artOptions = {program.get<int>("-i"), program.get<int>("-n"),
+                             static_cast<ARTOptions::Order>(program.get<int>("-o"))};
+    if (program.is_used("-t")) {
+        artOptions.device = ARTOptions::CPU;
+        artOptions.numThreads = program.get<int>("-t");
+    }
+    artOptions.cacheMatrix = program.get<bool>("-c");
+    if (program.get<bool>("-F")) {
+        artOptions.init = ARTOptions::FilteredBackProjection;
+    }
 
     // load images
     FArray holograms(numAngles * numImages * rows * cols);
-    float buffer[rows * cols];
-    float **dstack = new float*[numAngles];
-    char *filename = new char[100];
+    FArray buffer(rows * cols);
+    std::string pattern = program.get<std::string>("-I");
+    char *filename = new char[pattern.size() + 32];
     for (int i = 0; i < numAngles; i++) {
-		sprintf(filename, "/home/hujiarui/workspace/irp_code/data/detector_intensity%02d_130x130px.raw", i + 1 + rank * numAngles);
+        sprintf(filename, pattern.c_str(), i + 1 + angleStart);
         FILE *in = fopen(filename, "rb");
-        fread(buffer, sizeof(float), rows * cols, in);
-        dstack[i] = new float[rows * cols];
+        if (!in) {
+            throw std::runtime_error("Cannot open " + std::string(filename));
+        }
+        fread(buffer.data(), sizeof(float), rows * cols, in);
+        fclose(in);
+        float *hologram = holograms.data() + i * rows * cols;
         for (int x = 0; x < cols; x++) {
             for (int y = 0; y < rows; y++) {
-                dstack[i][x * rows + y] = buffer[y * cols + x];
+                hologram[x * rows + y] = buffer[y * cols + x];
             }
         }
-        fclose(in);
     }
-    for (int i = 0; i < numAngles; i++) {
-        memcpy(holograms.data() + i * rows * cols, dstack[i], rows * cols * sizeof(float));
-    }    
+    delete[] filename;
 
-    for (int i = 0; i < numAngles; i++) {
-        delete[] dstack[i];
+    if (program.is_used("--trace")) {
+        MPI_Barrier(MPI_COMM_WORLD);
+        TraceUtils::enable(rank, [] { cudaDeviceSynchronize(); });
     }
-    delete[] dstack; delete[] filename;
-
     auto start = std::chrono::high_resolution_clock::now();
-    FArray result = reconstruct_irp(holograms, totalAngles, numImages, imSize, fresnelNumbers, MPI_COMM_WORLD, 2, 1e-5f, 1);
+    FArray result = reconstruct_irp(holograms, localAngles, numImages, imSize, fresnelNumbers, MPI_COMM_WORLD,
+                                    program.get<int>("-k"), program.get<float>("-e"), program.get<int>("-S"),
+                                    artOptions, program.get<int>("-m"));
     auto end = std::chrono::high_resolution_clock::now();
 
     if (rank == 0) {
@@ -65,11 +180,16 @@ int main(int argc, char* argv[])
         auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
         std::cout << "Elapsed time: " << duration.count() << " milliseconds" << std::endl;
 
-        FILE *out = fopen("../result.raw", "w");
-        fwrite(result.data(), sizeof(float), rows * cols * rows, out);
+        FILE *out = fopen(program.get<std::string>("-O").c_str(), "w");
+        fwrite(result.data(), sizeof(float), result.size(), out);
         fclose(out);
     }
 
+    if (program.is_used("--trace")) {
+        TraceUtils::disable();
+        IOUtils::writeTrace(program.get<std::string>("--trace"), MPI_COMM_WORLD);
+    }
+
     MPI_Finalize();
     return 0;
-}
\ No newline at end of file
+}
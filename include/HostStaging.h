@@ -0,0 +1,42 @@
+#ifndef HOSTSTAGING_H_
+#define HOSTSTAGING_H_
+
+#include <cuda_runtime.h>
+#include <vector>
+#include "datatypes.h"
+
+/* Reusable page-locked host buffers of a reconstructor with a copy stream of their own. Data of every slot
+   (an angle of the batch) is uploaded and downloaded asynchronously, events order the copies against the
+   kernels, so the transfers of one angle overlap the computation of the others. If page-locked memory cannot
+   be allocated, or HIHOLO_PAGEABLE is set, uploads copy from the source and downloads go through aligned
+   pageable memory, they only overlap as far as the driver allows. Offsets and counts are in floats */
+class HostStaging
+{
+    private:
+        float *input;
+        float *output;
+        bool pinned;
+        FTensor pageableOutput;
+        cudaStream_t copyStream;
+        std::vector<cudaEvent_t> uploaded;
+        std::vector<cudaEvent_t> computed;
+        std::vector<cudaEvent_t> downloaded;
+
+    public:
+        HostStaging(size_t inputSize, size_t outputSize, int slots);
+        HostStaging(const HostStaging&) = delete;
+        HostStaging &operator=(const HostStaging&) = delete;
+        ~HostStaging();
+
+        bool isPinned() const {return pinned;}
+        // Stages count floats of src at offset and copies them to dst, later uploads of the same slot add to it
+        void upload(float *dst, const float *src, size_t count, size_t offset, int slot);
+        // Work queued in stream from now on starts once the uploads of slot have arrived
+        void waitUpload(int slot, cudaStream_t stream);
+        // Copies count floats of src to the staging at offset once the work queued in stream so far is done
+        void download(const float *src, size_t count, size_t offset, int slot, cudaStream_t stream);
+        // Blocks until the download of slot has arrived and copies it to dst
+        void collect(float *dst, size_t count, size_t offset, int slot);
+};
+
+#endif
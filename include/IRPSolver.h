@@ -2,7 +2,10 @@
 #define IRPSOLVER_H
 
 #include "Propagator.h"
+#include "art_utils.h"
+#include "SharedArray.h"
 #include <mpi.h>
+#include <functional>
 
 class Grid
 {
@@ -32,25 +35,100 @@ class CUDAStreamART
         cudaStream_t *streams;
         float *tp;
         float *tp_back;
-        int nx, ny;
+        int nx, nz;
         int numStreams;
 
     public:
-        CUDAStreamART(int ix, int iy, int N);
+        CUDAStreamART(int ix, int iz, int N);
         void syncStreams();
         void merge(float *project);
         void projectGrid(const Grid &grid, float *project, float phi);
-        void backProjectGrid(Grid &grid, const float *project, float phi, int size, int rank);
-        void maxMapGrid(Grid &grid, const float *project, float phi, int size, int rank);
+        void backProjectGrid(Grid &grid, const float *project, float phi);
+        void maxMapGrid(Grid &grid, const float *project, float phi);
         ~CUDAStreamART();
 };
 
+// System matrix resident on the device, the kernels read the weights instead of recomputing them
+class CUDASystemMatrix
+{
+    private:
+        int nx, ny;
+        int *rowOffsets;
+        int *columns;
+        float *weights;
+
+    public:
+        explicit CUDASystemMatrix(const ARTUtils::SystemMatrix &matrix);
+        CUDASystemMatrix(const CUDASystemMatrix&) = delete;
+        CUDASystemMatrix &operator=(const CUDASystemMatrix&) = delete;
+        void projectGrid(const Grid &grid, float *project, int angle);
+        void backProjectGrid(Grid &grid, const float *project, int angle);
+        void maxMapGrid(Grid &grid, const float *project, int angle);
+        ~CUDASystemMatrix();
+};
+
+/* Slab decomposition of the grid along the rotation axis z. Slices are independent, so each rank
+   reconstructs its z-range from all angles. Projections are distributed by angle outside the ART,
+   ranks may hold different numbers of angles, and are transposed to slabs before and after it,
+   in angle chunks with non-blocking all-to-all */
+class SlabExchange
+{
+    public:
+        // Called with the global indices of the angles in a chunk
+        typedef std::function<void(const IntArray&)> ChunkMethod;
+
+    private:
+        struct Chunk
+        {
+            int first, last;
+            IntArray angles;
+            std::vector<int> packedCounts, packedDispls;
+            std::vector<int> slabCounts, slabDispls;
+        };
+
+        MPI_Comm comm;
+        int rank, size;
+        int nx, nz;
+        int numAngles;
+        IntArray angleStarts;
+        IntArray zStarts;
+        std::vector<Chunk> chunks;
+        float *packed;
+
+    public:
+        SlabExchange(int ix, int iz, int numangles, MPI_Comm communicator, int numChunks = 4);
+        int getSlabStart() const {return zStarts[rank];}
+        int getSlabDepth() const {return zStarts[rank + 1] - zStarts[rank];}
+        int getNumAngles() const {return numAngles;}
+        int getAngleStart() const {return angleStarts[rank];}
+        int getTotalAngles() const {return angleStarts[size];}
+        // Angles of all ranks in global order
+        FArray gatherAngles(const FArray &localAngles) const;
+        // [numAngles][nx][nz] of local angles -> [totalAngles][nx][slab depth], arrived runs on each received chunk
+        void scatter(const float *angleProjs, float *slabProjs, const ChunkMethod &arrived = nullptr);
+        // produce fills the slab projections of a chunk before it is sent
+        void gather(const float *slabProjs, float *angleProjs, const ChunkMethod &produce = nullptr);
+        // Full volume on rank 0, empty on other ranks
+        FArray gatherGrid(const Grid &slab) const;
+        ~SlabExchange();
+};
+
 void grid_project(const float *grid, float *project, int nx, int nz, float phi, int start, int end, cudaStream_t stream = 0);
 void grid_back_project(float *grid, const float *project, int nx, int nz, float phi, int start, int end, cudaStream_t stream = 0);
 void grid_max_map(float *grid, const float *project, int nx, int nz, float phi, int start, int end, cudaStream_t stream = 0);
-void reprojectART(Grid &grid, float *projects, int totalAngles, int numStreams, float *angles, int iters, MPI_Comm comm);
+// System matrix built once per node and shared by its ranks, collective over comm
+ARTUtils::SystemMatrix buildSharedSystemMatrix(int nx, int ny, const FArray &angles, MPI_Comm comm);
+
+/* Reconstruct the slab from the local angle projections and replace them by the reprojections of the grid,
+   matrix is the system matrix of all angles when options.cacheMatrix is set */
+void reprojectART(Grid &grid, SlabExchange &exchange, float *angleProjs, float *slabProjs, int numStreams,
+                  const FArray &angles, const ARTOptions &options, const ARTUtils::SystemMatrix *matrix = nullptr);
 
-FArray reconstruct_irp(const FArray &holograms, int totalAngles, int numImages, const IntArray &imSize,
-        const F2DArray &fresnelNumbers, MPI_Comm comm, int kmax = 2, float epsilon = 1e-5f, int numStreams = 1);
+/* localAngles are the angles in radians of the holograms of this rank, any number per rank and any range.
+   Runs at most kmax outer iterations. ART starts with artOptions.iterations passes, which double whenever
+   the error decreases by less than epsilon, and the reconstruction stops when they would exceed maxARTIterations */
+FArray reconstruct_irp(const FArray &holograms, const FArray &localAngles, int numImages, const IntArray &imSize,
+        const F2DArray &fresnelNumbers, MPI_Comm comm, int kmax = 2, float epsilon = 1e-5f, int numStreams = 1,
+        const ARTOptions &artOptions = {100, 10, ARTOptions::BitReversal}, int maxARTIterations = 1000);
 
 #endif
\ No newline at end of file
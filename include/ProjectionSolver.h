@@ -10,11 +10,24 @@ struct IterationResult
     const F2DArray &finalError;
 };
 
+// Progress handed to observers, psi is the current wave field on the device and only valid during the call
+struct IterationState
+{
+    int iteration;
+    int iterations;
+    // Errors of this iteration, FloatInf when they are not calculated
+    float stepError;
+    float magnitudeError;
+    const WaveField &psi;
+};
+
 class ProjectionSolver
 {   
     public:
         enum Algorithm {AP, RAAR, HIO, DRAP, APWP, EPI};
         typedef std::function<void(ProjectionSolver*)> Method;
+        // Returning false stops the iteration, the final projection is still applied and observed once more
+        typedef std::function<bool(const IterationState&)> Observer;
 
     private:
         Projector *projMagnitude;
@@ -48,12 +61,16 @@ class ProjectionSolver
         int currentIteration;
         // Parameters for RAAR/HIO/DRAP algorithm        
         FArray parameters;
+        Observer observer;
+        int observeInterval;
 
     public:
         ProjectionSolver(Projector *PM, Projector *PS, const WaveField &initialPsi,
                          Algorithm algo, const FArray &algoParameters, bool calError = true);
         ProjectionSolver(Projector *PM, Projector *PS, const WaveField &initialPsi,
                          const WaveField &initialProbe, bool calError = true);
+        // Call observer every interval iterations
+        void setObserver(const Observer &iterationObserver, int interval = 1);
         IterationResult execute(int iterations);
         ~ProjectionSolver() = default;
 };
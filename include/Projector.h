@@ -26,6 +26,9 @@ struct Reflection
     float residual;
 };
 
+/* Projectors keep all state in the instance, different instances may be used concurrently
+   from different host threads. A single instance must not be shared between threads,
+   the scratch buffers are reused on every call */
 class Projector
 {
     public:
@@ -42,7 +45,6 @@ class PAmplitudeCons: public Projector
         /* Amplitude max:inf, min:0 */
         float maxAmplitude;
         float minAmplitude;
-        float *targetAmplitude;
     public:
         PAmplitudeCons(float minAmp, float maxAmp): minAmplitude(minAmp), maxAmplitude(maxAmp) {}
         virtual Projection project(const WaveField& psi) override;
@@ -56,7 +58,6 @@ class PPhaseCons: public Projector
         /* Phase max:inf, min:-inf */
         float maxPhase;
         float minPhase;
-        float *targetPhase;
     public:
         PPhaseCons(float minPha, float maxPha): minPhase(minPha), maxPhase(maxPha) {}
         virtual Projection project(const WaveField& psi) override;
@@ -99,7 +100,8 @@ class PMagnitudeCons: public Projector
         typedef std::function<void(PMagnitudeCons*)> Method;
         
     private:
-        static int currentIteration;
+        // Counts calls of project, selects the hologram in cyclic projection
+        int currentIteration;
         Type type;
         F2DArray fresnelNumbers;
         const float *measurements;
@@ -0,0 +1,81 @@
+#ifndef SHAREDARRAY_H_
+#define SHAREDARRAY_H_
+
+#include <mpi.h>
+#include <stdexcept>
+
+/* Read-only host array with one copy per node in an MPI-3 shared-memory window. The first rank of
+   each node owns and fills the memory, the other ranks of the node map the same pages. Construction
+   and sync are collective over the communicator */
+template <typename T>
+class SharedArray
+{
+    private:
+        MPI_Comm nodeComm;
+        MPI_Win window;
+        T *base;
+        size_t count;
+        int nodeRank;
+
+    public:
+        SharedArray(size_t n, MPI_Comm comm): base(nullptr), count(n)
+        {
+            int rank;
+            MPI_Comm_rank(comm, &rank);
+            MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &nodeComm);
+            MPI_Comm_rank(nodeComm, &nodeRank);
+
+            MPI_Aint bytes = nodeRank == 0 ? static_cast<MPI_Aint>(count * sizeof(T)) : 0;
+            if (MPI_Win_allocate_shared(bytes, sizeof(T), MPI_INFO_NULL, nodeComm, &base, &window) != MPI_SUCCESS) {
+                MPI_Comm_free(&nodeComm);
+                throw std::runtime_error("Cannot allocate shared memory window!");
+            }
+
+            MPI_Aint size;
+            int dispUnit;
+            MPI_Win_shared_query(window, 0, &size, &dispUnit, &base);
+            MPI_Win_lock_all(MPI_MODE_NOCHECK, window);
+        }
+
+        SharedArray(const SharedArray&) = delete;
+        SharedArray &operator=(const SharedArray&) = delete;
+
+        size_t size() const {return count;}
+        T *data() {return base;}
+        const T *data() const {return base;}
+        T &operator[](size_t i) {return base[i];}
+        const T &operator[](size_t i) const {return base[i];}
+
+        // Only the node owner writes, the others wait in sync until its writes are visible
+        bool isNodeOwner() const {return nodeRank == 0;}
+        MPI_Comm getNodeComm() const {return nodeComm;}
+        void sync()
+        {
+            MPI_Win_sync(window);
+            MPI_Barrier(nodeComm);
+            MPI_Win_sync(window);
+        }
+
+        ~SharedArray()
+        {
+            MPI_Win_unlock_all(window);
+            MPI_Win_free(&window);
+            MPI_Comm_free(&nodeComm);
+        }
+};
+
+/* Communicator of the node owners, MPI_COMM_NULL on the other ranks. Rank 0 of comm is always an owner
+   and rank 0 of the owners, so data read there reaches every node with one broadcast per node */
+inline MPI_Comm nodeOwnersComm(MPI_Comm comm)
+{
+    int rank, nodeRank;
+    MPI_Comm nodeComm, ownersComm;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &nodeComm);
+    MPI_Comm_rank(nodeComm, &nodeRank);
+    MPI_Comm_split(comm, nodeRank == 0 ? 0 : MPI_UNDEFINED, rank, &ownersComm);
+    MPI_Comm_free(&nodeComm);
+    return ownersComm;
+}
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef STREAMINGTOMOGRAPHY_H_
+#define STREAMINGTOMOGRAPHY_H_
+
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include "art_utils.h"
+
+/* Incremental filtered back projection of phase maps as they are retrieved, the volume is complete
+   once the last angle is added and no phase stack is written in between. The rotation axis runs
+   along the rows of the phase maps, each instance owns the slices of rows [zStart, zEnd). Projections
+   are filtered and back projected by a background thread with slab-parallel workers */
+class StreamingTomography
+{
+    private:
+        struct Projection
+        {
+            int angle;
+            FArray rows;
+        };
+
+        int nx;
+        int zStart, zEnd;
+        FArray angles;
+        FArray weights;
+        int numThreads;
+        size_t maxQueued;
+        FArray grid;
+        int processed;
+
+        std::deque<Projection> queue;
+        std::mutex mutex;
+        std::condition_variable queueChanged;
+        bool finished;
+        // First exception of the worker thread, which stops at it
+        std::exception_ptr error;
+        std::thread worker;
+
+        void workerLoop();
+        void backProject(const Projection &projection, FArray &project);
+
+    public:
+        StreamingTomography(int cols, int zstart, int zend, const FArray &allAngles, int numthreads = 0, int maxqueued = 16);
+        StreamingTomography(const StreamingTomography&) = delete;
+        StreamingTomography &operator=(const StreamingTomography&) = delete;
+
+        int getDepth() const {return zEnd - zStart;}
+        // Queue rows [zStart, zEnd) of the phase map of angle index, [depth][cols], blocks while the queue is full.
+        // Rethrows an exception raised by the worker thread
+        void addProjection(int angle, const float *rows);
+        // Wait for the queued projections and return the slices [depth][cols][cols], rethrows like addProjection
+        FArray finish();
+        ~StreamingTomography();
+};
+
+#endif
@@ -0,0 +1,162 @@
+#ifndef TENSOR_H_
+#define TENSOR_H_
+
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+/* Contiguous row-major N-D arrays on 64 byte aligned host memory, rows of floats can be loaded with aligned
+   SIMD instructions and the whole array handed to cudaMemcpy, HDF5 or numpy without repacking. A Tensor owns
+   its memory and is only moved, copies are explicit with clone. A TensorView is a non-owning window with the
+   shape and strides of a tensor or of any contiguous buffer, valid as long as the memory it points to */
+template <typename T>
+class TensorView
+{
+    private:
+        T *base;
+        std::vector<int> dims;
+        std::vector<size_t> steps;
+
+    public:
+        TensorView(): base(nullptr) {}
+        TensorView(T *data, const std::vector<int> &shape): base(data), dims(shape), steps(shape.size(), 1)
+        {
+            for (int i = static_cast<int>(dims.size()) - 2; i >= 0; i--) {
+                steps[i] = steps[i + 1] * dims[i + 1];
+            }
+        }
+        // Views of mutable elements convert to views of constant ones
+        template <typename U, typename = typename std::enable_if<std::is_same<const U, T>::value>::type>
+        TensorView(const TensorView<U> &view): TensorView(view.data(), view.shape()) {}
+
+        T *data() const {return base;}
+        T *begin() const {return base;}
+        T *end() const {return base + size();}
+        size_t size() const {return dims.empty() ? 0 : steps[0] * dims[0];}
+        bool empty() const {return size() == 0;}
+        int ndim() const {return static_cast<int>(dims.size());}
+        const std::vector<int> &shape() const {return dims;}
+        int shape(int axis) const {return dims[axis];}
+        // Distance in elements between neighbours along axis
+        size_t stride(int axis) const {return steps[axis];}
+        T &operator[](size_t i) const {return base[i];}
+
+        // Sub-tensor i along the leading axis
+        TensorView slice(int i) const
+        {
+            if (dims.empty() || i < 0 || i >= dims[0])
+                throw std::out_of_range("Tensor slice out of range!");
+            return TensorView(base + i * steps[0], std::vector<int>(dims.begin() + 1, dims.end()));
+        }
+};
+
+template <typename T>
+class Tensor
+{
+    public:
+        static const size_t alignment = 64;
+
+    private:
+        T *buffer;
+        std::vector<int> dims;
+        size_t count;
+
+        static size_t product(const std::vector<int> &shape)
+        {
+            size_t n = shape.empty() ? 0 : 1;
+            for (int extent: shape) {
+                if (extent < 0)
+                    throw std::invalid_argument("Negative tensor extent!");
+                n *= extent;
+            }
+            return n;
+        }
+
+    public:
+        Tensor(): buffer(nullptr), count(0) {}
+        // Elements are zero initialised
+        explicit Tensor(const std::vector<int> &shape): buffer(nullptr), dims(shape), count(product(shape))
+        {
+            static_assert(std::is_trivially_copyable<T>::value, "Tensor elements must be trivially copyable!");
+            if (count == 0)
+                return;
+            // aligned_alloc wants a multiple of the alignment
+            size_t bytes = (count * sizeof(T) + alignment - 1) / alignment * alignment;
+            buffer = static_cast<T*>(std::aligned_alloc(alignment, bytes));
+            if (!buffer)
+                throw std::bad_alloc();
+            std::fill(buffer, buffer + count, T());
+        }
+
+        Tensor(const Tensor&) = delete;
+        Tensor &operator=(const Tensor&) = delete;
+        Tensor(Tensor &&other) noexcept: buffer(other.buffer), dims(std::move(other.dims)), count(other.count)
+        {
+            other.buffer = nullptr;
+            other.count = 0;
+            other.dims.clear();
+        }
+        Tensor &operator=(Tensor &&other) noexcept
+        {
+            if (this != &other) {
+                std::free(buffer);
+                buffer = other.buffer;
+                dims = std::move(other.dims);
+                count = other.count;
+                other.buffer = nullptr;
+                other.count = 0;
+                other.dims.clear();
+            }
+            return *this;
+        }
+        ~Tensor() {std::free(buffer);}
+
+        Tensor clone() const
+        {
+            Tensor copy(dims);
+            std::copy(buffer, buffer + count, copy.buffer);
+            return copy;
+        }
+
+        T *data() {return buffer;}
+        const T *data() const {return buffer;}
+        T *begin() {return buffer;}
+        T *end() {return buffer + count;}
+        const T *begin() const {return buffer;}
+        const T *end() const {return buffer + count;}
+        size_t size() const {return count;}
+        bool empty() const {return count == 0;}
+        int ndim() const {return static_cast<int>(dims.size());}
+        const std::vector<int> &shape() const {return dims;}
+        int shape(int axis) const {return dims[axis];}
+        T &operator[](size_t i) {return buffer[i];}
+        const T &operator[](size_t i) const {return buffer[i];}
+
+        TensorView<T> view() {return TensorView<T>(buffer, dims);}
+        TensorView<const T> view() const {return TensorView<const T>(buffer, dims);}
+        TensorView<T> slice(int i) {return view().slice(i);}
+        TensorView<const T> slice(int i) const {return view().slice(i);}
+
+        // New extents of the same number of elements, the data stays in place
+        void reshape(const std::vector<int> &shape)
+        {
+            if (product(shape) != count)
+                throw std::invalid_argument("Reshaping changes the number of tensor elements!");
+            dims = shape;
+        }
+
+        // Hands the memory to the caller, who frees it with Tensor::deallocate
+        T *release()
+        {
+            T *memory = buffer;
+            buffer = nullptr;
+            count = 0;
+            dims.clear();
+            return memory;
+        }
+        static void deallocate(void *memory) {std::free(memory);}
+};
+
+#endif
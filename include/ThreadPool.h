@@ -0,0 +1,55 @@
+#ifndef THREADPOOL_H_
+#define THREADPOOL_H_
+
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <memory>
+#include <exception>
+#include <functional>
+#include <condition_variable>
+
+/* Work-stealing thread pool. Every worker owns a task deque, it takes its own tasks from the back
+   and steals from the front of the other deques when it runs dry, so uneven jobs balance themselves */
+class ThreadPool
+{
+    public:
+        // The argument is the index of the executing worker, used to select per-thread workspaces
+        typedef std::function<void(int)> Task;
+
+    private:
+        struct TaskQueue
+        {
+            std::deque<Task> tasks;
+            std::mutex mutex;
+        };
+
+        std::vector<std::unique_ptr<TaskQueue>> queues;
+        std::vector<std::thread> workers;
+        std::mutex stateMutex;
+        std::condition_variable taskAvailable;
+        std::condition_variable tasksFinished;
+        size_t queuedTasks;
+        size_t pendingTasks;
+        size_t nextQueue;
+        bool stopping;
+        std::exception_ptr firstError;
+
+        bool popTask(int index, Task &task);
+        bool stealTask(int index, Task &task);
+        void workerLoop(int index);
+
+    public:
+        explicit ThreadPool(int numThreads);
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool &operator=(const ThreadPool&) = delete;
+
+        int size() const {return static_cast<int>(workers.size());}
+        void submit(Task task);
+        // Block until all submitted tasks are finished, rethrows the first exception raised by a task
+        void wait();
+        ~ThreadPool();
+};
+
+#endif
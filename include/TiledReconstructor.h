@@ -0,0 +1,64 @@
+#ifndef TILEDRECONSTRUCTOR_H_
+#define TILEDRECONSTRUCTOR_H_
+
+#include <functional>
+#include "datatypes.h"
+
+namespace PhaseRetrieval
+{
+    /* A tile is a window read from the hologram plane. Only its core is written back,
+       the surrounding guard band absorbs the fringes leaking in from outside the window */
+    struct Tile
+    {
+        int row, col;                   // upper-left corner of the window
+        int coreRow, coreCol;           // core rectangle in image coordinates
+        int coreRows, coreCols;
+    };
+
+    class TiledReconstructor
+    {
+        public:
+            // Reconstruct a batch of windows [batch][numImages][rows][cols] (initial phase may be empty)
+            typedef std::function<FArray(const FArray&, const FArray&)> BatchMethod;
+            // Load all distances of a window into [numImages][rows][cols]
+            typedef std::function<void(const Tile&, float*)> TileReader;
+
+        private:
+            IntArray imSize;
+            IntArray windowSize;
+            int numImages;
+            int guard;
+            int blend;
+            int tileBatch;
+            std::vector<Tile> tiles;
+
+            void blendTile(const Tile &tile, const float *phase, FArray &result, FArray &weights) const;
+            // Constant phase of a tile relative to the tiles blended so far, weighted as they were accumulated
+            float tileOffset(const Tile &tile, const float *phase, const FArray &result, const FArray &weights) const;
+            float edgeWeight(int pos, int coreStart, int coreEnd, int imageEnd) const;
+
+        public:
+            TiledReconstructor(const IntArray &imsize, int images, const F2DArray &fresnelNumbers, const IntArray &tileSize,
+                               int batch = 1, int blendWidth = -1, float numZones = 4.0f);
+            // Guard band in pixels that covers the first numZones Fresnel zones of the smallest Fresnel number
+            static int guardBand(const F2DArray &fresnelNumbers, float numZones = 4.0f);
+
+            const IntArray &getWindowSize() const {return windowSize;}
+            const std::vector<Tile> &getTiles() const {return tiles;}
+            int getGuardBand() const {return guard;}
+            int getTileBatch() const {return tileBatch;}
+
+            // Sum of the blending weights of all tiles over the image, one everywhere
+            FArray blendWeights() const;
+
+            /* Batches of tiles are reconstructed one after another by method, which usually drives a single
+               reconstructor. Every tile is retrieved up to a constant phase, so its mean difference to the tiles
+               blended before over their common pixels is subtracted first, the first tile sets the offset */
+            // Reconstruct one angle held in memory as [numImages][rows][cols]
+            FArray reconstruct(const FArray &holograms, const FArray &initialPhase, const BatchMethod &method) const;
+            // Reconstruct one angle whose windows are loaded on demand, peak memory is bounded by the window size
+            FArray reconstruct(const TileReader &reader, const FArray &initialPhase, const BatchMethod &method) const;
+    };
+}
+
+#endif
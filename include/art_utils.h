@@ -0,0 +1,85 @@
+#ifndef ART_UTILS_H_
+#define ART_UTILS_H_
+
+#include <memory>
+#include <functional>
+#include "datatypes.h"
+
+// Ordered-subsets ART: the grid is updated after every subset of angles instead of once per pass
+struct ARTOptions
+{
+    /* Order of visiting subsets. Bit-reversal, golden-ratio and max-spread keep consecutive subsets
+       far apart in angle, max-spread picks the subset farthest from all visited ones */
+    enum Order {Sequential, Interleaved, BitReversal, GoldenRatio, MaxSpread};
+    // Device running the ART passes, the CPU engine uses numThreads z-slabs (0: all cores)
+    enum Device {GPU, CPU};
+    // Initial grid: the max map alone, or the ramp-filtered back projection bounded by the max map
+    enum Init {MaxMap, FilteredBackProjection};
+    int iterations;
+    int numSubsets;
+    Order order;
+    Device device = GPU;
+    int numThreads = 0;
+    // Precompute the projection weights once as a sparse matrix, worthwhile for small volumes
+    bool cacheMatrix = false;
+    Init init = MaxMap;
+};
+
+/* Host implementation of the ART projectors with the same grid layout (y * nx + x) * nz + z and
+   interpolation weights as the CUDA kernels. Projections are [nx][nz] without the padding rows.
+   Slices along z are independent, so each thread owns a z-slab and touches only its own columns
+   of the projections: no atomics are needed and the innermost loop runs contiguously along z */
+namespace ARTUtils
+{
+    /* CSR projection matrix of one z-slice for a set of angles, shared by all slices. Row
+       angle * nx * ny + (y * nx + x) holds the 3 detector rows and weights of that voxel column */
+    struct SystemMatrix
+    {
+        int nx, ny, numAngles;
+        size_t numEntries;
+        const int *rowOffsets;
+        const int *columns;
+        const float *weights;
+        // Owner of the arrays, private vectors or memory shared by the ranks of a node
+        std::shared_ptr<void> storage;
+
+        size_t numRows() const {return static_cast<size_t>(numAngles) * nx * ny;}
+    };
+
+    // Visiting order of numSubsets interleaved subsets
+    IntArray subsetOrder(int numSubsets, ARTOptions::Order order);
+    // Subsets of angle indices, built on the directions sorted modulo pi so that any angle list is supported
+    std::vector<IntArray> orderedSubsets(const FArray &angles, int numSubsets, ARTOptions::Order order);
+    // Run func(zStart, zEnd) on numThreads disjoint slabs of [0, nz)
+    void parallelSlabs(int nz, int numThreads, const std::function<void(int, int)> &func);
+
+    void gridProject(const float *grid, float *project, int nx, int ny, int nz, float phi, int zStart, int zEnd);
+    void gridBackProject(float *grid, const float *project, int nx, int ny, int nz, float phi, int zStart, int zEnd);
+    void gridMaxMap(float *grid, const float *project, int nx, int ny, int nz, float phi, int zStart, int zEnd);
+
+    void gridProject(const float *grid, float *project, int nx, int ny, int nz, float phi, int numThreads = 0);
+    void gridBackProject(float *grid, const float *project, int nx, int ny, int nz, float phi, int numThreads = 0);
+    void gridMaxMap(float *grid, const float *project, int nx, int ny, int nz, float phi, int numThreads = 0);
+
+    // Integration weights of the angles over the half circle, from the gaps between sorted directions
+    FArray angularWeights(const FArray &angles);
+    // Ram-Lak filter along the detector rows of one projection [nx][nz], scaled by scale
+    void rampFilter(const float *project, float *filtered, int nx, int nz, float scale, int zStart, int zEnd);
+    // Overwrite the grid slices [zStart, zEnd) by the filtered back projection of projections [numAngles][nx][nz]
+    void filteredBackProject(float *grid, const float *projects, int nx, int ny, int nz, const FArray &angles,
+                             int zStart, int zEnd);
+    void filteredBackProject(FArray &grid, const FArray &projects, int nx, int ny, int nz, const FArray &angles,
+                             int numThreads = 0);
+
+    SystemMatrix buildSystemMatrix(int nx, int ny, const FArray &angles);
+    void gridProject(const SystemMatrix &matrix, int angle, const float *grid, float *project, int nz, int zStart, int zEnd);
+    void gridBackProject(const SystemMatrix &matrix, int angle, float *grid, const float *project, int nz, int zStart, int zEnd);
+    void gridMaxMap(const SystemMatrix &matrix, int angle, float *grid, const float *project, int nz, int zStart, int zEnd);
+
+    /* Reconstruct grid [ny][nx][nz] from projections [numAngles][nx][nz] and replace them by its reprojections.
+       With options.cacheMatrix the given matrix is used, or one is built for this call if there is none */
+    void reprojectART(FArray &grid, FArray &projects, int nx, int ny, int nz, const FArray &angles,
+                      const ARTOptions &options, const SystemMatrix *matrix = nullptr);
+}
+
+#endif
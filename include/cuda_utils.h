@@ -164,8 +164,15 @@ __global__ void grid_back_project_k(float *grid, const float *project, int nx, i
 __global__ void grid_max_map_k(float *grid, const float *project, int nx, int nz, float a, float b,
                                float h, float cosp, float sinp, int start, int end, float border);
 
+__global__ void csr_project_k(const float *grid, float *project, const int *rowOffsets, const int *columns,
+                              const float *weights, int nz, int numel);
+__global__ void csr_back_project_k(float *grid, const float *project, const int *rowOffsets, const int *columns,
+                                   const float *weights, int nz, int numel);
+__global__ void csr_max_map_k(float *grid, const float *project, const int *rowOffsets, const int *columns,
+                              const float *weights, int nz, int numel);
+
 __global__ void limitGrid(float *grid, float constraint, int numel);
 __global__ void updateProject(float *project, const float *factor, int numel);
-__global__ void updateGrid(float *grid, const float *newGrid, int totalAngles, int numel);
+__global__ void updateGrid(float *grid, const float *newGrid, int numAngles, int numel);
 
 #endif
@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <complex>
+#include "Tensor.h"
 
 typedef std::vector<int> IntArray;
 typedef std::vector<IntArray> Int2DArray;
@@ -22,4 +23,7 @@ typedef std::vector<BArray> B2DArray;
 typedef std::vector<uint16_t> U16Array;
 typedef std::vector<uint8_t> U8Array;
 
+typedef Tensor<float> FTensor;
+typedef TensorView<const float> FTensorView;
+
 #endif
\ No newline at end of file
@@ -1,21 +1,53 @@
 #ifndef HOLO_RECONS_H_
 #define HOLO_RECONS_H_
 
-#include "ProjectionSolver.h"
+#include "HostStaging.h"
+#include "perf_utils.h"
+#include "tune_utils.h"
 
+/* All reconstruction functions are re-entrant, every call and every Reconstructor/CTFReconstructor
+   instance owns its solver, projectors and device buffers. Different threads may reconstruct
+   concurrently as long as they do not share an instance. Own kernels and copies are issued on the
+   per-thread default stream and overlap between threads, but cuFFT plans and NPP calls are not bound to
+   it and run on the legacy default stream, which synchronizes with the work of all threads on the same
+   device. Threads sharing a device therefore overlap only partially, threads on separate devices fully */
 namespace PhaseRetrieval
 {   
-    F2DArray reconstruct_iter(const FArray &holograms, int numImages, const IntArray &imSize, const F2DArray &fresnelNumbers, int iterations, const FArray &initialPhase,
+    /* Reconstructed planes [planes][rows][cols] in one aligned block: phase and amplitude, for reconstruct_iter
+       followed by the probe phase, which is zero unless APWP is used. Residuals hold the step and magnitude
+       errors of every iteration when they are calculated */
+    struct ReconsResult
+    {
+        FTensor planes;
+        F2DArray residuals;
+    };
+
+    /* observer is called every observeInterval iterations with the errors and the current padded wave field,
+       returning false ends the reconstruction early. Errors are only calculated with calcError */
+    ReconsResult reconstruct_iter(const FArray &holograms, int numImages, const IntArray &imSize, const F2DArray &fresnelNumbers, int iterations, const FArray &initialPhase,
                               const FArray &initialAmplitude, ProjectionSolver::Algorithm algorithm, const FArray &algoParameters, float minPhase, float maxPhase, float minAmplitude,
                               float maxAmplitude, const IntArray &support, float outsideValue, const IntArray &padSize, CUDAUtils::PaddingType padType, float padValue,
-                              PMagnitudeCons::Type projectionType, CUDAPropKernel::Type kernelType, const FArray &holoProbes, const FArray &initProbePhase, bool calcError);
+                              PMagnitudeCons::Type projectionType, CUDAPropKernel::Type kernelType, const FArray &holoProbes, const FArray &initProbePhase, bool calcError,
+                              const ProjectionSolver::Observer &observer = nullptr, int observeInterval = 1);
 
-    F2DArray reconstruct_epi(const FArray &holograms, int numImages, const IntArray &measSize, const F2DArray &fresnelNumbers, int iterations, const IntArray &imSize,
+    ReconsResult reconstruct_epi(const FArray &holograms, int numImages, const IntArray &measSize, const F2DArray &fresnelNumbers, int iterations, const IntArray &imSize,
                                 const FArray &initialPhase, const FArray &initialAmplitude, float minPhase, float maxPhase, float minAmplitude, float maxAmplitude,
-                                const IntArray &support, float outsideValue, PMagnitudeCons::Type projectionType, CUDAPropKernel::Type kernelType, bool calcError);
+                                const IntArray &support, float outsideValue, PMagnitudeCons::Type projectionType, CUDAPropKernel::Type kernelType, bool calcError,
+                                const ProjectionSolver::Observer &observer = nullptr, int observeInterval = 1);
                               
     FArray reconstruct_ctf(const FArray &holograms, int numImages, const IntArray &imSize, const F2DArray &fresnelnumbers, float lowFreqLim, float highFreqLim,
-                           float betaDeltaRatio, const IntArray &padSize, CUDAUtils::PaddingType padType, float padValue);
+                           float betaDeltaRatio, const IntArray &padSize, CUDAUtils::PaddingType padType, float padValue,
+                           PerfUtils::PerfReport *report = nullptr);
+
+    /* Device memory planning. Footprints follow the allocation sites of the reconstructors: the buffers and cuFFT
+       plans of the instance plus the buffers alive at the peak of one angle, scratch of projections included */
+    size_t ctfFootprint(int batchSize, int numImages, const IntArray &imSize, const IntArray &padSize);
+    size_t iterFootprint(int batchSize, int numImages, const IntArray &imSize, const IntArray &padSize, PMagnitudeCons::Type projectionType,
+                         bool objectConstraints, bool support);
+    // Free memory of the current device times fraction
+    size_t deviceBudget(float fraction = 0.9f);
+    // Largest batch size up to maxBatchSize dividing numAngles whose footprint fits into budget, 0 if none fits
+    int planBatchSize(const std::function<size_t(int)> &footprint, size_t budget, int maxBatchSize, int numAngles);
 
     class CTFReconstructor
     {
@@ -36,13 +68,21 @@ namespace PhaseRetrieval
             float *regWeights;
             float *d_regTemp;
             float *d_phase;
-            float *d_croppedPhase;
+            // Phases of the batch, cropped to the image size
+            float *d_results;
             cudaStream_t *streams;
+            HostStaging *staging;
+            size_t peakMemory;
+
+            void release();
             
         public:
             CTFReconstructor(int batchsize, int images, const IntArray &imsize, const F2DArray &fresnelnumbers, float lowFreqLim,
                              float highFreqLim, float ratio, const IntArray &padsize, CUDAUtils::PaddingType padtype, float padvalue);
-            FArray reconsBatch(const FArray &holograms);
+            // Stage counts and times are added to report when given, which synchronises the device between stages
+            FArray reconsBatch(const FArray &holograms, PerfUtils::PerfReport *report = nullptr);
+            // Highest device memory in use seen after setting up an angle, the CUDA context included
+            size_t getPeakMemory() const {return peakMemory;}
             ~CTFReconstructor();
     };
 
@@ -75,18 +115,42 @@ namespace PhaseRetrieval
             float *d_support;
             float *d_initPhase;
             float *d_paddedInitPhase;
-            float *d_croppedPhase;
+            float *d_results;
             cuFloatComplex *complexWave;
             cudaStream_t *streams;
+            HostStaging *staging;
+            size_t peakMemory;
+
+            void release();
 
         public:
             Reconstructor(int batchsize, int images, const IntArray &imsize, const F2DArray &fresnelNumbers, int iter, ProjectionSolver::Algorithm algo,
                           const FArray &algoParams, float minPhase, float maxPhase, float minAmplitude, float maxAmplitude, const IntArray &support,
                           float outsideValue, const IntArray &padsize, CUDAUtils::PaddingType padtype, float padvalue, PMagnitudeCons::Type projType,
                           CUDAPropKernel::Type kernelType);
-            FArray reconsBatch(const FArray &holograms, const FArray &initialPhase);
+            FArray reconsBatch(const FArray &holograms, const FArray &initialPhase, PerfUtils::PerfReport *report = nullptr);
+            size_t getPeakMemory() const {return peakMemory;}
             ~Reconstructor();
     };
+
+    /* Reconstruct holograms [numAngles][numImages][rows][cols] angle by angle on a work-stealing thread pool.
+       Every worker owns a Reconstructor on device (worker % numDevices), numThreads <= 0 runs up to two workers
+       per device as far as their footprints fit into its free memory, and numDevices <= 0 uses all GPUs.
+       Returns phases [numAngles][rows][cols] */
+    FTensor reconstruct_many(const FArray &holograms, int numAngles, int numImages, const IntArray &imSize, const F2DArray &fresnelNumbers, int iterations,
+                            const FArray &initialPhase, ProjectionSolver::Algorithm algorithm, const FArray &algoParameters, float minPhase, float maxPhase,
+                            float minAmplitude, float maxAmplitude, const IntArray &support, float outsideValue, const IntArray &padSize,
+                            CUDAUtils::PaddingType padType, float padValue, PMagnitudeCons::Type projectionType, CUDAPropKernel::Type kernelType,
+                            int numThreads = 0, int numDevices = 0);
+
+    /* Trial reconstructions of one angle, holograms [numImages][rows][cols], on the current device. Every projection and
+       kernel type runs trialIterations with errors, then the best of them is timed on the batch sizes up to maxBatchSize
+       which divide numAngles and fit into the free memory. Failing configurations are skipped, all trials are appended
+       to trials when given. Returns the best types with the fastest batch size */
+    TuneUtils::Trial tune(const FArray &holograms, int numImages, const IntArray &imSize, const F2DArray &fresnelNumbers, int trialIterations,
+                          ProjectionSolver::Algorithm algorithm, const FArray &algoParameters, float minPhase, float maxPhase, float minAmplitude,
+                          float maxAmplitude, const IntArray &support, float outsideValue, const IntArray &padSize, CUDAUtils::PaddingType padType,
+                          float padValue, int maxBatchSize, int numAngles, std::vector<TuneUtils::Trial> *trials = nullptr);
 }
 
 #endif
\ No newline at end of file
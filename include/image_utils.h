@@ -28,8 +28,11 @@ namespace ImageUtils
     DArray computePSDs(const std::vector<cv::Mat> &images, int direction, std::vector<cv::Mat> &profiles, std::vector<cv::Mat> &frequencies);
 
     void displayNDArray(F2DArray &images, int rows, int cols, const std::vector<std::string> &imgName);
+    // images [numImages][rows][cols]
+    void displayNDArray(const FTensorView &images, const std::vector<std::string> &imgName);
     void displayPhase(FArray &phase, int rows, int cols, const std::string &imgName);
     bool saveImage(const std::string &filename, const FArray &image, int rows, int cols);
+    bool saveImage(const std::string &filename, const FTensorView &image);
 }
 
 #endif
\ No newline at end of file
@@ -2,10 +2,14 @@
 #define IO_UTILS_H_
 
 #include <iostream>
+#include <memory>
 #include <mpi.h>
 #include <hdf5.h>
 
 #include "datatypes.h"
+#include "SharedArray.h"
+#include "trace_utils.h"
+#include "perf_utils.h"
 
 namespace IOUtils
 {
@@ -14,21 +18,59 @@ namespace IOUtils
     bool readDataDims(const std::string &filename, const std::string &datasetName, std::vector<hsize_t> &dims, MPI_Comm comm);
     bool readDataDims(const std::string &filename, const std::string &datasetName, std::vector<hsize_t> &dims);
     bool readPhaseGram(const std::string &filename, const std::string &datasetName, FArray &phase, std::vector<hsize_t> &dims);
+    bool readAngles(const std::string &filename, const std::string &datasetName, FArray &angles);
     bool readSingleGram(const std::string &filename, const std::string &datasetName, U16Array &data, std::vector<hsize_t> &dims, MPI_Comm comm);
+    // One copy per node in shared memory, broadcast once per node
+    bool readSingleGram(const std::string &filename, const std::string &datasetName, std::unique_ptr<SharedArray<uint16_t>> &data,
+                        std::vector<hsize_t> &dims, MPI_Comm comm);
     bool readProcessedGrams(const std::string &filename, const std::string &datasetName, FArray &holograms, std::vector<hsize_t> &dims);
     bool savePhaseGram(const std::string &filename, const std::string &datasetName, const FArray &reconsPhase, int rows, int cols);
+    bool savePhaseGram(const std::string &filename, const std::string &datasetName, const FTensorView &reconsPhase);
     bool save3DGrams(const std::string &filename, const std::string &datasetName, const FArray &registeredGrams, int numImages, int rows, int cols);
     bool read3DimData(const std::string &filename, const std::string &datasetName, FArray &data, hsize_t offset, hsize_t count, MPI_Comm comm);
     bool read3DimData(const std::string &filename, const std::string &datasetName, U16Array &data, hsize_t offset, hsize_t count);
     bool read4DimData(const std::string &filename, const std::string &datasetName, U16Array &data, hsize_t offset, hsize_t count);
     bool read4DimData(const std::string &filename, const std::string &datasetName, FArray &data, hsize_t offset, hsize_t count, MPI_Comm comm);
     bool read4DimData(const std::string &filename, const std::string &datasetName, U16Array &data, hsize_t offset, hsize_t count, MPI_Comm comm);
-    bool createFileDataset(const std::string &filename, const std::string &datasetName, const std::vector<hsize_t> &dims, MPI_Comm comm);
+    bool read4DimTile(const std::string &filename, const std::string &datasetName, float *data, hsize_t angle,
+                      hsize_t row, hsize_t col, hsize_t rows, hsize_t cols);
+    // With resume an existing dataset of the same dims is reopened, finished slices are tracked in datasetName + "_done"
+    bool createFileDataset(const std::string &filename, const std::string &datasetName, const std::vector<hsize_t> &dims,
+                           MPI_Comm comm, bool resume = false);
+    // Add a dataset of the given type to an existing file
+    bool addFileDataset(const std::string &filename, const std::string &datasetName, const std::vector<hsize_t> &dims,
+                        hid_t type, MPI_Comm comm);
+    bool readProgress(const std::string &filename, const std::string &datasetName, U8Array &done, MPI_Comm comm);
+    bool markProgress(const std::string &filename, const std::string &datasetName, hsize_t offset, hsize_t count, MPI_Comm comm);
     
     bool write3DimData(const std::string &filename, const std::string &datasetName, const FArray &data,
                        const std::vector<hsize_t> &dims, hsize_t offset, MPI_Comm comm);
+    bool write3DimData(const std::string &filename, const std::string &datasetName, const U16Array &data,
+                       const std::vector<hsize_t> &dims, hsize_t offset, MPI_Comm comm);
+    // Slices [count][rows][cols] of a tensor
+    bool write3DimData(const std::string &filename, const std::string &datasetName, const FTensorView &data,
+                       const std::vector<hsize_t> &dims, hsize_t offset, MPI_Comm comm);
     bool write4DimData(const std::string &filename, const std::string &datasetName, const FArray &data,
                        const std::vector<hsize_t> &dims, hsize_t offset, MPI_Comm comm);
+    bool write4DimData(const std::string &filename, const std::string &datasetName, const U16Array &data,
+                       const std::vector<hsize_t> &dims, hsize_t offset, MPI_Comm comm);
+
+    // Gather the trace events of all processes and write them to one Chrome trace file on rank 0
+    bool writeTrace(const std::string &filename, MPI_Comm comm);
+    // Sum the counts of the reports of all processes, the slowest process sets the time of every stage
+    void reduceReport(PerfUtils::PerfReport &report, MPI_Comm comm);
+
+    /* Serial access to datasets growing along the first dimension during acquisition. A reader opens the
+       file once in SWMR read mode, which fails quietly until the dataset exists, and polls the refreshed dims
+       while a writer appends. The writer creates the file once and keeps it open in SWMR write mode, every
+       append is flushed. Both close with closeStreamDataset */
+    bool openStreamDataset(const std::string &filename, const std::string &datasetName, hid_t &file_id, hid_t &dataset_id);
+    bool readStreamDims(hid_t dataset_id, std::vector<hsize_t> &dims);
+    bool readStreamSlices(hid_t dataset_id, FArray &data, hsize_t offset, hsize_t count);
+    bool createStreamDataset(const std::string &filename, const std::string &datasetName, int rows, int cols,
+                             hid_t &file_id, hid_t &dataset_id);
+    bool appendStreamSlices(hid_t dataset_id, const FArray &data, hsize_t offset, int rows, int cols);
+    void closeStreamDataset(hid_t &file_id, hid_t &dataset_id);
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,72 @@
+#ifndef PERF_UTILS_H_
+#define PERF_UTILS_H_
+
+#include <chrono>
+#include <ostream>
+#include <string>
+#include "ProjectionSolver.h"
+
+/* Throughput reports of the reconstructors. Bytes, flops, FFTs and elementwise kernel passes of every
+   stage are derived analytically from the sizes, batch and iterations, each pass counted once at its
+   minimum traffic, and combined with the measured time of the stage. A 2D complex FFT of n points
+   counts 5 n log2(n) flops and one read and write of the data. Host transfers are counted as bytes of
+   the "upload" and "download" stages, so their bandwidth is that of the PCIe link */
+namespace PerfUtils
+{
+    struct Stage
+    {
+        std::string name;
+        double bytes = 0.0;
+        double flops = 0.0;
+        double ffts = 0.0;
+        // Size of the transforms, empty without FFTs
+        IntArray fftSize;
+        double passes = 0.0;
+        double seconds = 0.0;
+
+        // GB/s, GFLOP/s and FFTs/s, zero without measured time
+        double bandwidth() const;
+        double flopRate() const;
+        double fftRate() const;
+    };
+
+    struct PerfReport
+    {
+        std::vector<Stage> stages;
+
+        // Stage of this name, appended if it does not exist yet
+        Stage &stage(const std::string &name);
+        Stage total() const;
+        // Counts and times of another report are added stage by stage
+        void merge(const PerfReport &report);
+        std::string toJson() const;
+        void print(std::ostream &os) const;
+    };
+
+    // count 2D complex FFTs of size
+    void addFFTs(Stage &stage, const IntArray &size, double count);
+    // count passes over elements, each reading and writing bytesPerElement in total
+    void addPasses(Stage &stage, double elements, double bytesPerElement, double flopsPerElement, double count = 1.0);
+
+    // Counts of one CTFReconstructor batch, newSize is the padded size
+    void addCTFBatch(PerfReport &report, const IntArray &imSize, const IntArray &newSize, int numImages, int batchSize);
+    // Counts of one Reconstructor batch, multiObject when phase or support constraints are applied besides the amplitude
+    void addIterBatch(PerfReport &report, const IntArray &imSize, const IntArray &newSize, int numImages, int batchSize, int iterations,
+                      ProjectionSolver::Algorithm algorithm, PMagnitudeCons::Type projectionType, bool multiObject, bool initialPhase);
+
+    // Accumulates wall time into the stages of a report, the device is synchronised at every lap so that
+    // kernels are accounted to the stage which launched them. Does nothing without a report
+    class StageTimer
+    {
+        private:
+            PerfReport *report;
+            std::chrono::steady_clock::time_point last;
+
+        public:
+            explicit StageTimer(PerfReport *perfReport);
+            // Time since the previous lap is added to the stage
+            void lap(const std::string &name);
+    };
+}
+
+#endif
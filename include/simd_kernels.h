@@ -0,0 +1,495 @@
+#ifndef SIMD_KERNELS_H_
+#define SIMD_KERNELS_H_
+
+#include <cmath>
+#include <complex>
+
+/* Elementwise kernels of simd_utils.h written once over a vector backend and compiled by every
+   implementation with its own instruction set. A backend is a struct of static functions on a register
+   Reg of width floats and a comparison result Mask: set, load, store, loadComplex and storeComplex
+   (de)interleaving width complex numbers, add, sub, mul, div, fma (a * b + c), sqrt, abs, min, max,
+   round (to nearest even), floor, copySign, lt, gt, ge, eq, both, either and select (a where the mask is
+   set, else b). Loads and stores are unaligned. The elements past the last full register are computed by
+   the single lane backend Single with the same approximations */
+namespace SIMDUtils
+{
+    typedef std::complex<float> Complex;
+
+    struct KernelTable
+    {
+        const char *name;
+        void (*scaleComplexData)(Complex*, int, float);
+        void (*computeComplexData)(Complex*, const float*, const float*, int);
+        void (*computeAmplitude)(const Complex*, float*, int);
+        void (*computePhase)(const Complex*, float*, int);
+        void (*initByPhase)(Complex*, const float*, int);
+        void (*setAmplitude)(Complex*, const float*, int);
+        void (*setPhase)(Complex*, const float*, int);
+        void (*setPhaseAmp1)(Complex*, const float*, int);
+        void (*setAmpPhase0)(Complex*, const float*, int);
+        void (*limitAmplitude)(Complex*, const float*, const float*, int);
+        void (*adjustAmplitude)(float*, float, float, int);
+        void (*adjustPhase)(float*, float, float, int);
+        void (*adjustComplexWave)(Complex*, const float*, float, int);
+        void (*sqrtIntensity)(float*, int);
+        void (*computeSquError)(float*, const Complex*, const float*, int);
+        void (*subNormComplex)(float*, const Complex*, const Complex*, int);
+        void (*addWaveField)(Complex*, const Complex*, int);
+        void (*subWaveField)(Complex*, const Complex*, int);
+        void (*multiplyWaveField)(Complex*, const Complex*, const Complex*, int);
+        void (*reflectWaveField)(Complex*, const Complex*, int);
+        void (*updateDM)(Complex*, const Complex*, const Complex*, int);
+        void (*propProcess)(Complex*, const Complex*, const Complex*, int, int);
+        void (*backPropProcess)(Complex*, const Complex*, const Complex*, int, int);
+    };
+
+    // Tables of the implementations, only those of the architecture being built exist
+    namespace Generic {const KernelTable &kernels();}
+    namespace AVX2 {const KernelTable &kernels();}
+    namespace AVX512 {const KernelTable &kernels();}
+    namespace NEON {const KernelTable &kernels();}
+}
+
+#endif
+
+/* The rest is compiled into the namespace SIMD_ISA of the including translation unit, so that the
+   instantiations of different instruction sets never merge at link time */
+#ifdef SIMD_ISA
+
+namespace SIMDUtils
+{
+namespace SIMD_ISA
+{
+    struct Single
+    {
+        typedef float Reg;
+        typedef bool Mask;
+        static const int width = 1;
+
+        static Reg set(float value) {return value;}
+        static Reg load(const float *p) {return *p;}
+        static void store(float *p, Reg v) {*p = v;}
+        static void loadComplex(const Complex *p, Reg &re, Reg &im) {re = p->real(); im = p->imag();}
+        static void storeComplex(Complex *p, Reg re, Reg im) {*p = Complex(re, im);}
+
+        static Reg add(Reg a, Reg b) {return a + b;}
+        static Reg sub(Reg a, Reg b) {return a - b;}
+        static Reg mul(Reg a, Reg b) {return a * b;}
+        static Reg div(Reg a, Reg b) {return a / b;}
+        static Reg fma(Reg a, Reg b, Reg c) {return a * b + c;}
+        static Reg sqrt(Reg a) {return std::sqrt(a);}
+        static Reg abs(Reg a) {return std::fabs(a);}
+        static Reg min(Reg a, Reg b) {return b < a ? b : a;}
+        static Reg max(Reg a, Reg b) {return a < b ? b : a;}
+        static Reg round(Reg a) {return std::nearbyint(a);}
+        static Reg floor(Reg a) {return std::floor(a);}
+        static Reg copySign(Reg magnitude, Reg sign) {return std::copysign(magnitude, sign);}
+
+        static Mask lt(Reg a, Reg b) {return a < b;}
+        static Mask gt(Reg a, Reg b) {return a > b;}
+        static Mask ge(Reg a, Reg b) {return a >= b;}
+        static Mask eq(Reg a, Reg b) {return a == b;}
+        static Mask both(Mask a, Mask b) {return a && b;}
+        static Mask either(Mask a, Mask b) {return a || b;}
+        static Reg select(Mask m, Reg a, Reg b) {return m ? a : b;}
+    };
+
+    // Runs body on every full register of V, then on the remaining elements one at a time
+    template <class V, class Body>
+    inline void forEach(int numel, const Body &body)
+    {
+        int i = 0;
+        for (; i + V::width <= numel; i += V::width) {
+            body(V(), i);
+        }
+        for (; i < numel; i++) {
+            body(Single(), i);
+        }
+    }
+
+    // The rounding of the square root is corrected by one Newton step on the exact residual x * x + y * y - h * h
+    template <class B>
+    inline typename B::Reg hypot(typename B::Reg x, typename B::Reg y)
+    {
+        auto yy = B::mul(y, y);
+        auto yyError = B::fma(y, y, B::sub(B::set(0.0f), yy));
+        auto h = B::sqrt(B::fma(x, x, yy));
+        auto residual = B::add(B::fma(x, x, B::fma(B::sub(B::set(0.0f), h), h, yy)), yyError);
+        auto corrected = B::fma(residual, B::div(B::set(0.5f), h), h);
+        return B::select(B::eq(h, B::set(0.0f)), h, corrected);
+    }
+
+    // fma of Single may round twice without FMA instructions, the single lane form works in double instead
+    template <>
+    inline float hypot<Single>(float x, float y)
+    {
+        return static_cast<float>(std::sqrt(static_cast<double>(x) * x + static_cast<double>(y) * y));
+    }
+
+    // Cephes atanf on [0, tan(pi / 8)], larger ratios are reduced by atan(t) = pi / 4 + atan((t - 1) / (t + 1))
+    template <class B>
+    inline typename B::Reg atan2(typename B::Reg y, typename B::Reg x)
+    {
+        auto zero = B::set(0.0f);
+        auto ax = B::abs(x);
+        auto ay = B::abs(y);
+        auto hi = B::max(ax, ay);
+        auto lo = B::min(ax, ay);
+
+        auto reduce = B::gt(lo, B::mul(B::set(0.414213562f), hi));
+        auto num = B::select(reduce, B::sub(lo, hi), lo);
+        auto den = B::select(reduce, B::add(lo, hi), hi);
+        den = B::select(B::eq(den, zero), B::set(1.0f), den);
+        auto t = B::div(num, den);
+        auto z = B::mul(t, t);
+
+        auto p = B::fma(B::set(8.05374449538e-2f), z, B::set(-1.38776856032e-1f));
+        p = B::fma(p, z, B::set(1.99777106478e-1f));
+        p = B::fma(p, z, B::set(-3.33329491539e-1f));
+        auto r = B::fma(B::mul(p, z), t, t);
+        r = B::add(r, B::select(reduce, B::set(0.785398163f), zero));
+
+        r = B::select(B::gt(ay, ax), B::sub(B::set(1.570796327f), r), r);
+        r = B::select(B::lt(x, zero), B::sub(B::set(3.141592654f), r), r);
+        return B::copySign(r, y);
+    }
+
+    // Cephes sinf and cosf on [-pi / 4, pi / 4] after a three part Cody-Waite reduction by multiples of pi / 2
+    template <class B>
+    inline void sincos(typename B::Reg x, typename B::Reg &s, typename B::Reg &c)
+    {
+        auto q = B::round(B::mul(x, B::set(0.636619772f)));
+        auto r = B::fma(q, B::set(-1.5703125f), x);
+        r = B::fma(q, B::set(-4.837512969970703125e-4f), r);
+        r = B::fma(q, B::set(-7.54978995489188216e-8f), r);
+        auto z = B::mul(r, r);
+
+        auto ps = B::fma(B::set(-1.9515295891e-4f), z, B::set(8.3321608736e-3f));
+        ps = B::fma(ps, z, B::set(-1.6666654611e-1f));
+        auto sr = B::fma(B::mul(ps, z), r, r);
+        auto pc = B::fma(B::set(2.443315711809948e-5f), z, B::set(-1.388731625493765e-3f));
+        pc = B::fma(pc, z, B::set(4.166664568298827e-2f));
+        auto cr = B::fma(B::mul(pc, z), z, B::fma(B::set(-0.5f), z, B::set(1.0f)));
+
+        // Quadrant in 0..3, exact in floats
+        auto quadrant = B::sub(q, B::mul(B::set(4.0f), B::floor(B::mul(q, B::set(0.25f)))));
+        auto odd = B::either(B::eq(quadrant, B::set(1.0f)), B::eq(quadrant, B::set(3.0f)));
+        auto sinNeg = B::ge(quadrant, B::set(2.0f));
+        auto cosNeg = B::both(B::gt(quadrant, B::set(0.5f)), B::lt(quadrant, B::set(2.5f)));
+        s = B::select(odd, cr, sr);
+        c = B::select(odd, sr, cr);
+        s = B::select(sinNeg, B::sub(B::set(0.0f), s), s);
+        c = B::select(cosNeg, B::sub(B::set(0.0f), c), c);
+    }
+
+    template <class V>
+    void scaleComplexData(Complex *data, int numel, float scale)
+    {
+        forEach<V>(numel, [=](auto isa, int i) {
+            using B = decltype(isa);
+            typename B::Reg re, im;
+            B::loadComplex(data + i, re, im);
+            B::storeComplex(data + i, B::mul(re, B::set(scale)), B::mul(im, B::set(scale)));
+        });
+    }
+
+    template <class V>
+    void computeComplexData(Complex *complexData, const float *amplitude, const float *phase, int numel)
+    {
+        forEach<V>(numel, [=](auto isa, int i) {
+            using B = decltype(isa);
+            typename B::Reg s, c;
+            sincos<B>(B::load(phase + i), s, c);
+            auto amp = B::load(amplitude + i);
+            B::storeComplex(complexData + i, B::mul(amp, c), B::mul(amp, s));
+        });
+    }
+
+    template <class V>
+    void computeAmplitude(const Complex *complexWave, float *amplitude, int numel)
+    {
+        forEach<V>(numel, [=](auto isa, int i) {
+            using B = decltype(isa);
+            typename B::Reg re, im;
+            B::loadComplex(complexWave + i, re, im);
+            B::store(amplitude + i, hypot<B>(re, im));
+        });
+    }
+
+    template <class V>
+    void computePhase(const Complex *complexWave, float *phase, int numel)
+    {
+        forEach<V>(numel, [=](auto isa, int i) {
+            using B = decltype(isa);
+            typename B::Reg re, im;
+            B::loadComplex(complexWave + i, re, im);
+            B::store(phase + i, atan2<B>(im, re));
+        });
+    }
+
+    template <class V>
+    void initByPhase(Complex *data, const float *phase, int numel)
+    {
+        forEach<V>(numel, [=](auto isa, int i) {
+            using B = decltype(isa);
+            typename B::Reg s, c;
+            sincos<B>(B::load(phase + i), s, c);
+            B::storeComplex(data + i, c, s);
+        });
+    }
+
+    // Scales the wave to the target amplitude, waves of amplitude below 1e-10 are replaced by it
+    template <class B>
+    inline void scaleToTarget(Complex *wave, typename B::Reg re, typename B::Reg im, typename B::Reg amplitude,
+                              typename B::Reg target)
+    {
+        auto valid = B::ge(amplitude, B::set(1e-10f));
+        auto scale = B::div(target, amplitude);
+        B::storeComplex(wave, B::select(valid, B::mul(re, scale), target), B::select(valid, B::mul(im, scale), B::set(0.0f)));
+    }
+
+    template <class V>
+    void setAmplitude(Complex *complexWave, const float *targetAmplitude, int numel)
+    {
+        forEach<V>(numel, [=](auto isa, int i) {
+            using B = decltype(isa);
+            typename B::Reg re, im;
+            B::loadComplex(complexWave + i, re, im);
+            scaleToTarget<B>(complexWave + i, re, im, hypot<B>(re, im), B::load(targetAmplitude + i));
+        });
+    }
+
+    template <class V>
+    void limitAmplitude(Complex *complexWave, const float *amplitude, const float *targetAmplitude, int numel)
+    {
+        forEach<V>(numel, [=](auto isa, int i) {
+            using B = decltype(isa);
+            typename B::Reg re, im;
+            B::loadComplex(complexWave + i, re, im);
+            scaleToTarget<B>(complexWave + i, re, im, B::load(amplitude + i), B::load(targetAmplitude + i));
+        });
+    }
+
+    template <class V>
+    void setPhase(Complex *complexWave, const float *targetPhase, int numel)
+    {
+        forEach<V>(numel, [=](auto isa, int i) {
+            using B = decltype(isa);
+            typename B::Reg re, im, s, c;
+            B::loadComplex(complexWave + i, re, im);
+            auto amp = hypot<B>(re, im);
+            sincos<B>(B::load(targetPhase + i), s, c);
+            B::storeComplex(complexWave + i, B::mul(amp, c), B::mul(amp, s));
+        });
+    }
+
+    template <class V>
+    void setPhaseAmp1(Complex *complexWave, const float *targetPhase, int numel)
+    {
+        forEach<V>(numel, [=](auto isa, int i) {
+            using B = decltype(isa);
+            typename B::Reg re, im, s, c;
+            B::loadComplex(complexWave + i, re, im);
+            auto amp = B::min(hypot<B>(re, im), B::set(1.0f));
+            sincos<B>(B::load(targetPhase + i), s, c);
+            B::storeComplex(complexWave + i, B::mul(amp, c), B::mul(amp, s));
+        });
+    }
+
+    template <class V>
+    void setAmpPhase0(Complex *complexWave, const float *targetAmplitude, int numel)
+    {
+        forEach<V>(numel, [=](auto isa, int i) {
+            using B = decltype(isa);
+            B::storeComplex(complexWave + i, B::load(targetAmplitude + i), B::set(0.0f));
+        });
+    }
+
+    template <class V>
+    void adjustAmplitude(float *amplitude, float maxAmplitude, float minAmplitude, int numel)
+    {
+        bool upper = maxAmplitude < INFINITY;
+        bool lower = minAmplitude > 0;
+        forEach<V>(numel, [=](auto isa, int i) {
+            using B = decltype(isa);
+            auto amp = B::load(amplitude + i);
+            if (upper)
+                amp = B::min(amp, B::set(maxAmplitude));
+            if (lower)
+                amp = B::max(amp, B::set(minAmplitude));
+            B::store(amplitude + i, amp);
+        });
+    }
+
+    template <class V>
+    void adjustPhase(float *phase, float maxPhase, float minPhase, int numel)
+    {
+        bool upper = maxPhase < INFINITY;
+        bool lower = minPhase > -INFINITY;
+        forEach<V>(numel, [=](auto isa, int i) {
+            using B = decltype(isa);
+            auto value = B::load(phase + i);
+            if (upper)
+                value = B::min(value, B::set(maxPhase));
+            if (lower)
+                value = B::max(value, B::set(minPhase));
+            B::store(phase + i, value);
+        });
+    }
+
+    template <class V>
+    void adjustComplexWave(Complex *complexWave, const float *support, float outsideValue, int numel)
+    {
+        forEach<V>(numel, [=](auto isa, int i) {
+            using B = decltype(isa);
+            typename B::Reg re, im;
+            B::loadComplex(complexWave + i, re, im);
+            auto outside = B::eq(B::load(support + i), B::set(0.0f));
+            B::storeComplex(complexWave + i, B::select(outside, B::set(outsideValue), re), B::select(outside, B::set(0.0f), im));
+        });
+    }
+
+    template <class V>
+    void sqrtIntensity(float *amplitude, int numel)
+    {
+        forEach<V>(numel, [=](auto isa, int i) {
+            using B = decltype(isa);
+            B::store(amplitude + i, B::sqrt(B::load(amplitude + i)));
+        });
+    }
+
+    template <class V>
+    void computeSquError(float *error, const Complex *propedWave, const float *measuredHologram, int numel)
+    {
+        forEach<V>(numel, [=](auto isa, int i) {
+            using B = decltype(isa);
+            typename B::Reg re, im;
+            B::loadComplex(propedWave + i, re, im);
+            auto diff = B::sub(hypot<B>(re, im), B::load(measuredHologram + i));
+            B::store(error + i, B::mul(diff, diff));
+        });
+    }
+
+    template <class V>
+    void subNormComplex(float *result, const Complex *cmpData1, const Complex *cmpData2, int numel)
+    {
+        forEach<V>(numel, [=](auto isa, int i) {
+            using B = decltype(isa);
+            typename B::Reg re1, im1, re2, im2;
+            B::loadComplex(cmpData1 + i, re1, im1);
+            B::loadComplex(cmpData2 + i, re2, im2);
+            auto re = B::sub(re1, re2);
+            auto im = B::sub(im1, im2);
+            B::store(result + i, B::fma(re, re, B::mul(im, im)));
+        });
+    }
+
+    template <class V>
+    void addWaveField(Complex *complexWave, const Complex *waveField, int numel)
+    {
+        forEach<V>(numel, [=](auto isa, int i) {
+            using B = decltype(isa);
+            typename B::Reg re1, im1, re2, im2;
+            B::loadComplex(complexWave + i, re1, im1);
+            B::loadComplex(waveField + i, re2, im2);
+            B::storeComplex(complexWave + i, B::add(re1, re2), B::add(im1, im2));
+        });
+    }
+
+    template <class V>
+    void subWaveField(Complex *complexWave, const Complex *waveField, int numel)
+    {
+        forEach<V>(numel, [=](auto isa, int i) {
+            using B = decltype(isa);
+            typename B::Reg re1, im1, re2, im2;
+            B::loadComplex(complexWave + i, re1, im1);
+            B::loadComplex(waveField + i, re2, im2);
+            B::storeComplex(complexWave + i, B::sub(re1, re2), B::sub(im1, im2));
+        });
+    }
+
+    template <class V>
+    void multiplyWaveField(Complex *result, const Complex *wf1, const Complex *wf2, int numel)
+    {
+        forEach<V>(numel, [=](auto isa, int i) {
+            using B = decltype(isa);
+            typename B::Reg re1, im1, re2, im2;
+            B::loadComplex(wf1 + i, re1, im1);
+            B::loadComplex(wf2 + i, re2, im2);
+            B::storeComplex(result + i, B::sub(B::mul(re1, re2), B::mul(im1, im2)), B::add(B::mul(re1, im2), B::mul(im1, re2)));
+        });
+    }
+
+    template <class V>
+    void reflectWaveField(Complex *reflectedWave, const Complex *waveField, int numel)
+    {
+        forEach<V>(numel, [=](auto isa, int i) {
+            using B = decltype(isa);
+            typename B::Reg re1, im1, re2, im2;
+            B::loadComplex(reflectedWave + i, re1, im1);
+            B::loadComplex(waveField + i, re2, im2);
+            B::storeComplex(reflectedWave + i, B::fma(B::set(2.0f), re1, B::sub(B::set(0.0f), re2)),
+                            B::fma(B::set(2.0f), im1, B::sub(B::set(0.0f), im2)));
+        });
+    }
+
+    template <class V>
+    void updateDM(Complex *probe, const Complex *probeWave, const Complex *complexWave, int numel)
+    {
+        forEach<V>(numel, [=](auto isa, int i) {
+            using B = decltype(isa);
+            typename B::Reg pr, pi, wr, wi;
+            B::loadComplex(probeWave + i, pr, pi);
+            B::loadComplex(complexWave + i, wr, wi);
+            auto intensity = B::fma(wr, wr, B::mul(wi, wi));
+            auto re = B::add(B::mul(pr, wr), B::mul(pi, wi));
+            auto im = B::sub(B::mul(pi, wr), B::mul(pr, wi));
+            B::storeComplex(probe + i, B::div(re, intensity), B::div(im, intensity));
+        });
+    }
+
+    template <class V>
+    void propProcess(Complex *propagatedWave, const Complex *complexWave, const Complex *kernel, int numel, int batchSize)
+    {
+        for (int b = 0; b < batchSize; b++) {
+            Complex *propagated = propagatedWave + static_cast<size_t>(b) * numel;
+            const Complex *batchKernel = kernel + static_cast<size_t>(b) * numel;
+            multiplyWaveField<V>(propagated, batchKernel, complexWave, numel);
+        }
+    }
+
+    template <class V>
+    void backPropProcess(Complex *complexWave, const Complex *propagatedWave, const Complex *kernel, int numel, int batchSize)
+    {
+        forEach<V>(numel, [=](auto isa, int i) {
+            using B = decltype(isa);
+            auto sumRe = B::set(0.0f);
+            auto sumIm = B::set(0.0f);
+            for (int b = 0; b < batchSize; b++) {
+                size_t idx = static_cast<size_t>(b) * numel + i;
+                typename B::Reg pr, pi, kr, ki;
+                B::loadComplex(propagatedWave + idx, pr, pi);
+                B::loadComplex(kernel + idx, kr, ki);
+                sumRe = B::add(sumRe, B::add(B::mul(pr, kr), B::mul(pi, ki)));
+                sumIm = B::add(sumIm, B::sub(B::mul(pi, kr), B::mul(pr, ki)));
+            }
+            B::storeComplex(complexWave + i, sumRe, sumIm);
+        });
+    }
+
+    template <class V>
+    const KernelTable &kernelTable(const char *name)
+    {
+        static const KernelTable table {
+            name, scaleComplexData<V>, computeComplexData<V>, computeAmplitude<V>, computePhase<V>, initByPhase<V>,
+            setAmplitude<V>, setPhase<V>, setPhaseAmp1<V>, setAmpPhase0<V>, limitAmplitude<V>, adjustAmplitude<V>,
+            adjustPhase<V>, adjustComplexWave<V>, sqrtIntensity<V>, computeSquError<V>, subNormComplex<V>,
+            addWaveField<V>, subWaveField<V>, multiplyWaveField<V>, reflectWaveField<V>, updateDM<V>,
+            propProcess<V>, backPropProcess<V>
+        };
+        return table;
+    }
+}
+}
+
+#endif
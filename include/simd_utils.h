@@ -0,0 +1,54 @@
+#ifndef SIMD_UTILS_H_
+#define SIMD_UTILS_H_
+
+#include <complex>
+#include <string>
+
+/* Host versions of the elementwise kernels of cuda_utils.cu with the same names, arguments and results,
+   so that a CPU reconstruction can be checked against the CUDA one. Complex arrays are interleaved like
+   cuFloatComplex. The implementation is chosen once per process from the CPU: AVX-512, AVX2 with FMA or
+   NEON, else a portable one element at a time. HIHOLO_SIMD=generic|avx2|avx512|neon forces one of them if
+   the CPU supports it. All of them share the same approximations of the elementary functions:
+     hypot  sqrt(x * x + y * y) with a corrected rounding, within 1 ulp for |x|, |y| in [1e-19, 1e19]
+     atan2  within 3e-7 rad, atan2(0, 0) is 0, infinite arguments are not handled
+     sincos within 2e-7 for |x| <= 8192, the error grows linearly with |x| above */
+namespace SIMDUtils
+{
+    // Name of the implementation in use
+    std::string activeISA();
+
+    void scaleComplexData(std::complex<float> *data, int numel, float scale);
+    void computeComplexData(std::complex<float> *complexData, const float *amplitude, const float *phase, int numel);
+    void computeAmplitude(const std::complex<float> *complexWave, float *amplitude, int numel);
+    void computePhase(const std::complex<float> *complexWave, float *phase, int numel);
+    void initByPhase(std::complex<float> *data, const float *phase, int numel);
+
+    void setAmplitude(std::complex<float> *complexWave, const float *targetAmplitude, int numel);
+    void setPhase(std::complex<float> *complexWave, const float *targetPhase, int numel);
+    void setPhaseAmp1(std::complex<float> *complexWave, const float *targetPhase, int numel);
+    void setAmpPhase0(std::complex<float> *complexWave, const float *targetAmplitude, int numel);
+    void limitAmplitude(std::complex<float> *complexWave, const float *amplitude, const float *targetAmplitude, int numel);
+
+    void adjustAmplitude(float *amplitude, float maxAmplitude, float minAmplitude, int numel);
+    void adjustPhase(float *phase, float maxPhase, float minPhase, int numel);
+    void adjustComplexWave(std::complex<float> *complexWave, const float *support, float outsideValue, int numel);
+    void sqrtIntensity(float *amplitude, int numel);
+
+    void computeSquError(float *error, const std::complex<float> *propedWave, const float *measuredHologram, int numel);
+    void subNormComplex(float *result, const std::complex<float> *cmpData1, const std::complex<float> *cmpData2, int numel);
+
+    void addWaveField(std::complex<float> *complexWave, const std::complex<float> *waveField, int numel);
+    void subWaveField(std::complex<float> *complexWave, const std::complex<float> *waveField, int numel);
+    void multiplyWaveField(std::complex<float> *result, const std::complex<float> *wf1, const std::complex<float> *wf2, int numel);
+    void reflectWaveField(std::complex<float> *reflectedWave, const std::complex<float> *waveField, int numel);
+    void updateDM(std::complex<float> *probe, const std::complex<float> *probeWave, const std::complex<float> *complexWave, int numel);
+
+    // Propagates one wave with the kernels of batchSize distances, numel elements each
+    void propProcess(std::complex<float> *propagatedWave, const std::complex<float> *complexWave, const std::complex<float> *kernel,
+                     int numel, int batchSize);
+    // Sums the batch of propagated waves back-propagated with the conjugate kernels into one wave
+    void backPropProcess(std::complex<float> *complexWave, const std::complex<float> *propagatedWave, const std::complex<float> *kernel,
+                         int numel, int batchSize);
+}
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef SYNTHETIC_DATA_H_
+#define SYNTHETIC_DATA_H_
+
+#include <random>
+#include "Propagator.h"
+
+/* Reproducible synthetic holograms: a 3D phantom is projected to phase maps, the object waves are
+   propagated to every Fresnel number with the library's own Propagator and recorded by a simple
+   detector with photon noise, dark current, read-out noise and a gaussian beam profile. Everything
+   is seeded, the same parameters always give the same data */
+namespace SyntheticData
+{
+    struct DetectorModel
+    {
+        // Mean photons per pixel of the flat field, must be positive to record counts. Without a detector,
+        // e.g. for noise-free holograms, the intensities of propagateObject are used directly
+        float flux = 1e4f;
+        // Mean and standard deviation of the dark counts, a deviation <= 0 adds the mean without read-out noise
+        float darkLevel = 100.0f;
+        float readNoise = 2.0f;
+        // Standard deviation of the gaussian beam relative to the image size, <= 0 is uniform
+        float beamWidth = 0.0f;
+    };
+
+    // Random spheres in a grid [nx][nx][nz] with layout (y * nx + x) * nz + z as in ARTUtils
+    FArray spherePhantom(int nx, int nz, int numSpheres, unsigned seed);
+    // Phase maps [numAngles][nz][nx], -phaseScale times the projections of the grid
+    FArray projectPhantom(const FArray &grid, int nx, int nz, const FArray &angles, float phaseScale);
+    // Intensities [numImages][rows][cols] of the object exp((betaDeltaRatio + i) * phase) at all Fresnel numbers
+    FArray propagateObject(const FArray &phase, float betaDeltaRatio, const IntArray &imSize, const F2DArray &fresnelNumbers);
+
+    // Beam profile [rows][cols] with mean 1 in the center
+    FArray beamProfile(const IntArray &imSize, float beamWidth);
+    // Dark frame [rows][cols] and flat fields [numImages][rows][cols] in detector counts, throws for flux <= 0
+    void detectorFields(const IntArray &imSize, int numImages, const DetectorModel &model, U16Array &dark, U16Array &flat,
+                        std::mt19937 &generator);
+    // Detector counts of intensities [n][rows][cols] under the beam with photon and read-out noise, throws for flux <= 0
+    U16Array detectorCounts(const FArray &intensities, const FArray &profile, const DetectorModel &model, std::mt19937 &generator);
+    // (counts - dark) / (flat - dark) per distance, the holograms of counts [n][numImages][rows][cols]
+    FArray flatFieldCorrect(const U16Array &counts, const U16Array &dark, const U16Array &flat, int numImages);
+}
+
+#endif
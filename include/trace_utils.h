@@ -0,0 +1,62 @@
+#ifndef TRACE_UTILS_H_
+#define TRACE_UTILS_H_
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/* Scoped spans written as Chrome/Perfetto trace events ("X" events in microseconds). Tracing is off by
+   default and a span then costs one relaxed atomic load. When on, every host thread appends to its own
+   buffer without locking, pid is the process index given to enable (the MPI rank) and tid a small index
+   per thread. Spans measure host time: GPU spans call the synchroniser given to enable at their end, so
+   the kernels they launched are accounted to them, at the price of serialising streams while tracing */
+namespace TraceUtils
+{
+    extern std::atomic<bool> active;
+
+    inline bool enabled() {return active.load(std::memory_order_relaxed);}
+    // Clears the recorded events, so no traced work may run meanwhile, the settings themselves are atomic
+    void enable(int process = 0, void (*synchronize)() = nullptr);
+    void disable();
+    // Microseconds since enable
+    int64_t now();
+    void record(const char *name, const char *category, int64_t start, int64_t end);
+    void synchronize();
+
+    // Events of this process as a JSON fragment without brackets, only valid once the traced work has finished
+    std::string events();
+    // Complete trace of the fragments of one or more processes
+    bool writeTrace(const std::string &filename, const std::vector<std::string> &fragments);
+
+    // Names and categories must outlive the trace, string literals are expected
+    class Span
+    {
+        private:
+            const char *name;
+            const char *category;
+            bool gpu;
+            int64_t start;
+
+        public:
+            Span(const char *spanName, const char *spanCategory, bool gpuWork = false): name(spanName), category(spanCategory),
+                 gpu(gpuWork), start(enabled() ? now() : -1) {}
+            Span(const Span&) = delete;
+            Span &operator=(const Span&) = delete;
+            ~Span()
+            {
+                if (start < 0 || !enabled())
+                    return;
+                if (gpu)
+                    synchronize();
+                record(name, category, start, now());
+            }
+    };
+}
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name, category) TraceUtils::Span TRACE_CONCAT(traceSpan, __LINE__)(name, category)
+#define TRACE_GPU_SCOPE(name, category) TraceUtils::Span TRACE_CONCAT(traceSpan, __LINE__)(name, category, true)
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef TUNE_UTILS_H_
+#define TUNE_UTILS_H_
+
+#include <string>
+#include "ProjectionSolver.h"
+
+/* Tuned settings of the iterative reconstruction. Trials are scored by the time per iteration and the
+   decrease of the magnitude error per second. The cache is a text file with one configuration per line:
+   rows cols images projectionType kernelType batchSize secondsPerIteration errorDecreasePerSecond */
+namespace TuneUtils
+{
+    struct Trial
+    {
+        PMagnitudeCons::Type projectionType;
+        CUDAPropKernel::Type kernelType;
+        int batchSize;
+        // Seconds per iteration of one angle, amortised over the batch
+        double iterationSeconds;
+        // Decrease of the magnitude error per second, zero when it does not decrease
+        double errorDecrease;
+    };
+
+    // Fills the scores of a trial from the times in seconds and magnitude errors of consecutive iterations
+    void scoreTrial(Trial &trial, const std::vector<double> &times, const FArray &errors);
+    // Fastest decreasing trial, the fastest iteration when none decreases
+    const Trial &bestTrial(const std::vector<Trial> &trials);
+
+    const char *projectionName(PMagnitudeCons::Type type);
+    const char *kernelName(CUDAPropKernel::Type type);
+
+    // $HIHOLO_TUNE_CACHE, else ~/.hiholo_tune, else hiholo_tune in the working directory
+    std::string defaultCachePath();
+    // false if the file or a configuration for the size and number of images does not exist
+    bool loadConfig(const std::string &filename, const IntArray &imSize, int numImages, Trial &config);
+    // Replaces the configuration for the size and number of images, other lines are kept
+    bool saveConfig(const std::string &filename, const IntArray &imSize, int numImages, const Trial &config);
+}
+
+#endif
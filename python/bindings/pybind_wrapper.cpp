@@ -1,6 +1,7 @@
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
 #include <pybind11/numpy.h>
+#include <pybind11/complex.h>
 #include <limits>
 
 #include "holo_recons.h"
@@ -24,6 +25,61 @@ py::array_t<float> mat_to_numpy(const cv::Mat& mat) {
     );
 }
 
+/* Hands the memory of a tensor to numpy without copying, the array owns it from then on and frees it
+   with the tensor deallocator once the array and all views of it are gone */
+py::array_t<float> tensor_to_numpy(FTensor&& tensor) {
+    std::vector<py::ssize_t> shape(tensor.shape().begin(), tensor.shape().end());
+    if (tensor.empty()) {
+        return py::array_t<float>(shape);
+    }
+    float* data = tensor.release();
+    py::capsule owner(data, [](void* memory) { FTensor::deallocate(memory); });
+    return py::array_t<float>(shape, data, owner);
+}
+
+/* Planes of a reconstruction as 2D numpy views of one array, followed by the step and magnitude errors
+   when they were calculated */
+py::list result_to_list(PhaseRetrieval::ReconsResult&& result) {
+    py::list output_list;
+    int numPlanes = result.planes.shape(0);
+    py::array_t<float> planes = tensor_to_numpy(std::move(result.planes));
+    for (int i = 0; i < numPlanes; ++i) {
+        output_list.append(planes[py::int_(i)]);
+    }
+    for (const auto& errors: result.residuals) {
+        output_list.append(py::array_t<float>(errors.size(), errors.data()));
+    }
+    return output_list;
+}
+
+/* Wraps a Python callable as solver observer, called as callback(iteration, stepError, magnitudeError, field).
+   field is None unless requested, then a read-only complex64 copy of the current padded wave field. Returning
+   False stops the iteration, an exception of the callable stops it as well and is raised once the call returns.
+   The callable is borrowed, it stays alive as argument of the binding while the reconstruction runs */
+ProjectionSolver::Observer make_observer(py::handle callback, bool withField) {
+    if (callback.is_none()) {
+        return nullptr;
+    }
+    return [callback, withField](const IterationState& state) {
+        py::gil_scoped_acquire acquire;
+        try {
+            py::object field = py::none();
+            if (withField) {
+                py::array_t<std::complex<float>> wave({state.psi.getRows(), state.psi.getColumns()});
+                cudaMemcpy(wave.mutable_data(), state.psi.getComplexWave(), state.psi.getSize() * sizeof(cuFloatComplex),
+                           cudaMemcpyDeviceToHost);
+                wave.attr("flags").attr("writeable") = false;
+                field = wave;
+            }
+            py::object proceed = callback(state.iteration, state.stepError, state.magnitudeError, field);
+            return proceed.is_none() || proceed.cast<bool>();
+        } catch (py::error_already_set& error) {
+            error.restore();
+            return false;
+        }
+    };
+}
+
 PYBIND11_MODULE(hiholo, m) {
     m.doc() = "Python binding for holographic reconstruction using CTF and iterative methods";
 
@@ -165,10 +221,14 @@ PYBIND11_MODULE(hiholo, m) {
           float* data_ptr = static_cast<float*>(buf.ptr);
           holograms.assign(data_ptr, data_ptr + buf.size);
           
-          // Call the original C++ function
-          FArray result = PhaseRetrieval::reconstruct_ctf(holograms, numImages, imSize, fresnelNumbers, 
-                                                          lowFreqLim, highFreqLim, betaDeltaRatio, padSize,
-                                                          padType, padValue);
+          // Call the original C++ function without the GIL, other Python threads may reconstruct concurrently
+          FArray result;
+          {
+              py::gil_scoped_release release;
+              result = PhaseRetrieval::reconstruct_ctf(holograms, numImages, imSize, fresnelNumbers, 
+                                                       lowFreqLim, highFreqLim, betaDeltaRatio, padSize,
+                                                       padType, padValue);
+          }
           
           // Convert result to 2D numpy array
           auto output = py::array_t<float>(rows * cols);
@@ -198,7 +258,8 @@ PYBIND11_MODULE(hiholo, m) {
                                  float maxPhase, float minAmplitude, float maxAmplitude, const IntArray& support,
                                  float outsideValue, const IntArray& padSize, CUDAUtils::PaddingType padType,
                                  float padValue, PMagnitudeCons::Type projectionType, CUDAPropKernel::Type kernelType,
-                                 py::array_t<float> holoProbes_array, py::array_t<float> initProbePhase_array, bool calcError) {
+                                 py::array_t<float> holoProbes_array, py::array_t<float> initProbePhase_array, bool calcError,
+                                 py::object callback, int callbackInterval, bool callbackField) {
           
           py::buffer_info holo_buf = holograms_array.request();
           
@@ -257,43 +318,23 @@ PYBIND11_MODULE(hiholo, m) {
               initProbePhase.assign(probe_phase_data_ptr, probe_phase_data_ptr + probe_phase_buf.size);
           }
           
-          // Call the original C++ function
-          F2DArray result = PhaseRetrieval::reconstruct_iter(holograms, numImages, imSize, fresnelNumbers, iterations,
-                                                             initialPhase, initialAmplitude, algorithm, algoParameters,
-                                                             minPhase, maxPhase, minAmplitude, maxAmplitude, support,
-                                                             outsideValue, padSize, padType, padValue, projectionType,
-                                                             kernelType, holoProbes, initProbePhase, calcError);
-          
-          // Convert F2DArray result to list of numpy arrays with proper dimensions
-          py::list output_list;
-          for (size_t i = 0; i < result.size(); ++i) {
-              const auto& array = result[i];
-              
-              if (i < 3) {
-                  // First 3 arrays: phase, amplitude, probe_phase (2D)
-                  auto output = py::array_t<float>(rows * cols);
-                  py::buffer_info output_buf = output.request();
-                  float* output_ptr = static_cast<float*>(output_buf.ptr);
-                  
-                  // Copy data
-                  std::copy(array.begin(), array.end(), output_ptr);
-                  
-                  // Reshape to 2D
-                  output.resize({rows, cols});
-                  output_list.append(output);
-              } else {
-                  // Last 2 arrays: step_errors, pm_errors (1D)
-                  auto output = py::array_t<float>(array.size());
-                  py::buffer_info output_buf = output.request();
-                  float* output_ptr = static_cast<float*>(output_buf.ptr);
-                  
-                  // Copy data (keep as 1D)
-                  std::copy(array.begin(), array.end(), output_ptr);
-                  output_list.append(output);
-              }
+          // Call the original C++ function without the GIL, other Python threads may reconstruct concurrently
+          PhaseRetrieval::ReconsResult result;
+          {
+              py::gil_scoped_release release;
+              result = PhaseRetrieval::reconstruct_iter(holograms, numImages, imSize, fresnelNumbers, iterations,
+                                                        initialPhase, initialAmplitude, algorithm, algoParameters,
+                                                        minPhase, maxPhase, minAmplitude, maxAmplitude, support,
+                                                        outsideValue, padSize, padType, padValue, projectionType,
+                                                        kernelType, holoProbes, initProbePhase, calcError,
+                                                        make_observer(callback, callbackField), callbackInterval);
+          }
+          if (PyErr_Occurred()) {
+              throw py::error_already_set();
           }
           
-          return output_list;
+          // Phase, amplitude and probe phase share one array handed over without copying
+          return result_to_list(std::move(result));
     }, "Iterative phase retrieval with auto-parsing from numpy array",
           py::arg("holograms"),
           py::arg("fresnelNumbers"),
@@ -315,14 +356,18 @@ PYBIND11_MODULE(hiholo, m) {
           py::arg("kernelType") = CUDAPropKernel::Type::Fourier,
           py::arg("holoProbes") = py::array_t<float>(),
           py::arg("initProbePhase") = py::array_t<float>(),
-          py::arg("calcError") = false);
+          py::arg("calcError") = false,
+          py::arg("callback") = py::none(),
+          py::arg("callbackInterval") = 1,
+          py::arg("callbackField") = false);
 
     // Bind EPI reconstruction function with numpy array auto-parsing
     m.def("reconstruct_epi", [](py::array_t<float> holograms_array, const F2DArray& fresnelNumbers,
                                int iterations, py::array_t<float> initialPhase_array, py::array_t<float> initialAmplitude_array,
                                float minPhase, float maxPhase, float minAmplitude, float maxAmplitude,
                                const IntArray& support, float outsideValue, const IntArray& padSize,
-                               PMagnitudeCons::Type projectionType, CUDAPropKernel::Type kernelType, bool calcError) {
+                               PMagnitudeCons::Type projectionType, CUDAPropKernel::Type kernelType, bool calcError,
+                               py::object callback, int callbackInterval, bool callbackField) {
           
           py::buffer_info holo_buf = holograms_array.request();
           
@@ -369,41 +414,21 @@ PYBIND11_MODULE(hiholo, m) {
               initialAmplitude.assign(amp_data_ptr, amp_data_ptr + amp_buf.size);
           }
           
-          // Call the original C++ function
-          F2DArray result = PhaseRetrieval::reconstruct_epi(holograms, numImages, measSize, fresnelNumbers, iterations, imSize,
-                                                            initialPhase, initialAmplitude, minPhase, maxPhase, minAmplitude, maxAmplitude,
-                                                            support, outsideValue, projectionType, kernelType, calcError);
-          
-          // Convert F2DArray result to list of numpy arrays with proper dimensions
-          py::list output_list;
-          for (size_t i = 0; i < result.size(); ++i) {
-              const auto& array = result[i];
-              
-              if (i < 2) {
-                  // First 2 arrays: phase, amplitude (2D with imSize dimensions)
-                  auto output = py::array_t<float>(imSize[0] * imSize[1]);
-                  py::buffer_info output_buf = output.request();
-                  float* output_ptr = static_cast<float*>(output_buf.ptr);
-                  
-                  // Copy data
-                  std::copy(array.begin(), array.end(), output_ptr);
-                  
-                  // Reshape to 2D with measurement size
-                  output.resize({imSize[0], imSize[1]});
-                  output_list.append(output);
-              } else {
-                  // Last 2 arrays: step_errors, pm_errors (1D)
-                  auto output = py::array_t<float>(array.size());
-                  py::buffer_info output_buf = output.request();
-                  float* output_ptr = static_cast<float*>(output_buf.ptr);
-                  
-                  // Copy data (keep as 1D)
-                  std::copy(array.begin(), array.end(), output_ptr);
-                  output_list.append(output);
-              }
+          // Call the original C++ function without the GIL, other Python threads may reconstruct concurrently
+          PhaseRetrieval::ReconsResult result;
+          {
+              py::gil_scoped_release release;
+              result = PhaseRetrieval::reconstruct_epi(holograms, numImages, measSize, fresnelNumbers, iterations, imSize,
+                                                       initialPhase, initialAmplitude, minPhase, maxPhase, minAmplitude, maxAmplitude,
+                                                       support, outsideValue, projectionType, kernelType, calcError,
+                                                       make_observer(callback, callbackField), callbackInterval);
+          }
+          if (PyErr_Occurred()) {
+              throw py::error_already_set();
           }
           
-          return output_list; 
+          // Phase and amplitude share one array handed over without copying
+          return result_to_list(std::move(result));
     }, "EPI phase retrieval with auto-parsing from numpy array",
           py::arg("holograms"),
           py::arg("fresnelNumbers"),
@@ -419,7 +444,10 @@ PYBIND11_MODULE(hiholo, m) {
           py::arg("padSize") = IntArray(),
           py::arg("projectionType") = PMagnitudeCons::Type::Averaged,
           py::arg("kernelType") = CUDAPropKernel::Type::Fourier,
-          py::arg("calcError") = false);
+          py::arg("calcError") = false,
+          py::arg("callback") = py::none(),
+          py::arg("callbackInterval") = 1,
+          py::arg("callbackField") = false);
 
     // Bind CTFReconstructor class with numpy array auto-parsing
     py::class_<PhaseRetrieval::CTFReconstructor>(m, "CTFReconstructor")
@@ -452,8 +480,12 @@ PYBIND11_MODULE(hiholo, m) {
             float* data_ptr = static_cast<float*>(buf.ptr);
             holograms.assign(data_ptr, data_ptr + buf.size);
             
-            // Call the original C++ function
-            FArray result = self.reconsBatch(holograms);
+            // Call the original C++ function without the GIL, other Python threads may reconstruct concurrently
+            FArray result;
+            {
+                py::gil_scoped_release release;
+                result = self.reconsBatch(holograms);
+            }
             
             // Convert result back to numpy array
             auto output = py::array_t<float>(result.size());
@@ -514,8 +546,12 @@ PYBIND11_MODULE(hiholo, m) {
                 initialPhase.assign(phase_data_ptr, phase_data_ptr + phase_buf.size);
             }
             
-            // Call the original C++ function
-            FArray result = self.reconsBatch(holograms, initialPhase);
+            // Call the original C++ function without the GIL, other Python threads may reconstruct concurrently
+            FArray result;
+            {
+                py::gil_scoped_release release;
+                result = self.reconsBatch(holograms, initialPhase);
+            }
             
             // Convert result back to numpy array
             auto output = py::array_t<float>(result.size());
@@ -528,4 +564,65 @@ PYBIND11_MODULE(hiholo, m) {
         }, "Reconstruct a batch of holograms using iterative method with auto-parsing from numpy array",
             py::arg("holograms"),
             py::arg("initialPhase") = py::array_t<float>());
-}
\ No newline at end of file
+
+    // Bind thread-pool executor for many independent angles
+    m.def("reconstruct_many", [](py::array_t<float> holograms_array, const F2DArray& fresnelNumbers, int iterations,
+                                 py::array_t<float> initialPhase_array, ProjectionSolver::Algorithm algorithm,
+                                 const FArray& algoParameters, float minPhase, float maxPhase, float minAmplitude,
+                                 float maxAmplitude, const IntArray& support, float outsideValue, const IntArray& padSize,
+                                 CUDAUtils::PaddingType padType, float padValue, PMagnitudeCons::Type projectionType,
+                                 CUDAPropKernel::Type kernelType, int numThreads, int numDevices) {
+          py::buffer_info holo_buf = holograms_array.request();
+          if (holo_buf.ndim != 4) {
+              throw std::runtime_error("Holograms array must be 4D (angles, images, rows, cols)");
+          }
+
+          int numAngles = holo_buf.shape[0];
+          int numImages = holo_buf.shape[1];
+          int rows = holo_buf.shape[2];
+          int cols = holo_buf.shape[3];
+          IntArray imSize {rows, cols};
+
+          FArray holograms;
+          float* holo_data_ptr = static_cast<float*>(holo_buf.ptr);
+          holograms.assign(holo_data_ptr, holo_data_ptr + holo_buf.size);
+
+          FArray initialPhase;
+          if (initialPhase_array.size() > 0) {
+              py::buffer_info phase_buf = initialPhase_array.request();
+              float* phase_data_ptr = static_cast<float*>(phase_buf.ptr);
+              initialPhase.assign(phase_data_ptr, phase_data_ptr + phase_buf.size);
+          }
+
+          // Call the original C++ function without the GIL, the workers never touch Python objects
+          FTensor result;
+          {
+              py::gil_scoped_release release;
+              result = PhaseRetrieval::reconstruct_many(holograms, numAngles, numImages, imSize, fresnelNumbers, iterations,
+                                                        initialPhase, algorithm, algoParameters, minPhase, maxPhase,
+                                                        minAmplitude, maxAmplitude, support, outsideValue, padSize, padType,
+                                                        padValue, projectionType, kernelType, numThreads, numDevices);
+          }
+
+          return tensor_to_numpy(std::move(result));
+    }, "Iterative phase retrieval of many angles on a work-stealing thread pool within one process",
+          py::arg("holograms"),
+          py::arg("fresnelNumbers"),
+          py::arg("iterations") = 200,
+          py::arg("initialPhase") = py::array_t<float>(),
+          py::arg("algorithm") = ProjectionSolver::Algorithm::AP,
+          py::arg("algoParameters") = FArray(),
+          py::arg("minPhase") = -1e10f,
+          py::arg("maxPhase") = 1e10f,
+          py::arg("minAmplitude") = 0.0f,
+          py::arg("maxAmplitude") = 1e10f,
+          py::arg("support") = IntArray(),
+          py::arg("outsideValue") = 0.0f,
+          py::arg("padSize") = IntArray(),
+          py::arg("padType") = CUDAUtils::PaddingType::Replicate,
+          py::arg("padValue") = 0.0f,
+          py::arg("projectionType") = PMagnitudeCons::Type::Averaged,
+          py::arg("kernelType") = CUDAPropKernel::Type::Fourier,
+          py::arg("numThreads") = 0,
+          py::arg("numDevices") = 0);
+}
@@ -0,0 +1,86 @@
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include "HostStaging.h"
+
+HostStaging::HostStaging(size_t inputSize, size_t outputSize, int slots): input(nullptr), output(nullptr), pinned(false)
+{
+    if (slots <= 0)
+        throw std::invalid_argument("Staging needs at least one slot!");
+
+    if (!std::getenv("HIHOLO_PAGEABLE")) {
+        pinned = cudaHostAlloc((void**)&input, inputSize * sizeof(float), cudaHostAllocDefault) == cudaSuccess &&
+                 cudaHostAlloc((void**)&output, outputSize * sizeof(float), cudaHostAllocDefault) == cudaSuccess;
+        if (!pinned) {
+            // The failed allocation leaves an error behind, later checks must not see it
+            cudaGetLastError();
+            if (input)
+                cudaFreeHost(input);
+            if (output)
+                cudaFreeHost(output);
+        }
+    }
+    if (!pinned) {
+        // Uploads copy straight from the source, only downloads are staged
+        input = nullptr;
+        if (outputSize > static_cast<size_t>(std::numeric_limits<int>::max()))
+            throw std::invalid_argument("The staging output is too large for a tensor extent!");
+        pageableOutput = FTensor({static_cast<int>(outputSize)});
+        output = pageableOutput.data();
+    }
+
+    cudaStreamCreateWithFlags(&copyStream, cudaStreamNonBlocking);
+    for (auto *events: {&uploaded, &computed, &downloaded}) {
+        events->resize(slots);
+        for (auto &event: *events) {
+            cudaEventCreateWithFlags(&event, cudaEventDisableTiming);
+        }
+    }
+}
+
+HostStaging::~HostStaging()
+{
+    cudaStreamSynchronize(copyStream);
+    for (auto *events: {&uploaded, &computed, &downloaded}) {
+        for (auto &event: *events) {
+            cudaEventDestroy(event);
+        }
+    }
+    cudaStreamDestroy(copyStream);
+    if (pinned) {
+        cudaFreeHost(input);
+        cudaFreeHost(output);
+    }
+}
+
+void HostStaging::upload(float *dst, const float *src, size_t count, size_t offset, int slot)
+{
+    // Pageable sources are copied by the driver directly, staging them once more gains nothing
+    const float *staged = src;
+    if (pinned) {
+        std::memcpy(input + offset, src, count * sizeof(float));
+        staged = input + offset;
+    }
+    cudaMemcpyAsync(dst, staged, count * sizeof(float), cudaMemcpyHostToDevice, copyStream);
+    cudaEventRecord(uploaded[slot], copyStream);
+}
+
+void HostStaging::waitUpload(int slot, cudaStream_t stream)
+{
+    cudaStreamWaitEvent(stream, uploaded[slot], 0);
+}
+
+void HostStaging::download(const float *src, size_t count, size_t offset, int slot, cudaStream_t stream)
+{
+    cudaEventRecord(computed[slot], stream);
+    cudaStreamWaitEvent(copyStream, computed[slot], 0);
+    cudaMemcpyAsync(output + offset, src, count * sizeof(float), cudaMemcpyDeviceToHost, copyStream);
+    cudaEventRecord(downloaded[slot], copyStream);
+}
+
+void HostStaging::collect(float *dst, size_t count, size_t offset, int slot)
+{
+    cudaEventSynchronize(downloaded[slot]);
+    std::memcpy(dst, output + offset, count * sizeof(float));
+}
@@ -1,4 +1,7 @@
+#include <exception>
+#include <limits>
 #include "IRPSolver.h"
+#include "trace_utils.h"
 
 Grid::Grid(int ix, int iy, int iz) : nx(ix), ny(iy), nz(iz), size(ix * iy * iz)
 {
@@ -34,15 +37,15 @@ void Grid::scaleValues(float scale)
     scaleFloatData<<<gridSize, blockSize>>>(values, size, scale);
 }
 
-CUDAStreamART::CUDAStreamART(int ix, int iy, int N): nx(ix), ny(iy), numStreams(N)
+CUDAStreamART::CUDAStreamART(int ix, int iz, int N): nx(ix), nz(iz), numStreams(N)
 {
     streams = new cudaStream_t[numStreams];
     for (int i = 0; i < numStreams; i++) {
         cudaStreamCreate(&streams[i]);
     }
 
-    cudaMalloc((void**)&tp, (nx + 4) * ny * numStreams * sizeof(float));
-    cudaMalloc((void**)&tp_back, (nx + 4) * ny * sizeof(float));
+    cudaMalloc((void**)&tp, (nx + 4) * nz * numStreams * sizeof(float));
+    cudaMalloc((void**)&tp_back, (nx + 4) * nz * sizeof(float));
 }
 
 void CUDAStreamART::syncStreams()
@@ -54,11 +57,11 @@ void CUDAStreamART::syncStreams()
 
 void CUDAStreamART::merge(float *project)
 {
-    cudaMemcpy(project, tp + 2 * ny, nx * ny * sizeof(float), cudaMemcpyDeviceToDevice);
+    cudaMemcpy(project, tp + 2 * nz, nx * nz * sizeof(float), cudaMemcpyDeviceToDevice);
     int blockSize = 1024;
-    int numBlocks = (nx * ny + blockSize - 1) / blockSize;
+    int numBlocks = (nx * nz + blockSize - 1) / blockSize;
     for (int i = 1; i < numStreams; i++) {
-        addFloatData<<<numBlocks, blockSize>>>(project, tp + i * (nx + 4) * ny + 2 * ny, nx * ny);
+        addFloatData<<<numBlocks, blockSize>>>(project, tp + i * (nx + 4) * nz + 2 * nz, nx * nz);
     }
 }
 
@@ -66,10 +69,10 @@ void CUDAStreamART::projectGrid(const Grid &grid, float *project, float phi)
 {    
     for (int i = 0; i < numStreams; i++) {
         if (i == numStreams - 1) {
-            grid_project(grid.getValues(), tp + i * (nx + 4) * ny, grid.getNx(), grid.getNz(),
+            grid_project(grid.getValues(), tp + i * (nx + 4) * nz, grid.getNx(), grid.getNz(),
                          phi, i * grid.getSize() / numStreams, grid.getSize(), streams[i]);
         } else {
-            grid_project(grid.getValues(), tp + i * (nx + 4) * ny, grid.getNx(), grid.getNz(),
+            grid_project(grid.getValues(), tp + i * (nx + 4) * nz, grid.getNx(), grid.getNz(),
                          phi, i * grid.getSize() / numStreams, (i + 1) * grid.getSize() / numStreams, streams[i]);
         }
     }
@@ -78,46 +81,30 @@ void CUDAStreamART::projectGrid(const Grid &grid, float *project, float phi)
     merge(project);
 }
 
-void CUDAStreamART::backProjectGrid(Grid &grid, const float *project, float phi, int size, int rank)
+void CUDAStreamART::backProjectGrid(Grid &grid, const float *project, float phi)
 {
-    cudaMemset(tp_back, 0, (nx + 4) * ny * sizeof(float));
-    cudaMemcpy(tp_back + 2 * ny, project, nx * ny * sizeof(float), cudaMemcpyDeviceToDevice);
-    int procSize = grid.getSize() / size;
+    cudaMemset(tp_back, 0, (nx + 4) * nz * sizeof(float));
+    cudaMemcpy(tp_back + 2 * nz, project, nx * nz * sizeof(float), cudaMemcpyDeviceToDevice);
 
     for (int i = 0; i < numStreams; i++) {
-        if (i == numStreams - 1) {
-            grid_back_project(grid.getValues(), tp_back, grid.getNx(), grid.getNz(), phi,
-                              rank * procSize + i * procSize / numStreams, (rank + 1) * procSize, streams[i]);
-        } else {
-            grid_back_project(grid.getValues(), tp_back, grid.getNx(), grid.getNz(), phi,
-                              rank * procSize + i * procSize / numStreams, rank * procSize + (i + 1) * procSize / numStreams, streams[i]);
-        }
+        grid_back_project(grid.getValues(), tp_back, grid.getNx(), grid.getNz(), phi,
+                          i * grid.getSize() / numStreams, (i + 1) * grid.getSize() / numStreams, streams[i]);
     }
     
     syncStreams();
 }
 
-void CUDAStreamART::maxMapGrid(Grid &grid, const float *project, float phi, int size, int rank)
+void CUDAStreamART::maxMapGrid(Grid &grid, const float *project, float phi)
 {
-    grid.setValues(1e11f);
-    cudaMemset(tp_back, 0, (nx + 4) * ny * sizeof(float));
-    cudaMemcpy(tp_back + 2 * ny, project, nx * ny * sizeof(float), cudaMemcpyDeviceToDevice);
-    int procSize = grid.getSize() / size;
+    cudaMemset(tp_back, 0, (nx + 4) * nz * sizeof(float));
+    cudaMemcpy(tp_back + 2 * nz, project, nx * nz * sizeof(float), cudaMemcpyDeviceToDevice);
 
     for (int i = 0; i < numStreams; i++) {
-        if (i == numStreams - 1) {
-            grid_max_map(grid.getValues(), tp_back, grid.getNx(), grid.getNz(), phi, 
-                         rank * procSize + i * procSize / numStreams, (rank + 1) * procSize, streams[i]);
-        } else {
-            grid_max_map(grid.getValues(), tp_back, grid.getNx(), grid.getNz(), phi,
-                         rank * procSize + i * procSize / numStreams, rank * procSize + (i + 1) * procSize / numStreams, streams[i]);
-        }
+        grid_max_map(grid.getValues(), tp_back, grid.getNx(), grid.getNz(), phi,
+                     i * grid.getSize() / numStreams, (i + 1) * grid.getSize() / numStreams, streams[i]);
     }
 
     syncStreams();
-    int blockSize = 1024;
-    int numBlocks = (procSize + blockSize - 1) / blockSize;
-    limitGrid<<<numBlocks, blockSize>>>(grid.getValues() + rank * procSize, 0.99f * 1e11f, procSize);
 }
 
 CUDAStreamART::~CUDAStreamART()
@@ -131,6 +118,214 @@ CUDAStreamART::~CUDAStreamART()
     cudaFree(tp_back);
 }
 
+CUDASystemMatrix::CUDASystemMatrix(const ARTUtils::SystemMatrix &matrix): nx(matrix.nx), ny(matrix.ny)
+{
+    cudaMalloc((void**)&rowOffsets, (matrix.numRows() + 1) * sizeof(int));
+    cudaMalloc((void**)&columns, matrix.numEntries * sizeof(int));
+    cudaMalloc((void**)&weights, matrix.numEntries * sizeof(float));
+    cudaMemcpy(rowOffsets, matrix.rowOffsets, (matrix.numRows() + 1) * sizeof(int), cudaMemcpyHostToDevice);
+    cudaMemcpy(columns, matrix.columns, matrix.numEntries * sizeof(int), cudaMemcpyHostToDevice);
+    cudaMemcpy(weights, matrix.weights, matrix.numEntries * sizeof(float), cudaMemcpyHostToDevice);
+}
+
+void CUDASystemMatrix::projectGrid(const Grid &grid, float *project, int angle)
+{
+    cudaMemset(project, 0, nx * grid.getNz() * sizeof(float));
+    int blockSize = 1024;
+    int numBlocks = (grid.getSize() + blockSize - 1) / blockSize;
+    csr_project_k<<<numBlocks, blockSize>>>(grid.getValues(), project, rowOffsets + angle * nx * ny, columns,
+                                            weights, grid.getNz(), grid.getSize());
+}
+
+void CUDASystemMatrix::backProjectGrid(Grid &grid, const float *project, int angle)
+{
+    int blockSize = 1024;
+    int numBlocks = (grid.getSize() + blockSize - 1) / blockSize;
+    csr_back_project_k<<<numBlocks, blockSize>>>(grid.getValues(), project, rowOffsets + angle * nx * ny, columns,
+                                                 weights, grid.getNz(), grid.getSize());
+}
+
+void CUDASystemMatrix::maxMapGrid(Grid &grid, const float *project, int angle)
+{
+    int blockSize = 1024;
+    int numBlocks = (grid.getSize() + blockSize - 1) / blockSize;
+    csr_max_map_k<<<numBlocks, blockSize>>>(grid.getValues(), project, rowOffsets + angle * nx * ny, columns,
+                                            weights, grid.getNz(), grid.getSize());
+}
+
+CUDASystemMatrix::~CUDASystemMatrix()
+{
+    cudaFree(rowOffsets);
+    cudaFree(columns);
+    cudaFree(weights);
+}
+
+SlabExchange::SlabExchange(int ix, int iz, int numangles, MPI_Comm communicator, int numChunks): comm(communicator), nx(ix), nz(iz),
+                           numAngles(numangles)
+{
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    if (size > nz) {
+        throw std::invalid_argument("The number of processes exceeds the number of slices!");
+    }
+    if (numChunks <= 0) {
+        throw std::invalid_argument("The number of chunks must be positive!");
+    }
+
+    IntArray angleCounts(size);
+    MPI_Allgather(&numAngles, 1, MPI_INT, angleCounts.data(), 1, MPI_INT, comm);
+    angleStarts.push_back(0);
+    for (int r = 0; r < size; r++) {
+        angleStarts.push_back(angleStarts[r] + angleCounts[r]);
+    }
+    numChunks = std::max(1, std::min(numChunks, *std::max_element(angleCounts.begin(), angleCounts.end())));
+
+    for (int r = 0; r <= size; r++) {
+        zStarts.push_back(static_cast<int>(static_cast<long>(r) * nz / size));
+    }
+
+    // The packed buffer holds [rank][local angle][x][depth of rank], so every chunk is contiguous per rank
+    IntArray packedStarts {0};
+    for (int r = 0; r < size; r++) {
+        packedStarts.push_back(packedStarts[r] + numAngles * nx * (zStarts[r + 1] - zStarts[r]));
+    }
+
+    // Chunk c holds the c-th part of the angles of every rank, which may be empty for some ranks
+    int depth = getSlabDepth();
+    for (int c = 0; c < numChunks; c++) {
+        Chunk chunk;
+        chunk.first = c * numAngles / numChunks;
+        chunk.last = (c + 1) * numAngles / numChunks;
+        int chunkAngles = chunk.last - chunk.first;
+
+        for (int r = 0; r < size; r++) {
+            int rankDepth = zStarts[r + 1] - zStarts[r];
+            int first = c * angleCounts[r] / numChunks;
+            int last = (c + 1) * angleCounts[r] / numChunks;
+            for (int j = first; j < last; j++) {
+                chunk.angles.push_back(angleStarts[r] + j);
+            }
+            chunk.packedCounts.push_back(chunkAngles * nx * rankDepth);
+            chunk.packedDispls.push_back(packedStarts[r] + chunk.first * nx * rankDepth);
+            chunk.slabCounts.push_back((last - first) * nx * depth);
+            chunk.slabDispls.push_back((angleStarts[r] + first) * nx * depth);
+        }
+        chunks.push_back(chunk);
+    }
+
+    cudaMalloc((void**)&packed, numAngles * nx * nz * sizeof(float));
+}
+
+void SlabExchange::scatter(const float *angleProjs, float *slabProjs, const ChunkMethod &arrived)
+{
+    std::vector<MPI_Request> requests(chunks.size());
+    for (size_t c = 0; c < chunks.size(); c++) {
+        const Chunk &chunk = chunks[c];
+        for (int r = 0; r < size; r++) {
+            int depth = zStarts[r + 1] - zStarts[r];
+            cudaMemcpy2D(packed + chunk.packedDispls[r], depth * sizeof(float),
+                         angleProjs + chunk.first * nx * nz + zStarts[r], nz * sizeof(float),
+                         depth * sizeof(float), (chunk.last - chunk.first) * nx, cudaMemcpyDeviceToDevice);
+        }
+        cudaDeviceSynchronize();
+
+        // Blocks arrive ordered by source rank, which is already the global angle order
+        MPI_Ialltoallv(packed, chunk.packedCounts.data(), chunk.packedDispls.data(), MPI_FLOAT, slabProjs,
+                       chunk.slabCounts.data(), chunk.slabDispls.data(), MPI_FLOAT, comm, &requests[c]);
+    }
+
+    // Work on a chunk starts as soon as it has arrived, later chunks are still in flight
+    for (size_t c = 0; c < chunks.size(); c++) {
+        {
+            TRACE_SCOPE("scatter wait", "mpi");
+            MPI_Wait(&requests[c], MPI_STATUS_IGNORE);
+        }
+        if (arrived)
+            arrived(chunks[c].angles);
+    }
+}
+
+void SlabExchange::gather(const float *slabProjs, float *angleProjs, const ChunkMethod &produce)
+{
+    // Chunk k is exchanged while chunk k + 1 is produced
+    std::vector<MPI_Request> requests(chunks.size());
+    for (size_t c = 0; c < chunks.size(); c++) {
+        const Chunk &chunk = chunks[c];
+        if (produce)
+            produce(chunk.angles);
+        cudaDeviceSynchronize();
+
+        MPI_Ialltoallv(slabProjs, chunk.slabCounts.data(), chunk.slabDispls.data(), MPI_FLOAT, packed,
+                       chunk.packedCounts.data(), chunk.packedDispls.data(), MPI_FLOAT, comm, &requests[c]);
+    }
+
+    for (size_t c = 0; c < chunks.size(); c++) {
+        const Chunk &chunk = chunks[c];
+        {
+            TRACE_SCOPE("gather wait", "mpi");
+            MPI_Wait(&requests[c], MPI_STATUS_IGNORE);
+        }
+        for (int r = 0; r < size; r++) {
+            int depth = zStarts[r + 1] - zStarts[r];
+            cudaMemcpy2D(angleProjs + chunk.first * nx * nz + zStarts[r], nz * sizeof(float),
+                         packed + chunk.packedDispls[r], depth * sizeof(float),
+                         depth * sizeof(float), (chunk.last - chunk.first) * nx, cudaMemcpyDeviceToDevice);
+        }
+    }
+}
+
+FArray SlabExchange::gatherAngles(const FArray &localAngles) const
+{
+    if (static_cast<int>(localAngles.size()) != numAngles) {
+        throw std::invalid_argument("The number of local angles does not match the projections!");
+    }
+
+    IntArray counts(size);
+    for (int r = 0; r < size; r++) {
+        counts[r] = angleStarts[r + 1] - angleStarts[r];
+    }
+
+    FArray angles(getTotalAngles());
+    MPI_Allgatherv(localAngles.data(), numAngles, MPI_FLOAT, angles.data(), counts.data(), angleStarts.data(), MPI_FLOAT, comm);
+    return angles;
+}
+
+FArray SlabExchange::gatherGrid(const Grid &slab) const
+{
+    int depth = getSlabDepth();
+    int columns = slab.getNx() * slab.getNy();
+    FArray local(slab.getSize());
+    cudaMemcpy(local.data(), slab.getValues(), slab.getSize() * sizeof(float), cudaMemcpyDeviceToHost);
+
+    IntArray counts, displs;
+    for (int r = 0; r < size; r++) {
+        counts.push_back(columns * (zStarts[r + 1] - zStarts[r]));
+        displs.push_back(columns * zStarts[r]);
+    }
+
+    FArray slabs(rank == 0 ? static_cast<size_t>(columns) * nz : 0);
+    MPI_Gatherv(local.data(), columns * depth, MPI_FLOAT, slabs.data(), counts.data(), displs.data(), MPI_FLOAT, 0, comm);
+    if (rank != 0)
+        return FArray();
+
+    // Interleave the slabs into the grid layout (y * nx + x) * nz + z
+    FArray volume(slabs.size());
+    for (int r = 0; r < size; r++) {
+        int slabDepth = zStarts[r + 1] - zStarts[r];
+        const float *src = slabs.data() + displs[r];
+        for (int c = 0; c < columns; c++) {
+            std::copy(src + c * slabDepth, src + (c + 1) * slabDepth, volume.data() + static_cast<size_t>(c) * nz + zStarts[r]);
+        }
+    }
+
+    return volume;
+}
+
+SlabExchange::~SlabExchange()
+{
+    cudaFree(packed);
+}
+
 void grid_project(const float *grid, float *project, int nx, int nz, float phi, int start, int end, cudaStream_t stream)
 {
     float sinp = sin(phi);
@@ -198,74 +393,190 @@ void grid_max_map(float *grid, const float *project, int nx, int nz, float phi,
                                                                   cosp, sinp, start, end, border);
 }
 
-void reprojectART(Grid &grid, float *projects, int totalAngles, int numStreams, float *angles, int iters, MPI_Comm comm)
+ARTUtils::SystemMatrix buildSharedSystemMatrix(int nx, int ny, const FArray &angles, MPI_Comm comm)
 {
-    int rank, size;
-    MPI_Comm_rank(comm, &rank);
-    MPI_Comm_size(comm, &size);
-
-    int numAngles = totalAngles / size;
-    int procSize = grid.getSize() / size;
-    CUDAStreamART streamART(grid.getNx(), grid.getNy(), numStreams);
+    struct Storage
+    {
+        std::unique_ptr<SharedArray<int>> rowOffsets;
+        std::unique_ptr<SharedArray<int>> columns;
+        std::unique_ptr<SharedArray<float>> weights;
+    };
+    auto storage = std::make_shared<Storage>();
+
+    // Checked by every rank, so that all of them throw before waiting for the node owner
+    size_t numRows = angles.size() * static_cast<size_t>(nx) * ny;
+    if (3 * numRows > static_cast<size_t>(std::numeric_limits<int>::max())) {
+        throw std::invalid_argument("The system matrix is too large, disable the matrix cache!");
+    }
 
-    // Synchronize all projections from all GPUs
-    int imSize = grid.getNx() * grid.getNy();
-    int localSize = numAngles * imSize;
-    MPI_Allgather(MPI_IN_PLACE, localSize, MPI_FLOAT, projects, localSize, MPI_FLOAT, comm);
+    // The node owner builds the matrix, the entry count is known to the others from the row offsets
+    ARTUtils::SystemMatrix local;
+    storage->rowOffsets.reset(new SharedArray<int>(numRows + 1, comm));
+    std::exception_ptr failure;
+    if (storage->rowOffsets->isNodeOwner()) {
+        try {
+            local = ARTUtils::buildSystemMatrix(nx, ny, angles);
+            std::copy(local.rowOffsets, local.rowOffsets + numRows + 1, storage->rowOffsets->data());
+        } catch (...) {
+            failure = std::current_exception();
+        }
+    }
+    // A failed owner would leave the others waiting in sync
+    int failed = failure ? 1 : 0;
+    MPI_Allreduce(MPI_IN_PLACE, &failed, 1, MPI_INT, MPI_MAX, comm);
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
+    if (failed) {
+        throw std::runtime_error("Building the system matrix failed on another rank!");
+    }
+    storage->rowOffsets->sync();
+
+    size_t numEntries = (*storage->rowOffsets)[numRows];
+    storage->columns.reset(new SharedArray<int>(numEntries, comm));
+    storage->weights.reset(new SharedArray<float>(numEntries, comm));
+    if (storage->columns->isNodeOwner()) {
+        std::copy(local.columns, local.columns + numEntries, storage->columns->data());
+        std::copy(local.weights, local.weights + numEntries, storage->weights->data());
+    }
+    storage->columns->sync();
+    storage->weights->sync();
+
+    ARTUtils::SystemMatrix matrix;
+    matrix.nx = nx;
+    matrix.ny = ny;
+    matrix.numAngles = static_cast<int>(angles.size());
+    matrix.numEntries = numEntries;
+    matrix.rowOffsets = storage->rowOffsets->data();
+    matrix.columns = storage->columns->data();
+    matrix.weights = storage->weights->data();
+    matrix.storage = storage;
+    return matrix;
+}
 
-    for (int i = 0; i < totalAngles; i++) {
-        streamART.maxMapGrid(grid, projects + i * imSize, *(angles + i), size, rank);
+void reprojectART(Grid &grid, SlabExchange &exchange, float *angleProjs, float *slabProjs, int numStreams,
+                  const FArray &angles, const ARTOptions &options, const ARTUtils::SystemMatrix *matrix)
+{
+    int imSize = grid.getNx() * grid.getNz();
+    int totalAngles = exchange.getTotalAngles();
+    if (static_cast<int>(angles.size()) != totalAngles) {
+        throw std::invalid_argument("The number of angles does not match the projections!");
     }
-    // Swap values for different parts of the grid
-    MPI_Allgather(MPI_IN_PLACE, procSize, MPI_FLOAT, grid.getValues(), procSize, MPI_FLOAT, comm);
 
-    Grid *map = new Grid(grid.getNx(), grid.getNy(), grid.getNz());
-    float *tmpProjs;
-    cudaMalloc(&tmpProjs, totalAngles * imSize * sizeof(float));
+    // The host engine runs the passes on the slab with threads over its slices
+    if (options.device == ARTOptions::CPU) {
+        exchange.scatter(angleProjs, slabProjs);
+        FArray hostGrid(grid.getSize());
+        FArray hostProjs(static_cast<size_t>(totalAngles) * imSize);
+        cudaMemcpy(hostProjs.data(), slabProjs, hostProjs.size() * sizeof(float), cudaMemcpyDeviceToHost);
+        ARTUtils::reprojectART(hostGrid, hostProjs, grid.getNx(), grid.getNy(), grid.getNz(), angles, options, matrix);
+        cudaMemcpy(grid.getValues(), hostGrid.data(), hostGrid.size() * sizeof(float), cudaMemcpyHostToDevice);
+        cudaMemcpy(slabProjs, hostProjs.data(), hostProjs.size() * sizeof(float), cudaMemcpyHostToDevice);
+        exchange.gather(slabProjs, angleProjs);
+        return;
+    }
 
-    for (int k = 0; k < iters; k++) {
-        map->setZeros();
-        
-        for (int i = 0; i < numAngles; i++) {
-            streamART.projectGrid(grid, tmpProjs + rank * localSize + i * imSize, *(angles + rank * numAngles + i));
+    // The slab holds all angles of its slices, the passes run without any communication
+    CUDAStreamART streamART(grid.getNx(), grid.getNz(), numStreams);
+    std::unique_ptr<CUDASystemMatrix> deviceMatrix;
+    if (options.cacheMatrix) {
+        if (!matrix) {
+            throw std::invalid_argument("The system matrix is required when caching is enabled!");
         }
-
-        int blockSize = 1024;
-        int numBlocks = (localSize + blockSize - 1) / blockSize;
-        updateProject<<<numBlocks, blockSize>>>(tmpProjs + rank * localSize, projects + rank * localSize, localSize);
-        MPI_Allgather(MPI_IN_PLACE, localSize, MPI_FLOAT, tmpProjs, localSize, MPI_FLOAT, comm);
-        
-        for (int i = 0; i < totalAngles; i++) {
-            streamART.backProjectGrid(*map, tmpProjs + i * imSize, *(angles + i), size, rank);
+        deviceMatrix.reset(new CUDASystemMatrix(*matrix));
+    }
+    auto projectGrid = [&](Grid &target, float *project, int angle) {
+        if (deviceMatrix) deviceMatrix->projectGrid(target, project, angle);
+        else streamART.projectGrid(target, project, angles[angle]);
+    };
+    auto backProjectGrid = [&](Grid &target, const float *project, int angle) {
+        if (deviceMatrix) deviceMatrix->backProjectGrid(target, project, angle);
+        else streamART.backProjectGrid(target, project, angles[angle]);
+    };
+
+    // Initial grid is the minimum over all angles of the smeared back projections,
+    // accumulated chunk by chunk while the remaining projections are transposed
+    int blockSize = 1024;
+    int numBlocks = (grid.getSize() + blockSize - 1) / blockSize;
+    grid.setValues(1e11f);
+    exchange.scatter(angleProjs, slabProjs, [&](const IntArray &chunkAngles) {
+        for (int angle: chunkAngles) {
+            if (deviceMatrix) deviceMatrix->maxMapGrid(grid, slabProjs + angle * imSize, angle);
+            else streamART.maxMapGrid(grid, slabProjs + angle * imSize, angles[angle]);
+        }
+    });
+    limitGrid<<<numBlocks, blockSize>>>(grid.getValues(), 0.99f * 1e11f, grid.getSize());
+
+    // The filtered back projection runs on the host threads and is bounded by the max map
+    if (options.init == ARTOptions::FilteredBackProjection) {
+        FArray hostProjs(static_cast<size_t>(totalAngles) * imSize);
+        FArray hostGrid(grid.getSize()), filtered(grid.getSize());
+        cudaMemcpy(hostProjs.data(), slabProjs, hostProjs.size() * sizeof(float), cudaMemcpyDeviceToHost);
+        cudaMemcpy(hostGrid.data(), grid.getValues(), hostGrid.size() * sizeof(float), cudaMemcpyDeviceToHost);
+        ARTUtils::filteredBackProject(filtered, hostProjs, grid.getNx(), grid.getNy(), grid.getNz(), angles, options.numThreads);
+        for (size_t i = 0; i < hostGrid.size(); i++) {
+            hostGrid[i] = std::min(hostGrid[i], std::max(filtered[i], 0.0f));
         }
-        // Swap values for different parts of map
-        MPI_Allgather(MPI_IN_PLACE, procSize, MPI_FLOAT, map->getValues(), procSize, MPI_FLOAT, comm);
+        cudaMemcpy(grid.getValues(), hostGrid.data(), hostGrid.size() * sizeof(float), cudaMemcpyHostToDevice);
+    }
 
-        numBlocks = (grid.getSize() + blockSize - 1) / blockSize;
-        updateGrid<<<numBlocks, blockSize>>>(grid.getValues(), map->getValues(), totalAngles, grid.getSize());
+    Grid *map = new Grid(grid.getNx(), grid.getNy(), grid.getNz());
+    std::vector<IntArray> subsets = ARTUtils::orderedSubsets(angles, options.numSubsets, options.order);
+    int maxSubset = 0;
+    for (const auto &subset: subsets) {
+        maxSubset = std::max(maxSubset, static_cast<int>(subset.size()));
     }
+    float *tmpProjs;
+    cudaMalloc(&tmpProjs, maxSubset * imSize * sizeof(float));
+
+    for (int k = 0; k < options.iterations; k++) {
+        for (const auto &subset: subsets) {
+            int subsetAngles = static_cast<int>(subset.size());
+            map->setZeros();
+
+            // Correction ratios of the angles in this subset
+            int projBlocks = (imSize + blockSize - 1) / blockSize;
+            for (int j = 0; j < subsetAngles; j++) {
+                projectGrid(grid, tmpProjs + j * imSize, subset[j]);
+                updateProject<<<projBlocks, blockSize>>>(tmpProjs + j * imSize, slabProjs + subset[j] * imSize, imSize);
+            }
 
-    for (int i = 0; i < numAngles; i++) {
-        streamART.projectGrid(grid, projects + rank * localSize + i * imSize, *(angles + rank * numAngles + i));
+            for (int j = 0; j < subsetAngles; j++) {
+                backProjectGrid(*map, tmpProjs + j * imSize, subset[j]);
+            }
+            updateGrid<<<numBlocks, blockSize>>>(grid.getValues(), map->getValues(), subsetAngles, grid.getSize());
+        }
     }
 
+    // Reproject chunk by chunk, every finished chunk is sent back to the ranks owning its angles
+    exchange.gather(slabProjs, angleProjs, [&](const IntArray &chunkAngles) {
+        for (int angle: chunkAngles) {
+            projectGrid(grid, slabProjs + angle * imSize, angle);
+        }
+    });
+
     delete map;
     cudaFree(tmpProjs);
 }
 
-    FArray reconstruct_irp(const FArray &holograms, int totalAngles, int numImages, const IntArray &imSize,
-                           const F2DArray &fresnelNumbers, MPI_Comm comm, int kmax, float epsilon, int numStreams)
+    FArray reconstruct_irp(const FArray &holograms, const FArray &localAngles, int numImages, const IntArray &imSize,
+                           const F2DArray &fresnelNumbers, MPI_Comm comm, int kmax, float epsilon, int numStreams,
+                           const ARTOptions &artOptions, int maxARTIterations)
     {
         if (fresnelNumbers.size() != numImages)
             throw std::invalid_argument("The number of images and fresnel numbers does not match!");
+        if (kmax <= 0 || artOptions.iterations <= 0 || maxARTIterations < artOptions.iterations)
+            throw std::invalid_argument("Invalid outer iterations or ART iteration limits!");
 
         int rank, size;
         MPI_Comm_rank(comm, &rank);
         MPI_Comm_size(comm, &size);
-        int numAngles = totalAngles / size;
+        int numAngles = static_cast<int>(localAngles.size());
         int projSize = imSize[0] * imSize[1];
+        if (holograms.size() != static_cast<size_t>(numAngles) * numImages * projSize)
+            throw std::invalid_argument("The number of holograms does not match the number of angles!");
 
-        float *d_holograms, *projection, *squared_error;
+        float *d_holograms, *projection, *slabProjection, *squared_error;
         cudaMalloc((void**)&d_holograms, holograms.size() * sizeof(float));
         cudaMemcpy(d_holograms, holograms.data(), holograms.size() * sizeof(float), cudaMemcpyHostToDevice);
 
@@ -281,23 +592,35 @@ void reprojectART(Grid &grid, float *projects, int totalAngles, int numStreams,
         // Create propagators
         PropagatorPtr propPtr = std::make_shared<Propagator>(imSize, fresnelNumbers, CUDAPropKernel::Fourier);
 
-        Grid *grid = new Grid(imSize[0], imSize[1]);
-        grid->setValues(1.0f);
-        cudaMalloc((void**)&projection, totalAngles * projSize * sizeof(float));
-        float *angles = new float[totalAngles];
-        for (int i = 0; i < totalAngles; i++) {
-            angles[i] = i * M_PIf32 / totalAngles;
+        // Every rank owns a slab of slices along the rotation axis, the volume is never replicated
+        SlabExchange exchange(imSize[0], imSize[1], numAngles, comm);
+        int totalAngles = exchange.getTotalAngles();
+        FArray angles = exchange.gatherAngles(localAngles);
+        int slabProjSize = imSize[0] * exchange.getSlabDepth();
+        Grid *grid = new Grid(imSize[0], imSize[0], exchange.getSlabDepth());
+        cudaMalloc((void**)&projection, numAngles * projSize * sizeof(float));
+        cudaMalloc((void**)&slabProjection, totalAngles * slabProjSize * sizeof(float));
+        // The projection weights depend only on the angles, so one matrix per node serves every ART call
+        ARTUtils::SystemMatrix matrix;
+        if (artOptions.cacheMatrix) {
+            matrix = buildSharedSystemMatrix(imSize[0], imSize[0], angles, comm);
         }
+        const ARTUtils::SystemMatrix *matrixPtr = artOptions.cacheMatrix ? &matrix : nullptr;
 
         // start the iterative reconstruction
         float error, total_error;
         float last_error = 0.0f;
         cudaMalloc((void**)&squared_error, numAngles * numImages * projSize * sizeof(float));
-        std::cout << "Starting the iterative reconstruction..." << std::endl;
+        if (rank == 0)
+            std::cout << "Starting the iterative reconstruction..." << std::endl;
 
-        int iteration = 1;
+        // ART passes per call and stop flag, decided on rank 0 and broadcast after every outer iteration
+        ARTOptions options = artOptions;
+        int schedule[2] = {artOptions.iterations, 0};
         int objGridSize = (numAngles * projSize + blockSize - 1) / blockSize;
-        for (int n = 0; n < 1; n++) {
+        for (int n = 0; n < kmax && !schedule[1]; n++) {
+            options.iterations = schedule[0];
+
             // propagate the wave fields to object plane
             for (int i = 0; i < numAngles; i++) {
                 propPtr->backPropagate(propedComplexWave + i * numImages * projSize, complexWave + i * projSize);
@@ -305,21 +628,25 @@ void reprojectART(Grid &grid, float *projects, int totalAngles, int numStreams,
             scaleComplexData<<<objGridSize, blockSize>>>(complexWave, numAngles * projSize, 1.0f / numImages);
 
             // delta part of the objects' index of refraction
-            computeLogAbs<<<objGridSize, blockSize>>>(projection + rank * numAngles * projSize, complexWave, numAngles * projSize);
-            std::cout << "\t" << n << ": ART (1000 iterations)" << std::endl;
-            reprojectART(*grid, projection, totalAngles, numStreams, angles, 1000, comm);
+            computeLogAbs<<<objGridSize, blockSize>>>(projection, complexWave, numAngles * projSize);
+            if (rank == 0)
+                std::cout << "\t" << n << ": ART (" << options.iterations << " iterations, "
+                          << options.numSubsets << " subsets)" << std::endl;
+            reprojectART(*grid, exchange, projection, slabProjection, numStreams, angles, options, matrixPtr);
             // set amplitude to the wave fields
-            scaleExpData<<<objGridSize, blockSize>>>(projection + rank * numAngles * projSize, numAngles * projSize, -1.0f);
-            setAmplitude<<<objGridSize, blockSize>>>(complexWave, projection + rank * numAngles * projSize, numAngles * projSize);
+            scaleExpData<<<objGridSize, blockSize>>>(projection, numAngles * projSize, -1.0f);
+            setAmplitude<<<objGridSize, blockSize>>>(complexWave, projection, numAngles * projSize);
 
             // beta part of the objects' index of refraction
-            computePhase<<<objGridSize, blockSize>>>(complexWave, projection + rank * numAngles * projSize, numAngles * projSize);
-            absData<<<objGridSize, blockSize>>>(projection + rank * numAngles * projSize, numAngles * projSize);
-            std::cout << "\t" << n << ": ART (1000 iterations)" << std::endl;
-            reprojectART(*grid, projection, totalAngles, numStreams, angles, 1000, comm);
+            computePhase<<<objGridSize, blockSize>>>(complexWave, projection, numAngles * projSize);
+            absData<<<objGridSize, blockSize>>>(projection, numAngles * projSize);
+            if (rank == 0)
+                std::cout << "\t" << n << ": ART (" << options.iterations << " iterations, "
+                          << options.numSubsets << " subsets)" << std::endl;
+            reprojectART(*grid, exchange, projection, slabProjection, numStreams, angles, options, matrixPtr);
             // set phase to the wave fields
-            scaleFloatData<<<objGridSize, blockSize>>>(projection + rank * numAngles * projSize, numAngles * projSize, -1.0f);
-            setPhaseAmp1<<<objGridSize, blockSize>>>(complexWave, projection + rank * numAngles * projSize, numAngles * projSize);
+            scaleFloatData<<<objGridSize, blockSize>>>(projection, numAngles * projSize, -1.0f);
+            setPhaseAmp1<<<objGridSize, blockSize>>>(complexWave, projection, numAngles * projSize);
 
             // propagate the wave fields to detector plane
             for (int i = 0; i < numAngles; i++) {
@@ -338,23 +665,31 @@ void reprojectART(Grid &grid, float *projects, int totalAngles, int numStreams,
             if (rank == 0) {
                 error = std::sqrt(total_error / (totalAngles * numImages * projSize));
                 std::cout << "\t" << n << ": Error: " << error << " (Delta Error: " << last_error - error << ")" << std::endl;
+                // A stalled error asks for more ART passes, it has converged once they reach the limit
                 if (n != 0 && last_error - error < epsilon) {
-                    iteration *= 2;
+                    if (schedule[0] * 2 > maxARTIterations) {
+                        schedule[1] = 1;
+                        std::cout << "\t" << n << ": Converged with " << schedule[0] << " ART iterations" << std::endl;
+                    } else {
+                        schedule[0] *= 2;
+                    }
                 }
                 last_error = error;
             }
-            // 将rank 0的iteration广播到所有进程
-            MPI_Bcast(&iteration, 1, MPI_INT, 0, comm);
+            // 将rank 0的调度广播到所有进程
+            {
+                TRACE_SCOPE("schedule broadcast", "mpi");
+                MPI_Bcast(schedule, 2, MPI_INT, 0, comm);
+            }
 
             // magnitude constraint
             setAmplitude<<<decGridSize, blockSize>>>(propedComplexWave, d_holograms, numAngles * numImages * projSize);
         }
 
-        FArray result(grid->getSize());
-        cudaMemcpy(result.data(), grid->getValues(), grid->getSize() * sizeof(float), cudaMemcpyDeviceToHost);
+        FArray result = exchange.gatherGrid(*grid);
 
-        delete[] angles; delete grid;
-        cudaFree(complexWave); cudaFree(projection);
+        delete grid;
+        cudaFree(complexWave); cudaFree(projection); cudaFree(slabProjection);
         cudaFree(squared_error); cudaFree(propedComplexWave); cudaFree(d_holograms);
 
         return result;
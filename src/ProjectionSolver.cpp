@@ -1,12 +1,13 @@
 #include <iostream>
 #include "ProjectionSolver.h"
+#include "trace_utils.h"
 
 const float ProjectionSolver::terminateThreshold = -7.2;
 const int ProjectionSolver::terminateIterations = 100;
 
 ProjectionSolver::ProjectionSolver(Projector *PM, Projector *PS, const WaveField &initialPsi, Algorithm algo, const FArray &algoParameters,
                                    bool calError): projMagnitude(PM), projObject(PS), algorithm(algo), parameters(algoParameters),
-                                   psi(initialPsi), calculateError(calError), oldPsi(initialPsi)
+                                   psi(initialPsi), calculateError(calError), oldPsi(initialPsi), observeInterval(1)
 {    
     // Map holographic algorithm to corresponding update method
     std::unordered_map<Algorithm, Method> methodMap {{AP, &ProjectionSolver::updateStepAP}, {RAAR, &ProjectionSolver::updateStepRAAR}, 
@@ -30,7 +31,7 @@ ProjectionSolver::ProjectionSolver(Projector *PM, Projector *PS, const WaveField
 
 ProjectionSolver::ProjectionSolver(Projector *PM, Projector *PS, const WaveField &initialPsi, const WaveField &initialProbe,
                                    bool calError): projMagnitude(PM), projObject(PS), algorithm(APWP), psi(initialPsi),
-                                   probe(initialProbe), calculateError(calError), oldPsi(initialPsi)
+                                   probe(initialProbe), calculateError(calError), oldPsi(initialPsi), observeInterval(1)
 {
     update = &ProjectionSolver::updateStepAPWP;
     currentIteration = 1;
@@ -41,6 +42,15 @@ ProjectionSolver::ProjectionSolver(Projector *PM, Projector *PS, const WaveField
         residual = F2DArray(2, FArray());
 }
 
+void ProjectionSolver::setObserver(const Observer &iterationObserver, int interval)
+{
+    if (interval <= 0) {
+        throw std::invalid_argument("Observer interval must be positive!");
+    }
+    observer = iterationObserver;
+    observeInterval = interval;
+}
+
 IterationResult ProjectionSolver::execute(int iterations)
 {   
     /* error measurements
@@ -55,6 +65,7 @@ IterationResult ProjectionSolver::execute(int iterations)
     {   
         // std::cout << "Iteration " << currentIteration << std::endl;
         /* iterate */
+        TRACE_SCOPE("iteration", "solver");
         update(this);
 
         /* Calculate Step error*/
@@ -62,6 +73,14 @@ IterationResult ProjectionSolver::execute(int iterations)
             setResidual(0, CUDAUtils::computeL2Norm(psi.getComplexWave(), oldPsi.getComplexWave(), psi.getSize()));
         }
 
+        if (observer && currentIteration % observeInterval == 0) {
+            float stepError = calculateError ? residual[0][currentIteration - 1] : FloatInf;
+            float magnitudeError = calculateError ? residual[1][currentIteration - 1] : FloatInf;
+            if (!observer({currentIteration, iterations, stepError, magnitudeError, psi})) {
+                isConverged = true;
+            }
+        }
+
         // /* test if iteration is converged */
         // if (calculateStep && (currentIteration > 10 * terminateIterations))
         // {
@@ -99,6 +118,16 @@ IterationResult ProjectionSolver::execute(int iterations)
     if (calculateError) {
         setResidual(1, magnitudeResult.residual);
         setResidual(0, CUDAUtils::computeL2Norm(psi.getComplexWave(), oldPsi.getComplexWave(), psi.getSize()));
+        // Errors of iterations skipped by an observer are dropped
+        residual[0].resize(currentIteration);
+        residual[1].resize(currentIteration);
+    }
+
+    // The final projection is observed regardless of the interval, its return value has nothing left to stop
+    if (observer) {
+        float stepError = calculateError ? residual[0][currentIteration - 1] : FloatInf;
+        float magnitudeError = calculateError ? residual[1][currentIteration - 1] : FloatInf;
+        observer({currentIteration, iterations, stepError, magnitudeError, psi});
     }
     
     return {psi, probe, residual};
@@ -1,4 +1,5 @@
 #include "Projector.h"
+#include "trace_utils.h"
 
 // An empty implementation because of the actual call of derived class
 Projection Projector::project(const WaveField& waveField)
@@ -29,6 +30,7 @@ Reflection Projector::reflect(const WaveField& psi)
 
 Projection PAmplitudeCons::project(const WaveField& psi)
 {
+    TRACE_GPU_SCOPE("PAmplitudeCons", "projector");
     if (maxAmplitude < minAmplitude) {
         throw std::invalid_argument("maxAmplitude can not be less than minAmplitude");
     }
@@ -41,6 +43,7 @@ Projection PAmplitudeCons::project(const WaveField& psi)
     
     int rows = psi.getRows();
     int cols = psi.getColumns();
+    float *targetAmplitude;
     cudaMalloc(&targetAmplitude, rows * cols * sizeof(float));
 
     int blockSize = 1024;
@@ -67,6 +70,7 @@ ProbeProjection PAmplitudeCons::project(const WaveField& psi, const WaveField &p
 
 Projection PPhaseCons::project(const WaveField& psi)
 {
+    TRACE_GPU_SCOPE("PPhaseCons", "projector");
     if (maxPhase < minPhase) {
         throw std::invalid_argument("maxPhase can not be less than minPhase");
     }
@@ -79,6 +83,7 @@ Projection PPhaseCons::project(const WaveField& psi)
     
     int rows = psi.getRows();
     int cols = psi.getColumns();
+    float *targetPhase;
     cudaMalloc(&targetPhase, rows * cols * sizeof(float));
 
     int blockSize = 1024;
@@ -109,6 +114,7 @@ PSupportCons::PSupportCons(const float *supp, int size, float outValue):
 
 Projection PSupportCons::project(const WaveField& psi)
 {
+    TRACE_GPU_SCOPE("PSupportCons", "projector");
     float residual = FloatInf;
 
     if (!support)
@@ -139,6 +145,7 @@ PSupportCons::~PSupportCons()
 
 Projection MultiObjectCons::project(const WaveField& psi)
 {
+    TRACE_GPU_SCOPE("MultiObjectCons", "projector");
     Projection phaConsResult = pPhaCons->project(psi);
     Projection ampConsResult = pAmpCons->project(phaConsResult.projection);
     Projection suppConsResult = pSuppCons->project(ampConsResult.projection);
@@ -151,11 +158,10 @@ ProbeProjection MultiObjectCons::project(const WaveField& psi, const WaveField &
     return {psi, probeField, FloatInf};
 }
 
-int PMagnitudeCons::currentIteration = 0;
-
 PMagnitudeCons::PMagnitudeCons(const float *measuredGrams, int numimages, const IntArray &imsize, const std::vector<PropagatorPtr> &props,
                                Type projectionType, bool calcError): measurements(measuredGrams), numImages(numimages), imSize(imsize),
-                               propagators(props), type(projectionType), calculateError(calcError), p_measurements(nullptr), croppedAmp(nullptr)
+                               propagators(props), type(projectionType), calculateError(calcError), p_measurements(nullptr), croppedAmp(nullptr),
+                               currentIteration(0)
 {   
     // Check projection type and set batch size
     if (type == Averaged) {
@@ -183,7 +189,7 @@ PMagnitudeCons::PMagnitudeCons(const float *measuredGrams, int numimages, const
 PMagnitudeCons::PMagnitudeCons(const float *measuredGrams, const float *p_measuredGrams, int numimages, const IntArray &imsize, 
                                const std::vector<PropagatorPtr> &props, Type projectionType, bool calcError): measurements(measuredGrams),
                                imSize(imsize), p_measurements(p_measuredGrams), numImages(numimages), propagators(props), type(projectionType),
-                               calculateError(calcError), croppedAmp(nullptr)
+                               calculateError(calcError), croppedAmp(nullptr), currentIteration(0)
 {
     if (type != Averaged) {
         throw std::invalid_argument("Invalid projection computing method!");
@@ -204,7 +210,7 @@ PMagnitudeCons::PMagnitudeCons(const float *measuredGrams, const float *p_measur
 PMagnitudeCons::PMagnitudeCons(const float *measuredGrams, int numimages, const IntArray &meassize, const std::vector<PropagatorPtr> &props,
                                const IntArray &imsize, Type projectionType, bool calcError): measurements(measuredGrams), numImages(numimages), 
                                imSize(imsize), propagators(props), type(projectionType), calculateError(calcError), measSize(meassize),
-                               p_measurements(nullptr), croppedAmp(nullptr)
+                               p_measurements(nullptr), croppedAmp(nullptr), currentIteration(0)
 {
     if (type != Averaged) {
         throw std::invalid_argument("Invalid projection computing method!");
@@ -326,6 +332,7 @@ void PMagnitudeCons::projCyclic()
 
 Projection PMagnitudeCons::project(const WaveField &waveField)
 {   
+    TRACE_GPU_SCOPE("PMagnitudeCons", "projector");
     waveField.getComplexWave(complexWave);
     calculate(this);
     currentIteration++;
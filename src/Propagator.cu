@@ -1,10 +1,13 @@
 #include "Propagator.h"
+#include "trace_utils.h"
 
 Propagator::Propagator(const IntArray &imsize, const F2DArray &fresnelnumbers, CUDAPropKernel::Type type): imSize(imsize),
                        fresnelNumbers(fresnelnumbers), fftUtils(imsize[0], imsize[1], fresnelnumbers.size())
 {
     numImages = fresnelNumbers.size();
-    cudaMalloc(&propKernels, numImages * imSize[0] * imSize[1] * sizeof(cuFloatComplex));
+    if (cudaMalloc(&propKernels, numImages * imSize[0] * imSize[1] * sizeof(cuFloatComplex)) != cudaSuccess) {
+        throw std::runtime_error("Out of device memory for the propagation kernels!");
+    }
 
     // Create CUDA streams for each propagation kernel
     std::vector<cudaStream_t> streams(numImages);
@@ -25,6 +28,7 @@ Propagator::Propagator(const IntArray &imsize, const F2DArray &fresnelnumbers, C
 
 void Propagator::propagate(cuFloatComplex *complexWave, cuFloatComplex *propagatedWave)
 {       
+    TRACE_GPU_SCOPE("propagate", "propagation");
     // imProp = obj.iFT(obj.propKernel .* fftn(imProp));
     fftUtils.fft_fwd(complexWave);
 
@@ -38,6 +42,7 @@ void Propagator::propagate(cuFloatComplex *complexWave, cuFloatComplex *propagat
 
 void Propagator::backPropagate(cuFloatComplex *propagatedWave, cuFloatComplex *complexWave)
 {       
+    TRACE_GPU_SCOPE("backPropagate", "propagation");
     // imBack = conj(obj.propKernel) .* obj.FT(imBack)
     fftUtils.fft_fwd_batch(propagatedWave);
 
@@ -0,0 +1,126 @@
+#include <iostream>
+#include <stdexcept>
+#include "StreamingTomography.h"
+
+StreamingTomography::StreamingTomography(int cols, int zstart, int zend, const FArray &allAngles, int numthreads,
+                                         int maxqueued): nx(cols), zStart(zstart), zEnd(zend), angles(allAngles),
+                                         numThreads(numthreads), processed(0), finished(false)
+{
+    if (nx <= 0 || zStart < 0 || zEnd < zStart) {
+        throw std::invalid_argument("Invalid size or slice range of the tomography!");
+    }
+    if (angles.empty() || maxqueued <= 0) {
+        throw std::invalid_argument("Angles and queue length must not be empty!");
+    }
+
+    maxQueued = static_cast<size_t>(maxqueued);
+    weights = ARTUtils::angularWeights(angles);
+    grid.assign(static_cast<size_t>(nx) * nx * getDepth(), 0.0f);
+    worker = std::thread(&StreamingTomography::workerLoop, this);
+}
+
+void StreamingTomography::addProjection(int angle, const float *rows)
+{
+    if (angle < 0 || angle >= static_cast<int>(angles.size())) {
+        throw std::invalid_argument("Invalid angle index of the projection!");
+    }
+
+    Projection projection {angle, FArray(rows, rows + static_cast<size_t>(getDepth()) * nx)};
+    std::unique_lock<std::mutex> lock(mutex);
+    if (finished) {
+        throw std::runtime_error("Cannot add projections after the tomography is finished!");
+    }
+    queueChanged.wait(lock, [this] { return error || queue.size() < maxQueued; });
+    if (error)
+        std::rethrow_exception(error);
+    queue.push_back(std::move(projection));
+    queueChanged.notify_all();
+}
+
+void StreamingTomography::workerLoop()
+{
+    FArray project(static_cast<size_t>(nx) * getDepth());
+    while (true) {
+        Projection projection;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            queueChanged.wait(lock, [this] { return finished || !queue.empty(); });
+            if (queue.empty())
+                return;
+
+            projection = std::move(queue.front());
+            queue.pop_front();
+        }
+        queueChanged.notify_all();
+
+        // An exception must not escape the thread, it is handed to the next addProjection or finish
+        try {
+            backProject(projection, project);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            error = std::current_exception();
+            queue.clear();
+            queueChanged.notify_all();
+            return;
+        }
+        processed++;
+    }
+}
+
+void StreamingTomography::backProject(const Projection &projection, FArray &project)
+{
+    // Phase map rows [z][x] to the projection layout [x][z] of the slab-parallel projectors
+    int depth = getDepth();
+    FArray transposed(project.size());
+    for (int z = 0; z < depth; z++) {
+        for (int x = 0; x < nx; x++) {
+            transposed[x * depth + z] = projection.rows[z * nx + x];
+        }
+    }
+
+    float phi = angles[projection.angle];
+    float weight = weights[projection.angle];
+    ARTUtils::parallelSlabs(depth, numThreads, [&](int zFirst, int zLast) {
+        ARTUtils::rampFilter(transposed.data(), project.data(), nx, depth, weight, zFirst, zLast);
+        ARTUtils::gridBackProject(grid.data(), project.data(), nx, nx, depth, phi, zFirst, zLast);
+    });
+}
+
+FArray StreamingTomography::finish()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        finished = true;
+    }
+    queueChanged.notify_all();
+    if (worker.joinable())
+        worker.join();
+    if (error)
+        std::rethrow_exception(error);
+
+    if (processed != static_cast<int>(angles.size())) {
+        std::cerr << "Warning: " << processed << " of " << angles.size() << " projections back projected" << std::endl;
+    }
+
+    // Grid layout (y * nx + x) * depth + z to slices [z][y][x]
+    int depth = getDepth();
+    FArray slices(grid.size());
+    for (size_t c = 0; c < static_cast<size_t>(nx) * nx; c++) {
+        for (int z = 0; z < depth; z++) {
+            slices[z * static_cast<size_t>(nx) * nx + c] = grid[c * depth + z];
+        }
+    }
+
+    return slices;
+}
+
+StreamingTomography::~StreamingTomography()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        finished = true;
+    }
+    queueChanged.notify_all();
+    if (worker.joinable())
+        worker.join();
+}
@@ -0,0 +1,118 @@
+#include <stdexcept>
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(int numThreads): queuedTasks(0), pendingTasks(0), nextQueue(0), stopping(false)
+{
+    if (numThreads <= 0) {
+        throw std::invalid_argument("The number of threads must be positive!");
+    }
+
+    for (int i = 0; i < numThreads; i++) {
+        queues.push_back(std::make_unique<TaskQueue>());
+    }
+    for (int i = 0; i < numThreads; i++) {
+        workers.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+void ThreadPool::submit(Task task)
+{
+    // Tasks are dealt round-robin, idle workers steal the rest. The task is counted before it is published,
+    // otherwise a worker could take it and decrement the counters first
+    size_t index;
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        index = nextQueue++ % queues.size();
+        queuedTasks++;
+        pendingTasks++;
+    }
+    {
+        std::lock_guard<std::mutex> lock(queues[index]->mutex);
+        queues[index]->tasks.push_back(std::move(task));
+    }
+    taskAvailable.notify_one();
+}
+
+bool ThreadPool::popTask(int index, Task &task)
+{
+    TaskQueue &queue = *queues[index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty())
+        return false;
+
+    task = std::move(queue.tasks.back());
+    queue.tasks.pop_back();
+    return true;
+}
+
+bool ThreadPool::stealTask(int index, Task &task)
+{
+    int numQueues = static_cast<int>(queues.size());
+    for (int i = 1; i < numQueues; i++) {
+        TaskQueue &victim = *queues[(index + i) % numQueues];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::workerLoop(int index)
+{
+    while (true) {
+        Task task;
+        if (popTask(index, task) || stealTask(index, task)) {
+            {
+                std::lock_guard<std::mutex> lock(stateMutex);
+                queuedTasks--;
+            }
+
+            try {
+                task(index);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(stateMutex);
+                if (!firstError)
+                    firstError = std::current_exception();
+            }
+
+            std::lock_guard<std::mutex> lock(stateMutex);
+            if (--pendingTasks == 0)
+                tasksFinished.notify_all();
+            continue;
+        }
+
+        // Another worker may have taken the task counted in queuedTasks, then simply retry
+        std::unique_lock<std::mutex> lock(stateMutex);
+        taskAvailable.wait(lock, [this] {return stopping || queuedTasks > 0;});
+        if (stopping && queuedTasks == 0)
+            return;
+    }
+}
+
+void ThreadPool::wait()
+{
+    std::unique_lock<std::mutex> lock(stateMutex);
+    tasksFinished.wait(lock, [this] {return pendingTasks == 0;});
+
+    if (firstError) {
+        std::exception_ptr error = firstError;
+        firstError = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        stopping = true;
+    }
+    taskAvailable.notify_all();
+
+    for (auto &worker: workers) {
+        worker.join();
+    }
+}
@@ -0,0 +1,219 @@
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <algorithm>
+#include "TiledReconstructor.h"
+
+namespace PhaseRetrieval
+{
+    TiledReconstructor::TiledReconstructor(const IntArray &imsize, int images, const F2DArray &fresnelNumbers, const IntArray &tileSize,
+                                           int batch, int blendWidth, float numZones): imSize(imsize), numImages(images), tileBatch(batch)
+    {
+        if (imSize.size() != 2 || tileSize.size() != 2) {
+            throw std::invalid_argument("Image and tile sizes must be 2-dimensional!");
+        }
+        if (tileSize[0] <= 0 || tileSize[1] <= 0 || tileBatch <= 0) {
+            throw std::invalid_argument("Tile size and tile batch must be positive!");
+        }
+        if (fresnelNumbers.size() != static_cast<size_t>(numImages)) {
+            throw std::invalid_argument("The number of images and fresnel numbers does not match!");
+        }
+
+        guard = guardBand(fresnelNumbers, numZones);
+        IntArray coreSize {std::min(tileSize[0], imSize[0]), std::min(tileSize[1], imSize[1])};
+        windowSize = {std::min(coreSize[0] + 2 * guard, imSize[0]), std::min(coreSize[1] + 2 * guard, imSize[1])};
+
+        // The blending ramp reaches half of its width into the guard band and into the core
+        int maxBlend = std::min(2 * guard, std::min(coreSize[0], coreSize[1]));
+        blend = blendWidth < 0 ? std::min(guard, maxBlend) : std::min(blendWidth, maxBlend);
+
+        // Cores partition the image, windows are shifted inwards at the borders to keep a uniform size
+        for (int r = 0; r < imSize[0]; r += coreSize[0]) {
+            for (int c = 0; c < imSize[1]; c += coreSize[1]) {
+                Tile tile;
+                tile.coreRow = r;
+                tile.coreCol = c;
+                tile.coreRows = std::min(coreSize[0], imSize[0] - r);
+                tile.coreCols = std::min(coreSize[1], imSize[1] - c);
+                tile.row = std::max(0, std::min(r - guard, imSize[0] - windowSize[0]));
+                tile.col = std::max(0, std::min(c - guard, imSize[1] - windowSize[1]));
+                tiles.push_back(tile);
+            }
+        }
+    }
+
+    int TiledReconstructor::guardBand(const F2DArray &fresnelNumbers, float numZones)
+    {
+        // Fresnel numbers are given in pixel units, the k-th zero of the CTF at frequency 2*pi*sqrt(k*F)
+        // is shifted laterally by sqrt(k/F) pixels, the Nyquist frequency by 1/(2F) pixels
+        float minFresnel = std::numeric_limits<float>::max();
+        for (const auto &fNumber: fresnelNumbers) {
+            for (const auto &value: fNumber) {
+                minFresnel = std::min(minFresnel, std::abs(value));
+            }
+        }
+        if (!(minFresnel > 0.0f) || minFresnel == std::numeric_limits<float>::max()) {
+            throw std::invalid_argument("Invalid Fresnel number!");
+        }
+
+        float band = std::min(std::sqrt(numZones / minFresnel), 0.5f / minFresnel);
+        return static_cast<int>(std::ceil(band));
+    }
+
+    float TiledReconstructor::edgeWeight(int pos, int coreStart, int coreEnd, int imageEnd) const
+    {
+        float center = pos + 0.5f;
+        if (blend <= 0) {
+            return (center > coreStart && center < coreEnd) ? 1.0f : 0.0f;
+        }
+
+        // Raised sine ramp across each inner core boundary, neighbouring ramps sum to one
+        auto ramp = [this](float t) {
+            t /= blend;
+            if (t <= -0.5f) return 0.0f;
+            if (t >= 0.5f) return 1.0f;
+            return 0.5f * (1.0f + std::sin(static_cast<float>(M_PI) * t));
+        };
+
+        float weight = 1.0f;
+        if (coreStart > 0) {
+            weight *= ramp(center - coreStart);
+        } else if (center < coreStart) {
+            weight = 0.0f;
+        }
+        if (coreEnd < imageEnd) {
+            weight *= ramp(coreEnd - center);
+        } else if (center > coreEnd) {
+            weight = 0.0f;
+        }
+
+        return weight;
+    }
+
+    void TiledReconstructor::blendTile(const Tile &tile, const float *phase, FArray &result, FArray &weights) const
+    {
+        FArray rowWeights(windowSize[0]), colWeights(windowSize[1]);
+        for (int r = 0; r < windowSize[0]; r++) {
+            rowWeights[r] = edgeWeight(tile.row + r, tile.coreRow, tile.coreRow + tile.coreRows, imSize[0]);
+        }
+        for (int c = 0; c < windowSize[1]; c++) {
+            colWeights[c] = edgeWeight(tile.col + c, tile.coreCol, tile.coreCol + tile.coreCols, imSize[1]);
+        }
+
+        for (int r = 0; r < windowSize[0]; r++) {
+            if (rowWeights[r] == 0.0f)
+                continue;
+            size_t offset = static_cast<size_t>(tile.row + r) * imSize[1] + tile.col;
+            for (int c = 0; c < windowSize[1]; c++) {
+                float w = rowWeights[r] * colWeights[c];
+                result[offset + c] += w * phase[r * windowSize[1] + c];
+                weights[offset + c] += w;
+            }
+        }
+    }
+
+    float TiledReconstructor::tileOffset(const Tile &tile, const float *phase, const FArray &result, const FArray &weights) const
+    {
+        // Mean difference to the tiles blended so far over the part of the window they already cover
+        double difference = 0.0, total = 0.0;
+        for (int r = 0; r < windowSize[0]; r++) {
+            size_t offset = static_cast<size_t>(tile.row + r) * imSize[1] + tile.col;
+            for (int c = 0; c < windowSize[1]; c++) {
+                float w = weights[offset + c];
+                if (w > 0.0f) {
+                    difference += w * phase[r * windowSize[1] + c] - result[offset + c];
+                    total += w;
+                }
+            }
+        }
+
+        return total > 0.0 ? static_cast<float>(difference / total) : 0.0f;
+    }
+
+    FArray TiledReconstructor::blendWeights() const
+    {
+        FArray ones(static_cast<size_t>(windowSize[0]) * windowSize[1], 1.0f);
+        FArray result(static_cast<size_t>(imSize[0]) * imSize[1], 0.0f);
+        FArray weights(result.size(), 0.0f);
+        for (const auto &tile: tiles) {
+            blendTile(tile, ones.data(), result, weights);
+        }
+
+        return weights;
+    }
+
+    FArray TiledReconstructor::reconstruct(const FArray &holograms, const FArray &initialPhase, const BatchMethod &method) const
+    {
+        if (holograms.size() != static_cast<size_t>(numImages) * imSize[0] * imSize[1]) {
+            throw std::invalid_argument("The size of holograms does not match the image size!");
+        }
+
+        TileReader reader = [&](const Tile &tile, float *window) {
+            for (int i = 0; i < numImages; i++) {
+                for (int r = 0; r < windowSize[0]; r++) {
+                    const float *src = holograms.data() + (static_cast<size_t>(i) * imSize[0] + tile.row + r) * imSize[1] + tile.col;
+                    std::memcpy(window + (i * windowSize[0] + r) * windowSize[1], src, windowSize[1] * sizeof(float));
+                }
+            }
+        };
+
+        return reconstruct(reader, initialPhase, method);
+    }
+
+    FArray TiledReconstructor::reconstruct(const TileReader &reader, const FArray &initialPhase, const BatchMethod &method) const
+    {
+        if (!initialPhase.empty() && initialPhase.size() != static_cast<size_t>(imSize[0]) * imSize[1]) {
+            throw std::invalid_argument("The sizes of guess phase and wave field do not match!");
+        }
+
+        int windowNumel = windowSize[0] * windowSize[1];
+        FArray windows(static_cast<size_t>(tileBatch) * numImages * windowNumel);
+        FArray phaseWindows;
+        if (!initialPhase.empty()) {
+            phaseWindows.resize(static_cast<size_t>(tileBatch) * windowNumel);
+        }
+
+        FArray result(static_cast<size_t>(imSize[0]) * imSize[1], 0.0f);
+        FArray weights(result.size(), 0.0f);
+
+        for (size_t first = 0; first < tiles.size(); first += tileBatch) {
+            int count = static_cast<int>(std::min(tiles.size() - first, static_cast<size_t>(tileBatch)));
+            for (int t = 0; t < tileBatch; t++) {
+                // The last batch is filled up with its final tile, the duplicates are not blended
+                const Tile &tile = tiles[first + std::min(t, count - 1)];
+                reader(tile, windows.data() + static_cast<size_t>(t) * numImages * windowNumel);
+
+                if (!phaseWindows.empty()) {
+                    for (int r = 0; r < windowSize[0]; r++) {
+                        std::memcpy(phaseWindows.data() + static_cast<size_t>(t) * windowNumel + r * windowSize[1],
+                                    initialPhase.data() + static_cast<size_t>(tile.row + r) * imSize[1] + tile.col,
+                                    windowSize[1] * sizeof(float));
+                    }
+                }
+            }
+
+            FArray phases = method(windows, phaseWindows);
+            if (phases.size() != static_cast<size_t>(tileBatch) * windowNumel) {
+                throw std::runtime_error("The reconstructed tiles do not match the window size!");
+            }
+
+            for (int t = 0; t < count; t++) {
+                float *phase = phases.data() + static_cast<size_t>(t) * windowNumel;
+                float offset = tileOffset(tiles[first + t], phase, result, weights);
+                for (int i = 0; i < windowNumel; i++) {
+                    phase[i] -= offset;
+                }
+                blendTile(tiles[first + t], phase, result, weights);
+            }
+        }
+
+        for (size_t i = 0; i < result.size(); i++) {
+            if (weights[i] > 0.0f) {
+                result[i] /= weights[i];
+            }
+        }
+
+        return result;
+    }
+}
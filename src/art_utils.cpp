@@ -0,0 +1,563 @@
+#include <cmath>
+#include <limits>
+#include <thread>
+#include <stdexcept>
+#include <algorithm>
+#include "art_utils.h"
+
+namespace
+{
+    // Footprint of a voxel on the detector, identical to the setup of the CUDA kernels
+    struct Footprint
+    {
+        float a, b, h;
+        float cosp, sinp;
+        float border;
+    };
+
+    Footprint footprint(float phi, int nx)
+    {
+        const float pi = static_cast<float>(M_PI);
+        float phiAdjusted = phi;
+        while (phiAdjusted < 0) { phiAdjusted += 2 * pi; }
+        while (phiAdjusted > pi / 2) { phiAdjusted -= pi / 2; }
+        if (phiAdjusted > pi / 4) { phiAdjusted = pi / 2 - phiAdjusted; }
+
+        Footprint fp;
+        fp.a = std::sin(phiAdjusted + pi / 4) / std::sqrt(2.0f);
+        fp.b = std::cos(phiAdjusted + pi / 4) / std::sqrt(2.0f);
+        fp.h = 1.0f / (fp.a + fp.b);
+        fp.cosp = std::cos(phi);
+        fp.sinp = std::sin(phi);
+        fp.border = 0.5f * (nx - 1);
+        return fp;
+    }
+
+    float computeWeight(float a, float b, float h, float x)
+    {
+        if (x > b) {
+            if (x < a) {
+                return 1 - h * 0.5f / (a - b) * (a - x) * (a - x);
+            }
+            return 1;
+        } else {
+            if (x < -b) {
+                return h * 0.5f / (a - b) * (a + x) * (a + x);
+            }
+            return h * x + 0.5f;
+        }
+    }
+
+    /* Detector rows hit by the column (x, y) and their weights, rows outside the detector get
+       weight zero and point to row 0 so that the z loops need no branches */
+    bool columnWeights(const Footprint &fp, int x, int y, int nx, int rows[3], float weights[3])
+    {
+        float pos = (x - fp.border) * fp.cosp - (y - fp.border) * fp.sinp + 0.5f * nx;
+        if (!(pos > -fp.a && pos < nx + fp.a))
+            return false;
+
+        int lb = static_cast<int>(pos - fp.a);
+        weights[0] = computeWeight(fp.a, fp.b, fp.h, (lb + 1) - pos);
+        weights[1] = computeWeight(fp.a, fp.b, fp.h, (lb + 2) - pos) - weights[0];
+        weights[2] = 1 - weights[0] - weights[1];
+
+        for (int k = 0; k < 3; k++) {
+            rows[k] = lb + k;
+            if (rows[k] < 0 || rows[k] >= nx) {
+                rows[k] = 0;
+                weights[k] = 0.0f;
+            }
+        }
+        return true;
+    }
+
+    void fillSlab(float *data, size_t columns, int nz, int zStart, int zEnd, float value)
+    {
+        for (size_t c = 0; c < columns; c++) {
+            std::fill(data + c * nz + zStart, data + c * nz + zEnd, value);
+        }
+    }
+}
+
+IntArray ARTUtils::subsetOrder(int numSubsets, ARTOptions::Order order)
+{
+    IntArray visits;
+    if (order == ARTOptions::BitReversal) {
+        int bits = 0;
+        while ((1 << bits) < numSubsets) bits++;
+
+        for (int i = 0; i < (1 << bits); i++) {
+            int reversed = 0;
+            for (int b = 0; b < bits; b++) {
+                reversed |= ((i >> b) & 1) << (bits - 1 - b);
+            }
+            if (reversed < numSubsets)
+                visits.push_back(reversed);
+        }
+    } else if (order == ARTOptions::GoldenRatio || order == ARTOptions::MaxSpread) {
+        // Subset s starts at the phase s / numSubsets of the half circle of angles
+        std::vector<bool> used(numSubsets, false);
+        const double goldenRatio = 0.5 * (std::sqrt(5.0) - 1.0);
+        for (int k = 0; k < numSubsets; k++) {
+            int best = -1;
+            double bestScore = 0.0;
+            for (int s = 0; s < numSubsets; s++) {
+                if (used[s])
+                    continue;
+
+                double phase = static_cast<double>(s) / numSubsets;
+                double score;
+                if (order == ARTOptions::GoldenRatio) {
+                    // Nearest free subset to the golden-ratio sequence
+                    double target = k * goldenRatio - std::floor(k * goldenRatio);
+                    double distance = std::abs(phase - target);
+                    score = -std::min(distance, 1.0 - distance);
+                } else {
+                    // Free subset farthest from all visited ones
+                    int nearest = numSubsets;
+                    for (int v: visits) {
+                        int distance = std::abs(s - v);
+                        nearest = std::min(nearest, std::min(distance, numSubsets - distance));
+                    }
+                    score = nearest;
+                }
+                if (best < 0 || score > bestScore) {
+                    best = s;
+                    bestScore = score;
+                }
+            }
+            used[best] = true;
+            visits.push_back(best);
+        }
+    } else {
+        for (int s = 0; s < numSubsets; s++) {
+            visits.push_back(s);
+        }
+    }
+
+    return visits;
+}
+
+std::vector<IntArray> ARTUtils::orderedSubsets(const FArray &angles, int numSubsets, ARTOptions::Order order)
+{
+    int numAngles = static_cast<int>(angles.size());
+    if (numSubsets <= 0) {
+        throw std::invalid_argument("The number of subsets must be positive!");
+    }
+    numSubsets = std::min(numSubsets, numAngles);
+
+    // Angles are ranked by direction modulo pi, opposite directions carry the same information
+    const double pi = M_PI;
+    IntArray sorted(numAngles);
+    DArray directions(numAngles);
+    for (int i = 0; i < numAngles; i++) {
+        sorted[i] = i;
+        directions[i] = std::fmod(static_cast<double>(angles[i]), pi);
+        if (directions[i] < 0) directions[i] += pi;
+    }
+    std::stable_sort(sorted.begin(), sorted.end(), [&](int i, int j) { return directions[i] < directions[j]; });
+
+    // Subsets of angle indices
+    std::vector<IntArray> subsets(numSubsets);
+    for (int i = 0; i < numAngles; i++) {
+        if (order == ARTOptions::Sequential) {
+            subsets[static_cast<long>(i) * numSubsets / numAngles].push_back(sorted[i]);
+        } else {
+            subsets[i % numSubsets].push_back(sorted[i]);
+        }
+    }
+
+    std::vector<IntArray> ordered;
+    for (int s: subsetOrder(numSubsets, order)) {
+        ordered.push_back(subsets[s]);
+    }
+
+    return ordered;
+}
+
+void ARTUtils::parallelSlabs(int nz, int numThreads, const std::function<void(int, int)> &func)
+{
+    if (numThreads <= 0) {
+        numThreads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    }
+    numThreads = std::max(1, std::min(numThreads, nz));
+
+    if (numThreads == 1) {
+        func(0, nz);
+        return;
+    }
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < numThreads; t++) {
+        threads.emplace_back(func, t * nz / numThreads, (t + 1) * nz / numThreads);
+    }
+    for (auto &thread: threads) {
+        thread.join();
+    }
+}
+
+void ARTUtils::gridProject(const float *grid, float *project, int nx, int ny, int nz, float phi, int zStart, int zEnd)
+{
+    Footprint fp = footprint(phi, nx);
+    for (int x = 0; x < nx; x++) {
+        std::fill(project + x * nz + zStart, project + x * nz + zEnd, 0.0f);
+    }
+
+    int rows[3];
+    float weights[3];
+    for (int y = 0; y < ny; y++) {
+        for (int x = 0; x < nx; x++) {
+            if (!columnWeights(fp, x, y, nx, rows, weights))
+                continue;
+
+            const float *column = grid + (static_cast<size_t>(y) * nx + x) * nz;
+            for (int k = 0; k < 3; k++) {
+                float *row = project + rows[k] * nz;
+                float w = weights[k];
+                for (int z = zStart; z < zEnd; z++) {
+                    row[z] += w * column[z];
+                }
+            }
+        }
+    }
+}
+
+void ARTUtils::gridBackProject(float *grid, const float *project, int nx, int ny, int nz, float phi, int zStart, int zEnd)
+{
+    Footprint fp = footprint(phi, nx);
+
+    int rows[3];
+    float weights[3];
+    for (int y = 0; y < ny; y++) {
+        for (int x = 0; x < nx; x++) {
+            if (!columnWeights(fp, x, y, nx, rows, weights))
+                continue;
+
+            float *column = grid + (static_cast<size_t>(y) * nx + x) * nz;
+            const float *row0 = project + rows[0] * nz;
+            const float *row1 = project + rows[1] * nz;
+            const float *row2 = project + rows[2] * nz;
+            for (int z = zStart; z < zEnd; z++) {
+                column[z] += row0[z] * weights[0] + row1[z] * weights[1] + row2[z] * weights[2];
+            }
+        }
+    }
+}
+
+void ARTUtils::gridMaxMap(float *grid, const float *project, int nx, int ny, int nz, float phi, int zStart, int zEnd)
+{
+    Footprint fp = footprint(phi, nx);
+
+    int rows[3];
+    float weights[3];
+    for (int y = 0; y < ny; y++) {
+        for (int x = 0; x < nx; x++) {
+            if (!columnWeights(fp, x, y, nx, rows, weights))
+                continue;
+
+            float *column = grid + (static_cast<size_t>(y) * nx + x) * nz;
+            const float *row0 = project + rows[0] * nz;
+            const float *row1 = project + rows[1] * nz;
+            const float *row2 = project + rows[2] * nz;
+            for (int z = zStart; z < zEnd; z++) {
+                float tmp = row0[z] * weights[0] + row1[z] * weights[1] + row2[z] * weights[2];
+                column[z] = std::min(column[z], tmp);
+            }
+        }
+    }
+}
+
+void ARTUtils::gridProject(const float *grid, float *project, int nx, int ny, int nz, float phi, int numThreads)
+{
+    parallelSlabs(nz, numThreads, [&](int zStart, int zEnd) {
+        gridProject(grid, project, nx, ny, nz, phi, zStart, zEnd);
+    });
+}
+
+void ARTUtils::gridBackProject(float *grid, const float *project, int nx, int ny, int nz, float phi, int numThreads)
+{
+    parallelSlabs(nz, numThreads, [&](int zStart, int zEnd) {
+        gridBackProject(grid, project, nx, ny, nz, phi, zStart, zEnd);
+    });
+}
+
+void ARTUtils::gridMaxMap(float *grid, const float *project, int nx, int ny, int nz, float phi, int numThreads)
+{
+    parallelSlabs(nz, numThreads, [&](int zStart, int zEnd) {
+        gridMaxMap(grid, project, nx, ny, nz, phi, zStart, zEnd);
+    });
+}
+
+FArray ARTUtils::angularWeights(const FArray &angles)
+{
+    int numAngles = static_cast<int>(angles.size());
+    const double pi = M_PI;
+    FArray weights(numAngles, static_cast<float>(pi));
+    if (numAngles < 2)
+        return weights;
+
+    IntArray sorted(numAngles);
+    DArray directions(numAngles);
+    for (int i = 0; i < numAngles; i++) {
+        sorted[i] = i;
+        directions[i] = std::fmod(static_cast<double>(angles[i]), pi);
+        if (directions[i] < 0) directions[i] += pi;
+    }
+    std::stable_sort(sorted.begin(), sorted.end(), [&](int i, int j) { return directions[i] < directions[j]; });
+
+    // Each angle covers half of the gaps to its neighbours on the half circle
+    for (int k = 0; k < numAngles; k++) {
+        double prev = directions[sorted[(k + numAngles - 1) % numAngles]] - (k == 0 ? pi : 0.0);
+        double next = directions[sorted[(k + 1) % numAngles]] + (k == numAngles - 1 ? pi : 0.0);
+        weights[sorted[k]] = static_cast<float>(0.5 * (next - prev));
+    }
+
+    return weights;
+}
+
+void ARTUtils::rampFilter(const float *project, float *filtered, int nx, int nz, float scale, int zStart, int zEnd)
+{
+    // Spatial Ram-Lak kernel: 1/4 at zero, -1/(pi n)^2 at odd n and zero at even n
+    const float pi = static_cast<float>(M_PI);
+    for (int x = 0; x < nx; x++) {
+        float *out = filtered + x * nz;
+        const float *center = project + x * nz;
+        for (int z = zStart; z < zEnd; z++) {
+            out[z] = 0.25f * scale * center[z];
+        }
+        for (int k = (x % 2 == 0) ? 1 : 0; k < nx; k += 2) {
+            float h = -scale / (pi * pi * (x - k) * (x - k));
+            const float *row = project + k * nz;
+            for (int z = zStart; z < zEnd; z++) {
+                out[z] += h * row[z];
+            }
+        }
+    }
+}
+
+void ARTUtils::filteredBackProject(float *grid, const float *projects, int nx, int ny, int nz, const FArray &angles,
+                                   int zStart, int zEnd)
+{
+    size_t imSize = static_cast<size_t>(nx) * nz;
+    fillSlab(grid, static_cast<size_t>(nx) * ny, nz, zStart, zEnd, 0.0f);
+
+    FArray weights = angularWeights(angles);
+    FArray filtered(imSize);
+    for (size_t i = 0; i < angles.size(); i++) {
+        rampFilter(projects + i * imSize, filtered.data(), nx, nz, weights[i], zStart, zEnd);
+        gridBackProject(grid, filtered.data(), nx, ny, nz, angles[i], zStart, zEnd);
+    }
+}
+
+void ARTUtils::filteredBackProject(FArray &grid, const FArray &projects, int nx, int ny, int nz, const FArray &angles,
+                                   int numThreads)
+{
+    if (grid.size() != static_cast<size_t>(nx) * ny * nz || projects.size() != angles.size() * nx * nz) {
+        throw std::invalid_argument("The sizes of grid, projections and angles do not match!");
+    }
+
+    parallelSlabs(nz, numThreads, [&](int zStart, int zEnd) {
+        filteredBackProject(grid.data(), projects.data(), nx, ny, nz, angles, zStart, zEnd);
+    });
+}
+
+ARTUtils::SystemMatrix ARTUtils::buildSystemMatrix(int nx, int ny, const FArray &angles)
+{
+    size_t numRows = angles.size() * static_cast<size_t>(nx) * ny;
+    if (3 * numRows > static_cast<size_t>(std::numeric_limits<int>::max())) {
+        throw std::invalid_argument("The system matrix is too large, disable the matrix cache!");
+    }
+
+    struct Storage
+    {
+        IntArray rowOffsets;
+        IntArray columns;
+        FArray weights;
+    };
+    auto storage = std::make_shared<Storage>();
+    storage->rowOffsets.reserve(numRows + 1);
+    storage->columns.reserve(3 * numRows);
+    storage->weights.reserve(3 * numRows);
+    storage->rowOffsets.push_back(0);
+
+    int rows[3];
+    float weights[3];
+    for (float phi: angles) {
+        Footprint fp = footprint(phi, nx);
+        for (int y = 0; y < ny; y++) {
+            for (int x = 0; x < nx; x++) {
+                if (columnWeights(fp, x, y, nx, rows, weights)) {
+                    storage->columns.insert(storage->columns.end(), rows, rows + 3);
+                    storage->weights.insert(storage->weights.end(), weights, weights + 3);
+                }
+                storage->rowOffsets.push_back(static_cast<int>(storage->columns.size()));
+            }
+        }
+    }
+
+    SystemMatrix matrix;
+    matrix.nx = nx;
+    matrix.ny = ny;
+    matrix.numAngles = static_cast<int>(angles.size());
+    matrix.numEntries = storage->columns.size();
+    matrix.rowOffsets = storage->rowOffsets.data();
+    matrix.columns = storage->columns.data();
+    matrix.weights = storage->weights.data();
+    matrix.storage = storage;
+    return matrix;
+}
+
+void ARTUtils::gridProject(const SystemMatrix &matrix, int angle, const float *grid, float *project, int nz, int zStart, int zEnd)
+{
+    for (int x = 0; x < matrix.nx; x++) {
+        std::fill(project + x * nz + zStart, project + x * nz + zEnd, 0.0f);
+    }
+
+    size_t first = static_cast<size_t>(angle) * matrix.nx * matrix.ny;
+    for (size_t c = 0; c < static_cast<size_t>(matrix.nx) * matrix.ny; c++) {
+        const float *column = grid + c * nz;
+        for (int e = matrix.rowOffsets[first + c]; e < matrix.rowOffsets[first + c + 1]; e++) {
+            float *row = project + matrix.columns[e] * nz;
+            float w = matrix.weights[e];
+            for (int z = zStart; z < zEnd; z++) {
+                row[z] += w * column[z];
+            }
+        }
+    }
+}
+
+void ARTUtils::gridBackProject(const SystemMatrix &matrix, int angle, float *grid, const float *project, int nz, int zStart, int zEnd)
+{
+    size_t first = static_cast<size_t>(angle) * matrix.nx * matrix.ny;
+    for (size_t c = 0; c < static_cast<size_t>(matrix.nx) * matrix.ny; c++) {
+        int e = matrix.rowOffsets[first + c];
+        if (e == matrix.rowOffsets[first + c + 1])
+            continue;
+
+        float *column = grid + c * nz;
+        const float *row0 = project + matrix.columns[e] * nz;
+        const float *row1 = project + matrix.columns[e + 1] * nz;
+        const float *row2 = project + matrix.columns[e + 2] * nz;
+        const float *weights = matrix.weights + e;
+        for (int z = zStart; z < zEnd; z++) {
+            column[z] += row0[z] * weights[0] + row1[z] * weights[1] + row2[z] * weights[2];
+        }
+    }
+}
+
+void ARTUtils::gridMaxMap(const SystemMatrix &matrix, int angle, float *grid, const float *project, int nz, int zStart, int zEnd)
+{
+    size_t first = static_cast<size_t>(angle) * matrix.nx * matrix.ny;
+    for (size_t c = 0; c < static_cast<size_t>(matrix.nx) * matrix.ny; c++) {
+        int e = matrix.rowOffsets[first + c];
+        if (e == matrix.rowOffsets[first + c + 1])
+            continue;
+
+        float *column = grid + c * nz;
+        const float *row0 = project + matrix.columns[e] * nz;
+        const float *row1 = project + matrix.columns[e + 1] * nz;
+        const float *row2 = project + matrix.columns[e + 2] * nz;
+        const float *weights = matrix.weights + e;
+        for (int z = zStart; z < zEnd; z++) {
+            float tmp = row0[z] * weights[0] + row1[z] * weights[1] + row2[z] * weights[2];
+            column[z] = std::min(column[z], tmp);
+        }
+    }
+}
+
+void ARTUtils::reprojectART(FArray &grid, FArray &projects, int nx, int ny, int nz, const FArray &angles,
+                            const ARTOptions &options, const SystemMatrix *matrix)
+{
+    int totalAngles = static_cast<int>(angles.size());
+    size_t imSize = static_cast<size_t>(nx) * nz;
+    size_t columns = static_cast<size_t>(nx) * ny;
+    if (grid.size() != columns * nz || projects.size() != totalAngles * imSize) {
+        throw std::invalid_argument("The sizes of grid, projections and angles do not match!");
+    }
+
+    std::vector<IntArray> subsets = orderedSubsets(angles, options.numSubsets, options.order);
+    size_t maxSubset = 0;
+    for (const auto &subset: subsets) {
+        maxSubset = std::max(maxSubset, subset.size());
+    }
+    FArray map(grid.size());
+    FArray tmpProjs(maxSubset * imSize);
+
+    SystemMatrix ownMatrix;
+    if (options.cacheMatrix && !matrix) {
+        ownMatrix = buildSystemMatrix(nx, ny, angles);
+        matrix = &ownMatrix;
+    }
+    if (matrix && (matrix->nx != nx || matrix->ny != ny || matrix->numAngles != totalAngles)) {
+        throw std::invalid_argument("The system matrix does not match the grid and angles!");
+    }
+
+    // Every thread runs the whole ART on its own slices, there is no synchronization between passes
+    parallelSlabs(nz, options.numThreads, [&](int zStart, int zEnd) {
+        auto project = [&](float *proj, int angle) {
+            if (matrix) gridProject(*matrix, angle, grid.data(), proj, nz, zStart, zEnd);
+            else gridProject(grid.data(), proj, nx, ny, nz, angles[angle], zStart, zEnd);
+        };
+        auto backProject = [&](float *target, const float *proj, int angle) {
+            if (matrix) gridBackProject(*matrix, angle, target, proj, nz, zStart, zEnd);
+            else gridBackProject(target, proj, nx, ny, nz, angles[angle], zStart, zEnd);
+        };
+
+        // Initial grid is the minimum over all angles of the smeared back projections
+        fillSlab(grid.data(), columns, nz, zStart, zEnd, 1e11f);
+        for (int i = 0; i < totalAngles; i++) {
+            if (matrix) gridMaxMap(*matrix, i, grid.data(), projects.data() + i * imSize, nz, zStart, zEnd);
+            else gridMaxMap(grid.data(), projects.data() + i * imSize, nx, ny, nz, angles[i], zStart, zEnd);
+        }
+        for (size_t c = 0; c < columns; c++) {
+            for (int z = zStart; z < zEnd; z++) {
+                if (grid[c * nz + z] > 0.99f * 1e11f)
+                    grid[c * nz + z] = 0.0f;
+            }
+        }
+
+        // The non-negative part of the filtered back projection replaces the max map where it is lower
+        if (options.init == ARTOptions::FilteredBackProjection) {
+            filteredBackProject(map.data(), projects.data(), nx, ny, nz, angles, zStart, zEnd);
+            for (size_t c = 0; c < columns; c++) {
+                for (int z = zStart; z < zEnd; z++) {
+                    grid[c * nz + z] = std::min(grid[c * nz + z], std::max(map[c * nz + z], 0.0f));
+                }
+            }
+        }
+
+        for (int k = 0; k < options.iterations; k++) {
+            for (const auto &subset: subsets) {
+                int subsetAngles = static_cast<int>(subset.size());
+                fillSlab(map.data(), columns, nz, zStart, zEnd, 0.0f);
+
+                // Correction ratios of the angles in this subset
+                for (int j = 0; j < subsetAngles; j++) {
+                    float *ratio = tmpProjs.data() + j * imSize;
+                    const float *measured = projects.data() + subset[j] * imSize;
+                    project(ratio, subset[j]);
+                    for (int x = 0; x < nx; x++) {
+                        for (int z = zStart; z < zEnd; z++) {
+                            float &value = ratio[x * nz + z];
+                            if (value != 0)
+                                value = measured[x * nz + z] / value;
+                        }
+                    }
+                }
+
+                for (int j = 0; j < subsetAngles; j++) {
+                    backProject(map.data(), tmpProjs.data() + j * imSize, subset[j]);
+                }
+                for (size_t c = 0; c < columns; c++) {
+                    for (int z = zStart; z < zEnd; z++) {
+                        grid[c * nz + z] *= map[c * nz + z] / subsetAngles;
+                    }
+                }
+            }
+        }
+
+        for (int i = 0; i < totalAngles; i++) {
+            project(projects.data() + i * imSize, i);
+        }
+    });
+}
@@ -1,16 +1,30 @@
 #include "cuda_utils.h"
 
-CUFFTUtils::CUFFTUtils(int in_numel): numel(in_numel)
+// Plans are created in the constructors, a failure there leaves no usable instance
+static void checkPlan(cufftResult status)
 {
-    cufftPlan1d(&plan, numel, CUFFT_C2C, 1);
+    if (status == CUFFT_ALLOC_FAILED) {
+        throw std::runtime_error("Out of device memory for the cuFFT plans, reduce the batch size or padding!");
+    } else if (status != CUFFT_SUCCESS) {
+        throw std::runtime_error("Failed to create cuFFT plan, error " + std::to_string(static_cast<int>(status)) + "!");
+    }
+}
+
+CUFFTUtils::CUFFTUtils(int in_numel): numel(in_numel), rows(0), cols(0), batchSize(1)
+{
+    checkPlan(cufftPlan1d(&plan, numel, CUFFT_C2C, 1));
 }
 
 CUFFTUtils::CUFFTUtils(int in_rows, int in_cols, int in_batchSize):
 rows(in_rows), cols(in_cols), batchSize(in_batchSize), numel(in_rows * in_cols)
 {
-    cufftPlan2d(&plan, cols, rows, CUFFT_C2C);
+    checkPlan(cufftPlan2d(&plan, cols, rows, CUFFT_C2C));
     int size[2] = {cols, rows};
-    cufftPlanMany(&plan_batch, 2, size, nullptr, 1, numel, nullptr, 1, numel, CUFFT_C2C, batchSize);
+    cufftResult status = cufftPlanMany(&plan_batch, 2, size, nullptr, 1, numel, nullptr, 1, numel, CUFFT_C2C, batchSize);
+    if (status != CUFFT_SUCCESS) {
+        cufftDestroy(plan);
+        checkPlan(status);
+    }
 }
 
 void CUFFTUtils::fft_fwd(cuFloatComplex *complexWave)
@@ -649,7 +663,7 @@ __global__ void grid_project_k(const float *grid, float *project, int nx, int nz
         float w1 = computeWeight(a, b, h, (++lb) - pos);
         float w2 = computeWeight(a, b, h, (++lb) - pos) - w1;
         float w3 = 1 - w1 - w2;
-        int index = lb * nz;
+        int index = lb * nz + (i % nz);
 
         // 使用原子操作确保线程安全
         atomicAdd(&project[index], grid[i] * w1);
@@ -677,7 +691,7 @@ __global__ void grid_back_project_k(float *grid, const float *project, int nx, i
         float w1 = computeWeight(a, b, h, (++lb) - pos);
         float w2 = computeWeight(a, b, h, (++lb) - pos) - w1;
         float w3 = 1 - w1 - w2;
-        int index = lb * nz;
+        int index = lb * nz + (i % nz);
 
         float tmp = project[index] * w1 +
                     project[index + nz] * w2 +
@@ -716,6 +730,51 @@ __global__ void grid_max_map_k(float *grid, const float *project, int nx, int nz
     }
 }
 
+// Same projectors with the weights read from the system matrix, projections have no padding rows
+__global__ void csr_project_k(const float *grid, float *project, const int *rowOffsets, const int *columns,
+                              const float *weights, int nz, int numel)
+{
+    int idx = blockIdx.x * blockDim.x + threadIdx.x;
+    if (idx >= numel) return;
+
+    int row = idx / nz;
+    for (int e = rowOffsets[row]; e < rowOffsets[row + 1]; e++) {
+        atomicAdd(&project[columns[e] * nz + idx % nz], grid[idx] * weights[e]);
+    }
+}
+
+__global__ void csr_back_project_k(float *grid, const float *project, const int *rowOffsets, const int *columns,
+                                   const float *weights, int nz, int numel)
+{
+    int idx = blockIdx.x * blockDim.x + threadIdx.x;
+    if (idx >= numel) return;
+
+    int row = idx / nz;
+    float tmp = 0.0f;
+    for (int e = rowOffsets[row]; e < rowOffsets[row + 1]; e++) {
+        tmp += project[columns[e] * nz + idx % nz] * weights[e];
+    }
+    grid[idx] += tmp;
+}
+
+__global__ void csr_max_map_k(float *grid, const float *project, const int *rowOffsets, const int *columns,
+                              const float *weights, int nz, int numel)
+{
+    int idx = blockIdx.x * blockDim.x + threadIdx.x;
+    if (idx >= numel) return;
+
+    int row = idx / nz;
+    if (rowOffsets[row] == rowOffsets[row + 1]) return;
+
+    float tmp = 0.0f;
+    for (int e = rowOffsets[row]; e < rowOffsets[row + 1]; e++) {
+        tmp += project[columns[e] * nz + idx % nz] * weights[e];
+    }
+    if (tmp < grid[idx]) {
+        grid[idx] = tmp;
+    }
+}
+
 __global__ void limitGrid(float *grid, float constraint, int numel)
 {
     int idx = blockIdx.x * blockDim.x + threadIdx.x;
@@ -726,11 +785,11 @@ __global__ void limitGrid(float *grid, float constraint, int numel)
     }
 }
 
-__global__ void updateGrid(float *grid, const float *newGrid, int totalAngles, int numel)
+__global__ void updateGrid(float *grid, const float *newGrid, int numAngles, int numel)
 {
     int idx = blockIdx.x * blockDim.x + threadIdx.x;
     if (idx < numel) {
-        grid[idx] *= newGrid[idx] / totalAngles;
+        grid[idx] *= newGrid[idx] / numAngles;
     }
 }
 
@@ -925,7 +984,9 @@ float* CUDAUtils::padInputData(float* inputData, const IntArray& imSize, const I
     
     float* paddedData;
     IntArray newSize {imSize[0] + 2 * padSize[0], imSize[1] + 2 * padSize[1]};
-    cudaMalloc((void**)&paddedData, newSize[0] * newSize[1] * sizeof(float));
+    if (cudaMalloc((void**)&paddedData, newSize[0] * newSize[1] * sizeof(float)) != cudaSuccess) {
+        throw std::runtime_error("Out of device memory for the padded data!");
+    }
     CUDAUtils::padMatrix(inputData, paddedData, imSize[0], imSize[1], padSize[0], padSize[1], padType, padValue);
         
     return paddedData;
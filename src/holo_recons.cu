@@ -1,9 +1,12 @@
 #include "holo_recons.h"
+#include "ThreadPool.h"
+#include "trace_utils.h"
 
 namespace PhaseRetrieval
 {
     FArray reconstruct_ctf(const FArray &holograms, int numImages, const IntArray &imSize, const F2DArray &fresnelnumbers, float lowFreqLim,
-                           float highFreqLim, float betaDeltaRatio, const IntArray &padSize, CUDAUtils::PaddingType padType, float padValue)
+                           float highFreqLim, float betaDeltaRatio, const IntArray &padSize, CUDAUtils::PaddingType padType, float padValue,
+                           PerfUtils::PerfReport *report)
     {
         // Add GPU environment check
         int deviceCount;
@@ -33,7 +36,9 @@ namespace PhaseRetrieval
         // transfer holograms to GPU
         float *holograms_gpu, *phase_gpu;
         cudaMalloc((void**)&holograms_gpu, holograms.size() * sizeof(float));
+        PerfUtils::StageTimer timer(report);
         cudaMemcpy(holograms_gpu, holograms.data(), holograms.size() * sizeof(float), cudaMemcpyHostToDevice);
+        timer.lap("upload");
 
         IntArray newSize(imSize);
         // Optional padding operations on holograms
@@ -58,6 +63,7 @@ namespace PhaseRetrieval
             
             cudaFree(holograms_gpu);
             holograms_gpu = paddedHolograms_gpu;
+            timer.lap("padding");
         }
 
         // 按维度计算菲涅尔平均值
@@ -76,6 +82,7 @@ namespace PhaseRetrieval
 
         cudaMalloc((void**)&phase_gpu, newSize[0] * newSize[1] * sizeof(float));
         CUDAUtils::ctf_recons_kernel(holograms_gpu, phase_gpu, newSize, numImages, fresnelNumbers, betaDeltaRatio, regWeights);
+        timer.lap("ctf");
 
         // 如果应用了填充，则需要裁剪结果
         if (!padSize.empty()) {
@@ -84,18 +91,138 @@ namespace PhaseRetrieval
             CUDAUtils::cropMatrix(phase_gpu, croppedPhase, newSize[0], newSize[1], padSize[0], padSize[1], padSize[0], padSize[1]);
             cudaFree(phase_gpu);
             phase_gpu = croppedPhase;
+            timer.lap("crop");
         }
 
         FArray result(imSize[0] * imSize[1]);
         cudaMemcpy(result.data(), phase_gpu, imSize[0] * imSize[1] * sizeof(float), cudaMemcpyDeviceToHost);
+        timer.lap("download");
+        if (report) {
+            PerfUtils::addCTFBatch(*report, imSize, newSize, numImages, 1);
+        }
         cudaFree(phase_gpu); cudaFree(holograms_gpu); cudaFree(regWeights);
 
         return result;
     }
 
+    // Work areas of the single and batched plans of a CUFFTUtils
+    static size_t fftPlanBytes(const IntArray &size, int batchSize)
+    {
+        size_t single = 0, batch = 0;
+        int dims[2] = {size[1], size[0]};
+        cufftEstimate2d(size[1], size[0], CUFFT_C2C, &single);
+        cufftEstimateMany(2, dims, nullptr, 1, size[0] * size[1], nullptr, 1, size[0] * size[1], CUFFT_C2C, batchSize, &batch);
+        return single + batch;
+    }
+
+    // Allocation of a constructor, the planned footprint of the instance tells how much was needed when it fails
+    static void deviceMalloc(void **ptr, size_t bytes, size_t footprint)
+    {
+        cudaError_t status = cudaMalloc(ptr, bytes);
+        if (status == cudaSuccess) {
+            return;
+        }
+        cudaGetLastError();
+        if (status == cudaErrorMemoryAllocation) {
+            throw std::runtime_error("Out of device memory, the configuration needs about " + std::to_string(footprint >> 20) +
+                                     " MB, reduce the batch size or padding!");
+        }
+        throw std::runtime_error(std::string("Failed to allocate device memory: ") + cudaGetErrorString(status));
+    }
+
+    // Device memory in use, the CUDA context and other processes included
+    static void sampleMemory(size_t &peak)
+    {
+        size_t freeBytes, totalBytes;
+        if (cudaMemGetInfo(&freeBytes, &totalBytes) == cudaSuccess) {
+            peak = std::max(peak, totalBytes - freeBytes);
+        }
+    }
+
+    size_t ctfFootprint(int batchSize, int numImages, const IntArray &imSize, const IntArray &padSize)
+    {
+        size_t pixels = static_cast<size_t>(imSize[0]) * imSize[1];
+        IntArray newSize(imSize);
+        if (!padSize.empty()) {
+            newSize[0] += 2 * padSize[0];
+            newSize[1] += 2 * padSize[1];
+        }
+        size_t points = static_cast<size_t>(newSize[0]) * newSize[1];
+
+        // Holograms and phases of the batch, phase, weights and their copy, padded holograms
+        size_t bytes = (batchSize * numImages * pixels + batchSize * pixels + 3 * points) * sizeof(float);
+        if (!padSize.empty()) {
+            bytes += numImages * points * sizeof(float);
+        }
+
+        // Frequency grids, CTF sums, transfer function and hologram spectrum of ctf_recons_kernel
+        bytes += 2 * (newSize[0] + newSize[1]) * sizeof(float) + 2 * points * (sizeof(float) + sizeof(cuFloatComplex));
+        size_t plan = 0;
+        cufftEstimate2d(newSize[1], newSize[0], CUFFT_C2C, &plan);
+        return bytes + plan;
+    }
+
+    size_t iterFootprint(int batchSize, int numImages, const IntArray &imSize, const IntArray &padSize, PMagnitudeCons::Type projectionType,
+                         bool objectConstraints, bool support)
+    {
+        size_t pixels = static_cast<size_t>(imSize[0]) * imSize[1];
+        IntArray newSize(imSize);
+        if (!padSize.empty()) {
+            newSize[0] += 2 * padSize[0];
+            newSize[1] += 2 * padSize[1];
+        }
+        size_t points = static_cast<size_t>(newSize[0]) * newSize[1];
+        size_t wave = points * sizeof(cuFloatComplex);
+
+        // Holograms, initial and reconstructed phases of the batch, wave field and phase of the instance
+        size_t bytes = (batchSize * numImages * pixels + 2 * batchSize * pixels + points) * sizeof(float) + wave;
+        if (!padSize.empty()) {
+            bytes += (numImages * points + points) * sizeof(float);
+        }
+        if (support) {
+            bytes += points * sizeof(float) + wave;
+        }
+
+        // Propagation kernels with one propagator for all distances or one per distance
+        int propagated = projectionType == PMagnitudeCons::Averaged ? numImages : 1;
+        bytes += numImages * wave;
+        if (projectionType == PMagnitudeCons::Averaged) {
+            bytes += fftPlanBytes(newSize, numImages);
+        } else {
+            bytes += numImages * fftPlanBytes(newSize, 1);
+        }
+
+        // Magnitude projector of an angle, initial, current and previous wave fields of the solver, and the wave fields
+        // of a reflection on both planes with the chained object projections alive at once, besides one float scratch
+        bytes += wave + propagated * (wave + points * sizeof(float));
+        bytes += (3 + (objectConstraints ? 8 : 6)) * wave + points * sizeof(float);
+        return bytes;
+    }
+
+    size_t deviceBudget(float fraction)
+    {
+        size_t freeBytes = 0, totalBytes = 0;
+        cudaMemGetInfo(&freeBytes, &totalBytes);
+        return static_cast<size_t>(freeBytes * static_cast<double>(fraction));
+    }
+
+    int planBatchSize(const std::function<size_t(int)> &footprint, size_t budget, int maxBatchSize, int numAngles)
+    {
+        for (int batchSize = maxBatchSize; batchSize > 0; batchSize--) {
+            if (numAngles > 0 && numAngles % batchSize != 0)
+                continue;
+            if (footprint(batchSize) <= budget)
+                return batchSize;
+        }
+
+        return 0;
+    }
+
     CTFReconstructor::CTFReconstructor(int batchsize, int images, const IntArray &imsize, const F2DArray &fresnelnumbers, float lowFreqLim, float highFreqLim, float ratio,
                                        const IntArray &padsize, CUDAUtils::PaddingType padtype, float padvalue): batchSize(batchsize), numImages(images), imSize(imsize),
-                                       newSize(imsize), fresnelNumbers(fresnelnumbers), betaDeltaRatio(ratio), padSize(padsize), padType(padtype), padValue(padvalue)
+                                       newSize(imsize), fresnelNumbers(fresnelnumbers), betaDeltaRatio(ratio), padSize(padsize), padType(padtype), padValue(padvalue),
+                                       d_holograms(nullptr), d_paddedHolograms(nullptr), regWeights(nullptr), d_regTemp(nullptr), d_phase(nullptr),
+                                       d_results(nullptr), streams(nullptr), staging(nullptr), peakMemory(0)
     {
         for (auto &fresnelNumber: fresnelNumbers) {
             if (fresnelNumber.size() != 1 && fresnelNumber.size() != imSize.size()) {
@@ -113,37 +240,63 @@ namespace PhaseRetrieval
         if (!padSize.empty()) {
             newSize[0] += 2 * padSize[0];
             newSize[1] += 2 * padSize[1];
-            cudaMalloc((void**)&d_paddedHolograms, newSize[0] * newSize[1] * numImages * sizeof(float));
-            cudaMalloc((void**)&d_croppedPhase, imSize[0] * imSize[1] * sizeof(float));
-            streams = new cudaStream_t[numImages];
-            for (int i = 0; i < numImages; i++) {
-                cudaStreamCreate(&streams[i]);
-            }
         }
+        size_t footprint = ctfFootprint(batchSize, numImages, imSize, padSize);
+        try {
+            if (!padSize.empty()) {
+                deviceMalloc((void**)&d_paddedHolograms, newSize[0] * newSize[1] * numImages * sizeof(float), footprint);
+                streams = new cudaStream_t[numImages]();
+                for (int i = 0; i < numImages; i++) {
+                    cudaStreamCreate(&streams[i]);
+                }
+            }
 
-        cudaMalloc((void**)&d_holograms, batchSize * numImages * imSize[0] * imSize[1] * sizeof(float));
-        cudaMalloc((void**)&d_phase, newSize[0] * newSize[1] * sizeof(float));
-        cudaMalloc((void**)&regWeights, newSize[0] * newSize[1] * sizeof(float));
-        cudaMalloc((void**)&d_regTemp, newSize[0] * newSize[1] * sizeof(float));
+            deviceMalloc((void**)&d_holograms, batchSize * numImages * imSize[0] * imSize[1] * sizeof(float), footprint);
+            deviceMalloc((void**)&d_results, batchSize * imSize[0] * imSize[1] * sizeof(float), footprint);
+            deviceMalloc((void**)&d_phase, newSize[0] * newSize[1] * sizeof(float), footprint);
+            deviceMalloc((void**)&regWeights, newSize[0] * newSize[1] * sizeof(float), footprint);
+            deviceMalloc((void**)&d_regTemp, newSize[0] * newSize[1] * sizeof(float), footprint);
 
-        FArray fresnelMean(2);
-        for (int i = 0; i < 2; i++) {
-            float sum = 0.0f;
-            for (int j = 0; j < numImages; j++) {
-                sum += fresnelNumbers[j][i];
+            FArray fresnelMean(2);
+            for (int i = 0; i < 2; i++) {
+                float sum = 0.0f;
+                for (int j = 0; j < numImages; j++) {
+                    sum += fresnelNumbers[j][i];
+                }
+                fresnelMean[i] = sum / numImages;
             }
-            fresnelMean[i] = sum / numImages;
+            CUDAUtils::ctfRegWeights(regWeights, newSize, fresnelMean, lowFreqLim, highFreqLim);
+            staging = new HostStaging(batchSize * numImages * imSize[0] * imSize[1], batchSize * imSize[0] * imSize[1], batchSize);
+        } catch (...) {
+            release();
+            throw;
         }
-        CUDAUtils::ctfRegWeights(regWeights, newSize, fresnelMean, lowFreqLim, highFreqLim);
+        sampleMemory(peakMemory);
     }
 
-    FArray CTFReconstructor::reconsBatch(const FArray &holograms)
+    FArray CTFReconstructor::reconsBatch(const FArray &holograms, PerfUtils::PerfReport *report)
     {
-        cudaMemcpy(d_holograms, holograms.data(), holograms.size() * sizeof(float), cudaMemcpyHostToDevice);
+        TRACE_SCOPE("CTFReconstructor::reconsBatch", "recons");
+        if (holograms.size() != batchSize * numImages * imSize[0] * imSize[1]) {
+            throw std::invalid_argument("The size of holograms does not match the batch!");
+        }
+        PerfUtils::StageTimer timer(report);
+        // Every angle is uploaded on its own, so the first one is computed while the others are still in transfer
+        int pixels = imSize[0] * imSize[1];
+        for (int i = 0; i < batchSize; i++) {
+            staging->upload(d_holograms + i * numImages * pixels, holograms.data() + i * numImages * pixels, numImages * pixels,
+                            i * numImages * pixels, i);
+        }
+        timer.lap("upload");
         FArray result(imSize[0] * imSize[1] * batchSize);
 
         for (int i = 0; i < batchSize; i++) {
+            staging->waitUpload(i, cudaStreamPerThread);
             if (!padSize.empty()) {
+                TRACE_GPU_SCOPE("padding", "recons");
+                for (int j = 0; j < numImages; j++) {
+                    staging->waitUpload(i, streams[j]);
+                }
                 for (int j = 0; j < numImages; j++) {
                     CUDAUtils::padMatrix(d_holograms + i * numImages * imSize[0] * imSize[1] + j * imSize[0] * imSize[1],
                                          d_paddedHolograms + j * newSize[0] * newSize[1], imSize[0], imSize[1], padSize[0],
@@ -154,43 +307,68 @@ namespace PhaseRetrieval
                 }
 
                 d_temp = d_paddedHolograms;
+                timer.lap("padding");
             } else {
                 d_temp = d_holograms + i * numImages * imSize[0] * imSize[1];
             }
 
-            cudaMemcpy(d_regTemp, regWeights, newSize[0] * newSize[1] * sizeof(float), cudaMemcpyDeviceToDevice);
-            CUDAUtils::ctf_recons_kernel(d_temp, d_phase, newSize, numImages, fresnelNumbers, betaDeltaRatio, d_regTemp);
+            // Without padding the phase is written to its slot of the results right away
+            float *d_slot = d_results + i * pixels;
+            {
+                TRACE_GPU_SCOPE("ctf_recons_kernel", "recons");
+                cudaMemcpy(d_regTemp, regWeights, newSize[0] * newSize[1] * sizeof(float), cudaMemcpyDeviceToDevice);
+                sampleMemory(peakMemory);
+                CUDAUtils::ctf_recons_kernel(d_temp, padSize.empty() ? d_slot : d_phase, newSize, numImages, fresnelNumbers,
+                                             betaDeltaRatio, d_regTemp);
+            }
+            timer.lap("ctf");
 
             if (!padSize.empty()) {
-                CUDAUtils::cropMatrix(d_phase, d_croppedPhase, newSize[0], newSize[1], padSize[0], padSize[1], padSize[0], padSize[1]);
-            } else {
-                d_croppedPhase = d_phase;
+                CUDAUtils::cropMatrix(d_phase, d_slot, newSize[0], newSize[1], padSize[0], padSize[1], padSize[0], padSize[1]);
+                timer.lap("crop");
             }
 
-            cudaMemcpy(result.data() + i * imSize[0] * imSize[1], d_croppedPhase, imSize[0] * imSize[1] * sizeof(float), cudaMemcpyDeviceToHost);
+            // The download overlaps the next angle
+            staging->download(d_slot, pixels, i * pixels, i, cudaStreamPerThread);
+        }
+
+        for (int i = 0; i < batchSize; i++) {
+            staging->collect(result.data() + i * pixels, pixels, i * pixels, i);
         }
+        timer.lap("download");
 
+        if (report) {
+            PerfUtils::addCTFBatch(*report, imSize, newSize, numImages, batchSize);
+        }
         return result;
     }
 
-    CTFReconstructor::~CTFReconstructor()
+    // Also called by a failing constructor, buffers not allocated yet are null
+    void CTFReconstructor::release()
     {
-        cudaFree(d_holograms); cudaFree(d_phase);
+        delete staging;
+        cudaFree(d_holograms); cudaFree(d_phase); cudaFree(d_results);
         cudaFree(regWeights); cudaFree(d_regTemp);
-        if (!padSize.empty()) {
-            cudaFree(d_paddedHolograms);
-            cudaFree(d_croppedPhase);
+        cudaFree(d_paddedHolograms);
+        if (streams) {
             for (int i = 0; i < numImages; i++) {
-                cudaStreamDestroy(streams[i]);
+                if (streams[i])
+                    cudaStreamDestroy(streams[i]);
             }
             delete[] streams;
         }
     }
 
-    F2DArray reconstruct_iter(const FArray &holograms, int numImages, const IntArray &imSize, const F2DArray &fresnelNumbers, int iterations, const FArray &initialPhase,
+    CTFReconstructor::~CTFReconstructor()
+    {
+        release();
+    }
+
+    ReconsResult reconstruct_iter(const FArray &holograms, int numImages, const IntArray &imSize, const F2DArray &fresnelNumbers, int iterations, const FArray &initialPhase,
                               const FArray &initialAmplitude, ProjectionSolver::Algorithm algorithm, const FArray &algoParameters, float minPhase, float maxPhase, float minAmplitude,
                               float maxAmplitude, const IntArray &support, float outsideValue, const IntArray &padSize, CUDAUtils::PaddingType padType, float padValue,
-                              PMagnitudeCons::Type projectionType, CUDAPropKernel::Type kernelType, const FArray &holoProbes, const FArray &initProbePhase, bool calcError)
+                              PMagnitudeCons::Type projectionType, CUDAPropKernel::Type kernelType, const FArray &holoProbes, const FArray &initProbePhase, bool calcError,
+                              const ProjectionSolver::Observer &observer, int observeInterval)
     {
         // Add GPU environment check
         int deviceCount;
@@ -399,6 +577,9 @@ namespace PhaseRetrieval
         } else {
             projectionSolver = new ProjectionSolver(PM, PS, waveField, algorithm, algoParameters, calcError);
         }
+        if (observer) {
+            projectionSolver->setObserver(observer, observeInterval);
+        }
         
         // Reconstruct wave field by iterative projection algorithm
         auto iterResult = projectionSolver->execute(iterations);
@@ -439,16 +620,16 @@ namespace PhaseRetrieval
             reconsProbe.getPhase(probePhase);
         }
 
-        F2DArray result(3, FArray(imSize[0] * imSize[1]));
-        cudaMemcpy(result[0].data(), phase, imSize[0] * imSize[1] * sizeof(float), cudaMemcpyDeviceToHost);
-        cudaMemcpy(result[1].data(), amplitude, imSize[0] * imSize[1] * sizeof(float), cudaMemcpyDeviceToHost);
+        ReconsResult result;
+        result.planes = FTensor({3, imSize[0], imSize[1]});
+        cudaMemcpy(result.planes.slice(0).data(), phase, imSize[0] * imSize[1] * sizeof(float), cudaMemcpyDeviceToHost);
+        cudaMemcpy(result.planes.slice(1).data(), amplitude, imSize[0] * imSize[1] * sizeof(float), cudaMemcpyDeviceToHost);
         if (isAPWP) {
-            cudaMemcpy(result[2].data(), probePhase, imSize[0] * imSize[1] * sizeof(float), cudaMemcpyDeviceToHost);
+            cudaMemcpy(result.planes.slice(2).data(), probePhase, imSize[0] * imSize[1] * sizeof(float), cudaMemcpyDeviceToHost);
         }
 
         if (calcError) {
-            result.push_back(iterResult.finalError[0]);
-            result.push_back(iterResult.finalError[1]);
+            result.residuals = iterResult.finalError;
         }
         
         delete projectionSolver; delete PM; delete PS;
@@ -465,10 +646,10 @@ namespace PhaseRetrieval
         return result;
     }
 
-    F2DArray reconstruct_epi(const FArray &holograms, int numImages, const IntArray &measSize, const F2DArray &fresnelNumbers, int iterations,
+    ReconsResult reconstruct_epi(const FArray &holograms, int numImages, const IntArray &measSize, const F2DArray &fresnelNumbers, int iterations,
                                 const IntArray &imSize, const FArray &initialPhase, const FArray &initialAmplitude, float minPhase, float maxPhase,
                                 float minAmplitude, float maxAmplitude, const IntArray &support, float outsideValue, PMagnitudeCons::Type projectionType,
-                                CUDAPropKernel::Type kernelType, bool calcError)
+                                CUDAPropKernel::Type kernelType, bool calcError, const ProjectionSolver::Observer &observer, int observeInterval)
     {
         // Add GPU environment check
         int deviceCount;
@@ -547,6 +728,9 @@ namespace PhaseRetrieval
         WaveField waveField(imSize[0], imSize[1], complexWave);
 
         ProjectionSolver *projectionSolver = new ProjectionSolver(PM, PS, waveField, ProjectionSolver::EPI, FArray(), calcError);
+        if (observer) {
+            projectionSolver->setObserver(observer, observeInterval);
+        }
         
         // Reconstruct wave field by iterative projection algorithm
         auto iterResult = projectionSolver->execute(iterations);
@@ -560,13 +744,13 @@ namespace PhaseRetrieval
         reconsPsi.getPhase(phase);
         reconsPsi.getAmplitude(amplitude);
 
-        F2DArray result(2, FArray(imSize[0] * imSize[1]));
-        cudaMemcpy(result[0].data(), phase, imSize[0] * imSize[1] * sizeof(float), cudaMemcpyDeviceToHost);
-        cudaMemcpy(result[1].data(), amplitude, imSize[0] * imSize[1] * sizeof(float), cudaMemcpyDeviceToHost);
+        ReconsResult result;
+        result.planes = FTensor({2, imSize[0], imSize[1]});
+        cudaMemcpy(result.planes.slice(0).data(), phase, imSize[0] * imSize[1] * sizeof(float), cudaMemcpyDeviceToHost);
+        cudaMemcpy(result.planes.slice(1).data(), amplitude, imSize[0] * imSize[1] * sizeof(float), cudaMemcpyDeviceToHost);
 
         if (calcError) {
-            result.push_back(iterResult.finalError[0]);
-            result.push_back(iterResult.finalError[1]);
+            result.residuals = iterResult.finalError;
         }
         
         delete projectionSolver; delete PM; delete PS;
@@ -584,79 +768,111 @@ namespace PhaseRetrieval
                                  const FArray &algoParams, float minPhase, float maxPhase, float minAmplitude, float maxAmplitude, const IntArray &support, float outsideValue,
                                  const IntArray &padsize, CUDAUtils::PaddingType padtype, float padvalue, PMagnitudeCons::Type projType, CUDAPropKernel::Type kernelType):
                                  batchSize(batchsize), numImages(images), imSize(imsize), newSize(imsize), iteration(iter), algorithm(algo), algoParameters(algoParams),
-                                 padSize(padsize), projectionType(projType), padType(padtype), padValue(padvalue), d_support(nullptr)
+                                 padSize(padsize), projectionType(projType), padType(padtype), padValue(padvalue), pPhase(nullptr), pAmplitude(nullptr),
+                                 pSupport(nullptr), PS(nullptr), d_holograms(nullptr), d_paddedHolograms(nullptr), d_phase(nullptr), d_support(nullptr),
+                                 d_initPhase(nullptr), d_paddedInitPhase(nullptr), d_results(nullptr), complexWave(nullptr), streams(nullptr),
+                                 staging(nullptr), peakMemory(0)
     {
         if (!padSize.empty()) {
             newSize[0] += 2 * padSize[0];
             newSize[1] += 2 * padSize[1];
-            cudaMalloc((void**)&d_paddedHolograms, newSize[0] * newSize[1] * numImages * sizeof(float));
-            cudaMalloc((void**)&d_paddedInitPhase, newSize[0] * newSize[1] * sizeof(float));
-            cudaMalloc((void**)&d_croppedPhase, imSize[0] * imSize[1] * sizeof(float));
-            streams = new cudaStream_t[numImages];
-            for (int i = 0; i < numImages; i++) {
-                cudaStreamCreate(&streams[i]);
-            }
         }
+        bool supportCons = !support.empty() && !(support[0] == newSize[0] && support[1] == newSize[1]);
+        bool objectCons = !(minPhase == -FloatInf && maxPhase == FloatInf) || supportCons;
+        size_t footprint = iterFootprint(batchSize, numImages, imSize, padSize, projectionType, objectCons, supportCons);
+        try {
+            if (!padSize.empty()) {
+                deviceMalloc((void**)&d_paddedHolograms, newSize[0] * newSize[1] * numImages * sizeof(float), footprint);
+                deviceMalloc((void**)&d_paddedInitPhase, newSize[0] * newSize[1] * sizeof(float), footprint);
+                streams = new cudaStream_t[numImages]();
+                for (int i = 0; i < numImages; i++) {
+                    cudaStreamCreate(&streams[i]);
+                }
+            }
 
-        cudaMalloc((void**)&d_holograms, batchSize * numImages * imSize[0] * imSize[1] * sizeof(float));
-        cudaMalloc((void**)&d_initPhase, batchSize * imSize[0] * imSize[1] * sizeof(float));
-        cudaMalloc((void**)&complexWave, newSize[0] * newSize[1] * sizeof(cuFloatComplex));
-        cudaMalloc((void**)&d_phase, newSize[0] * newSize[1] * sizeof(float));
+            deviceMalloc((void**)&d_holograms, batchSize * numImages * imSize[0] * imSize[1] * sizeof(float), footprint);
+            deviceMalloc((void**)&d_initPhase, batchSize * imSize[0] * imSize[1] * sizeof(float), footprint);
+            deviceMalloc((void**)&d_results, batchSize * imSize[0] * imSize[1] * sizeof(float), footprint);
+            deviceMalloc((void**)&complexWave, newSize[0] * newSize[1] * sizeof(cuFloatComplex), footprint);
+            deviceMalloc((void**)&d_phase, newSize[0] * newSize[1] * sizeof(float), footprint);
 
-        // Construct propagators according to the projection type
-        if (projectionType == PMagnitudeCons::Averaged) {
-            propagators.push_back(std::make_shared<Propagator>(newSize, fresnelNumbers, kernelType));
-        } else {
-            for (const auto &fNumber: fresnelNumbers) {
-                F2DArray singleFresnel {fNumber};
-                propagators.push_back(std::make_shared<Propagator>(newSize, singleFresnel, kernelType));
+            // Construct propagators according to the projection type
+            if (projectionType == PMagnitudeCons::Averaged) {
+                propagators.push_back(std::make_shared<Propagator>(newSize, fresnelNumbers, kernelType));
+            } else {
+                for (const auto &fNumber: fresnelNumbers) {
+                    F2DArray singleFresnel {fNumber};
+                    propagators.push_back(std::make_shared<Propagator>(newSize, singleFresnel, kernelType));
+                }
             }
-        }
 
-        // Construct projector on constraints of object plane
-        if (!support.empty()) {
-            if (support[0] > newSize[0] || support[1] > newSize[1]) {
-                throw std::invalid_argument("The support size is larger than the image size!");
-            }
+            // Construct projector on constraints of object plane
+            if (!support.empty()) {
+                if (support[0] > newSize[0] || support[1] > newSize[1]) {
+                    throw std::invalid_argument("The support size is larger than the image size!");
+                }
 
-            if (!(support[0] == newSize[0] && support[1] == newSize[1])) {
-                cudaMalloc((void**)&d_support, support[0] * support[1] * sizeof(float));
-                int blockSize = 1024;
-                int gridSize = (support[0] * support[1] + blockSize - 1) / blockSize;
-                initializeData<<<gridSize, blockSize>>>(d_support, 1.0f, support[0] * support[1]);
+                if (!(support[0] == newSize[0] && support[1] == newSize[1])) {
+                    deviceMalloc((void**)&d_support, support[0] * support[1] * sizeof(float), footprint);
+                    int blockSize = 1024;
+                    int gridSize = (support[0] * support[1] + blockSize - 1) / blockSize;
+                    initializeData<<<gridSize, blockSize>>>(d_support, 1.0f, support[0] * support[1]);
 
-                IntArray suppPadSize {(newSize[0] - support[0]) / 2, (newSize[1] - support[1]) / 2};
-                float *paddedSupport_gpu = CUDAUtils::padInputData(d_support, support, suppPadSize, CUDAUtils::Constant, 0.0f);
-                cudaFree(d_support);
-                d_support = paddedSupport_gpu;
+                    IntArray suppPadSize {(newSize[0] - support[0]) / 2, (newSize[1] - support[1]) / 2};
+                    float *paddedSupport_gpu = CUDAUtils::padInputData(d_support, support, suppPadSize, CUDAUtils::Constant, 0.0f);
+                    cudaFree(d_support);
+                    d_support = paddedSupport_gpu;
+                }
             }
-        }
 
-        pAmplitude = new PAmplitudeCons(minAmplitude, maxAmplitude);
-        onlyAmpCons = (minPhase == -FloatInf && maxPhase == FloatInf && d_support == nullptr);
-        if (onlyAmpCons) {
-            PS = pAmplitude;
-        } else {
-            pPhase = new PPhaseCons(minPhase, maxPhase);
-            pSupport = new PSupportCons(d_support, newSize[0] * newSize[1], outsideValue);
-            PS = new MultiObjectCons(pPhase, pAmplitude, pSupport);
+            pAmplitude = new PAmplitudeCons(minAmplitude, maxAmplitude);
+            onlyAmpCons = (minPhase == -FloatInf && maxPhase == FloatInf && d_support == nullptr);
+            if (onlyAmpCons) {
+                PS = pAmplitude;
+            } else {
+                pPhase = new PPhaseCons(minPhase, maxPhase);
+                pSupport = new PSupportCons(d_support, newSize[0] * newSize[1], outsideValue);
+                PS = new MultiObjectCons(pPhase, pAmplitude, pSupport);
+            }
+            // Holograms of the batch are staged next to the initial phases
+            staging = new HostStaging(batchSize * (numImages + 1) * imSize[0] * imSize[1], batchSize * imSize[0] * imSize[1], batchSize);
+        } catch (...) {
+            release();
+            throw;
         }
+        sampleMemory(peakMemory);
     }
 
-    FArray Reconstructor::reconsBatch(const FArray &holograms, const FArray &initialPhase)
+    FArray Reconstructor::reconsBatch(const FArray &holograms, const FArray &initialPhase, PerfUtils::PerfReport *report)
     {
-        cudaMemcpy(d_holograms, holograms.data(), holograms.size() * sizeof(float), cudaMemcpyHostToDevice);
-        if (!initialPhase.empty()) {
-            if (initialPhase.size() != imSize[0] * imSize[1] * batchSize) {
-                throw std::invalid_argument("The sizes of guess phase and wave field do not match!");
+        TRACE_SCOPE("Reconstructor::reconsBatch", "recons");
+        int pixels = imSize[0] * imSize[1];
+        if (holograms.size() != batchSize * numImages * pixels) {
+            throw std::invalid_argument("The size of holograms does not match the batch!");
+        }
+        if (!initialPhase.empty() && initialPhase.size() != batchSize * pixels) {
+            throw std::invalid_argument("The sizes of guess phase and wave field do not match!");
+        }
+        PerfUtils::StageTimer timer(report);
+        // Every angle is uploaded on its own, so the first one is reconstructed while the others are still in transfer
+        for (int i = 0; i < batchSize; i++) {
+            staging->upload(d_holograms + i * numImages * pixels, holograms.data() + i * numImages * pixels, numImages * pixels,
+                            i * numImages * pixels, i);
+            if (!initialPhase.empty()) {
+                staging->upload(d_initPhase + i * pixels, initialPhase.data() + i * pixels, pixels, (batchSize * numImages + i) * pixels, i);
             }
-            cudaMemcpy(d_initPhase, initialPhase.data(), initialPhase.size() * sizeof(float), cudaMemcpyHostToDevice);
         }
-        FArray result(batchSize * imSize[0] * imSize[1]);
+        timer.lap("upload");
+        FArray result(batchSize * pixels);
 
         for (int i = 0; i < batchSize; i++) {
+            staging->waitUpload(i, cudaStreamPerThread);
             // Optional padding operations on holograms
             if (!padSize.empty()) {
+                TRACE_GPU_SCOPE("padding", "recons");
+                for (int j = 0; j < numImages; j++) {
+                    staging->waitUpload(i, streams[j]);
+                }
                 for (int j = 0; j < numImages; j++) {
                     CUDAUtils::padMatrix(d_holograms + i * numImages * imSize[0] * imSize[1] + j * imSize[0] * imSize[1], 
                                          d_paddedHolograms + j * newSize[0] * newSize[1], imSize[0], imSize[1], padSize[0],
@@ -668,6 +884,7 @@ namespace PhaseRetrieval
                 }
 
                 d_temp = d_paddedHolograms;
+                timer.lap("padding");
             } else {
                 d_temp = d_holograms + i * numImages * imSize[0] * imSize[1];
             }
@@ -675,6 +892,7 @@ namespace PhaseRetrieval
             int blockSize = 1024;
             int numBlocks = (newSize[0] * newSize[1] * numImages + blockSize - 1) / blockSize;
             sqrtIntensity<<<numBlocks, blockSize>>>(d_temp, newSize[0] * newSize[1] * numImages);
+            timer.lap("init");
 
             // Construct projector on measured holograms
             Projector *PM = new PMagnitudeCons(d_temp, numImages, newSize, propagators, projectionType, false);
@@ -685,6 +903,7 @@ namespace PhaseRetrieval
                     CUDAUtils::padMatrix(d_initPhase + i * imSize[0] * imSize[1], d_paddedInitPhase,
                                          imSize[0], imSize[1], padSize[0], padSize[1], padType, padValue);
                     d_temp = d_paddedInitPhase;
+                    timer.lap("padding");
                 } else {
                     d_temp = d_initPhase + i * imSize[0] * imSize[1];
                 }
@@ -693,46 +912,246 @@ namespace PhaseRetrieval
                 initializeData<<<numBlocks, blockSize>>>(complexWave, make_cuFloatComplex(1.0f, 0.0f), newSize[0] * newSize[1]);
             }
             WaveField waveField(newSize[0], newSize[1], complexWave);
+            timer.lap("init");
 
+            // Without padding the phase is written to its slot of the results right away
+            float *d_slot = d_results + i * pixels;
             ProjectionSolver projectionSolver(PM, PS, waveField, algorithm, algoParameters, false);
-            projectionSolver.execute(iteration).reconsPsi.getPhase(d_phase);
+            sampleMemory(peakMemory);
+            projectionSolver.execute(iteration).reconsPsi.getPhase(padSize.empty() ? d_slot : d_phase);
+            timer.lap("solver");
 
             if (!padSize.empty()) {
-                CUDAUtils::cropMatrix(d_phase, d_croppedPhase, newSize[0], newSize[1], padSize[0], padSize[1], padSize[0], padSize[1]);
-            } else {
-                d_croppedPhase = d_phase;
+                CUDAUtils::cropMatrix(d_phase, d_slot, newSize[0], newSize[1], padSize[0], padSize[1], padSize[0], padSize[1]);
+                timer.lap("crop");
             }
 
-            cudaMemcpy(result.data() + i * imSize[0] * imSize[1], d_croppedPhase, imSize[0] * imSize[1] * sizeof(float), cudaMemcpyDeviceToHost);
-
+            // The download overlaps the next angle
+            staging->download(d_slot, pixels, i * pixels, i, cudaStreamPerThread);
             delete PM;
         }
 
+        for (int i = 0; i < batchSize; i++) {
+            staging->collect(result.data() + i * pixels, pixels, i * pixels, i);
+        }
+        timer.lap("download");
+
+        if (report) {
+            PerfUtils::addIterBatch(*report, imSize, newSize, numImages, batchSize, iteration, algorithm, projectionType,
+                                    !onlyAmpCons, !initialPhase.empty());
+        }
         return result;
     }
     
-    Reconstructor::~Reconstructor()
+    // Also called by a failing constructor, members not set up yet are null
+    void Reconstructor::release()
     {
+        delete staging;
         cudaFree(d_holograms);
+        cudaFree(d_results);
         cudaFree(d_phase);
         cudaFree(complexWave);
         cudaFree(d_initPhase);
         if (d_support)
             cudaFree(d_support);
 
-        if (!padSize.empty()) {
-            cudaFree(d_paddedHolograms);
-            cudaFree(d_paddedInitPhase);
-            cudaFree(d_croppedPhase);
+        cudaFree(d_paddedHolograms);
+        cudaFree(d_paddedInitPhase);
+        if (streams) {
             for (int i = 0; i < numImages; i++) {
-                cudaStreamDestroy(streams[i]);
+                if (streams[i])
+                    cudaStreamDestroy(streams[i]);
             }
             delete[] streams;
         }
 
-        delete PS;
-        if (!onlyAmpCons) {
-            delete pPhase; delete pSupport; delete pAmplitude;
+        // PS is the amplitude projector itself without constraints on the object
+        if (PS != pAmplitude)
+            delete PS;
+        delete pPhase; delete pSupport; delete pAmplitude;
+    }
+
+    Reconstructor::~Reconstructor()
+    {
+        release();
+    }
+
+    FTensor reconstruct_many(const FArray &holograms, int numAngles, int numImages, const IntArray &imSize, const F2DArray &fresnelNumbers, int iterations,
+                            const FArray &initialPhase, ProjectionSolver::Algorithm algorithm, const FArray &algoParameters, float minPhase, float maxPhase,
+                            float minAmplitude, float maxAmplitude, const IntArray &support, float outsideValue, const IntArray &padSize,
+                            CUDAUtils::PaddingType padType, float padValue, PMagnitudeCons::Type projectionType, CUDAPropKernel::Type kernelType,
+                            int numThreads, int numDevices)
+    {
+        int deviceCount;
+        cudaError_t error = cudaGetDeviceCount(&deviceCount);
+        if (error != cudaSuccess || deviceCount == 0) {
+            throw std::runtime_error("No CUDA capable GPU device found!");
+        }
+        if (numDevices <= 0 || numDevices > deviceCount) {
+            numDevices = deviceCount;
+        }
+
+        size_t imNumel = static_cast<size_t>(imSize[0]) * imSize[1];
+        if (numAngles <= 0 || holograms.size() != numAngles * numImages * imNumel) {
+            throw std::invalid_argument("The size of holograms does not match the number of angles and images!");
+        }
+        if (!initialPhase.empty() && initialPhase.size() != numAngles * imNumel) {
+            throw std::invalid_argument("The sizes of guess phase and wave field do not match!");
+        }
+
+        int callerDevice;
+        cudaGetDevice(&callerDevice);
+        if (numThreads <= 0) {
+            // Every worker holds a full iterative workspace on its GPU, so the default follows the devices instead of the
+            // cores: up to two workers per device, to overlap the host work of one with the kernels of the other, as far
+            // as their footprints fit into the free memory of every device
+            bool objectConstraints = minPhase != -FloatInf || maxPhase != FloatInf || !support.empty();
+            size_t footprint = iterFootprint(1, numImages, imSize, padSize, projectionType, objectConstraints, !support.empty());
+            int perDevice = 2;
+            for (int device = 0; device < numDevices; device++) {
+                cudaSetDevice(device);
+                perDevice = static_cast<int>(std::min<size_t>(perDevice, deviceBudget() / footprint));
+            }
+            cudaSetDevice(callerDevice);
+            numThreads = std::max(1, perDevice) * numDevices;
+        }
+        numThreads = std::min(numThreads, numAngles);
+
+        // Each worker lazily builds its own reconstructor on device (worker % numDevices) and reuses it for all its angles
+        std::vector<std::unique_ptr<Reconstructor>> workspaces(numThreads);
+        FTensor result({numAngles, imSize[0], imSize[1]});
+
+        // Device buffers have to be released on the device they were allocated on
+        auto releaseWorkspaces = [&]() {
+            for (int i = 0; i < numThreads; i++) {
+                cudaSetDevice(i % numDevices);
+                workspaces[i].reset();
+            }
+            cudaSetDevice(callerDevice);
+        };
+
+        ThreadPool pool(numThreads);
+        for (int angle = 0; angle < numAngles; angle++) {
+            pool.submit([&, angle](int worker) {
+                auto &workspace = workspaces[worker];
+                if (!workspace) {
+                    cudaSetDevice(worker % numDevices);
+                    workspace = std::make_unique<Reconstructor>(1, numImages, imSize, fresnelNumbers, iterations, algorithm, algoParameters,
+                                                                minPhase, maxPhase, minAmplitude, maxAmplitude, support, outsideValue,
+                                                                padSize, padType, padValue, projectionType, kernelType);
+                }
+
+                FArray angleGrams(holograms.begin() + angle * numImages * imNumel, holograms.begin() + (angle + 1) * numImages * imNumel);
+                FArray anglePhase;
+                if (!initialPhase.empty()) {
+                    anglePhase.assign(initialPhase.begin() + angle * imNumel, initialPhase.begin() + (angle + 1) * imNumel);
+                }
+
+                FArray phase = workspace->reconsBatch(angleGrams, anglePhase);
+                std::copy(phase.begin(), phase.end(), result.slice(angle).data());
+            });
+        }
+
+        try {
+            pool.wait();
+        } catch (...) {
+            releaseWorkspaces();
+            throw;
         }
+        releaseWorkspaces();
+
+        return result;
+    }
+
+    TuneUtils::Trial tune(const FArray &holograms, int numImages, const IntArray &imSize, const F2DArray &fresnelNumbers, int trialIterations,
+                          ProjectionSolver::Algorithm algorithm, const FArray &algoParameters, float minPhase, float maxPhase, float minAmplitude,
+                          float maxAmplitude, const IntArray &support, float outsideValue, const IntArray &padSize, CUDAUtils::PaddingType padType,
+                          float padValue, int maxBatchSize, int numAngles, std::vector<TuneUtils::Trial> *trials)
+    {
+        if (trialIterations < 2)
+            throw std::invalid_argument("Tuning needs at least two trial iterations!");
+        if (maxBatchSize <= 0 || numAngles <= 0)
+            throw std::invalid_argument("Invalid batch size or number of angles!");
+
+        // Projection and kernel types, timed from the observer since the errors synchronise every iteration
+        std::vector<TuneUtils::Trial> typeTrials;
+        for (int p = PMagnitudeCons::Averaged; p <= PMagnitudeCons::Cyclic; p++) {
+            for (int k = CUDAPropKernel::Fourier; k <= CUDAPropKernel::ChirpLimited; k++) {
+                TuneUtils::Trial trial {static_cast<PMagnitudeCons::Type>(p), static_cast<CUDAPropKernel::Type>(k), 1, 0.0, 0.0};
+                std::vector<double> times;
+                FArray errors;
+                auto observer = [&](const IterationState &state) {
+                    times.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count());
+                    errors.push_back(state.magnitudeError);
+                    return true;
+                };
+                try {
+                    reconstruct_iter(holograms, numImages, imSize, fresnelNumbers, trialIterations, FArray(), FArray(), algorithm, algoParameters,
+                                     minPhase, maxPhase, minAmplitude, maxAmplitude, support, outsideValue, padSize, padType, padValue,
+                                     trial.projectionType, trial.kernelType, FArray(), FArray(), true, observer);
+                } catch (const std::exception &) {
+                    cudaGetLastError();
+                    continue;
+                }
+                TuneUtils::scoreTrial(trial, times, errors);
+                typeTrials.push_back(trial);
+            }
+        }
+        if (typeTrials.empty())
+            throw std::runtime_error("No configuration could be reconstructed!");
+        TuneUtils::Trial best = TuneUtils::bestTrial(typeTrials);
+        if (trials)
+            trials->insert(trials->end(), typeTrials.begin(), typeTrials.end());
+
+        // Batch sizes roughly doubling up to the largest one which fits
+        bool objectConstraints = minPhase != -FloatInf || maxPhase != FloatInf || !support.empty();
+        size_t budget = deviceBudget();
+        IntArray batches;
+        for (int limit = 1; ; limit *= 2) {
+            int batch = std::min(limit, std::min(maxBatchSize, numAngles));
+            while (numAngles % batch != 0) {
+                batch--;
+            }
+            if (iterFootprint(batch, numImages, imSize, padSize, best.projectionType, objectConstraints, !support.empty()) > budget)
+                break;
+            if (batches.empty() || batches.back() != batch)
+                batches.push_back(batch);
+            if (limit >= maxBatchSize || limit >= numAngles)
+                break;
+        }
+
+        // The first batch warms up the kernels and plans, the second one is timed
+        double fastest = 0.0;
+        for (int batch: batches) {
+            TuneUtils::Trial trial = best;
+            trial.batchSize = batch;
+            try {
+                Reconstructor reconstructor(batch, numImages, imSize, fresnelNumbers, trialIterations, algorithm, algoParameters, minPhase, maxPhase,
+                                            minAmplitude, maxAmplitude, support, outsideValue, padSize, padType, padValue, best.projectionType,
+                                            best.kernelType);
+                FArray batchGrams;
+                for (int i = 0; i < batch; i++) {
+                    batchGrams.insert(batchGrams.end(), holograms.begin(), holograms.end());
+                }
+                reconstructor.reconsBatch(batchGrams, FArray());
+                auto start = std::chrono::steady_clock::now();
+                reconstructor.reconsBatch(batchGrams, FArray());
+                double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                trial.iterationSeconds = seconds / (static_cast<double>(batch) * trialIterations);
+            } catch (const std::exception &) {
+                cudaGetLastError();
+                break;
+            }
+            if (trials)
+                trials->push_back(trial);
+            if (fastest == 0.0 || trial.iterationSeconds < fastest) {
+                fastest = trial.iterationSeconds;
+                best.batchSize = batch;
+            }
+        }
+        if (fastest > 0.0)
+            best.iterationSeconds = fastest;
+
+        return best;
     }
-}
\ No newline at end of file
+}
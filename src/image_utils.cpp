@@ -331,6 +331,27 @@ void ImageUtils::displayNDArray(F2DArray &images, int rows, int cols, const std:
     while (cv::waitKey(1) != 27);   
 }
 
+void ImageUtils::displayNDArray(const FTensorView &images, const std::vector<std::string> &imgName)
+{
+    int rows = images.shape(1);
+    int cols = images.shape(2);
+    std::vector<cv::Mat> mats;
+    for (int i = 0; i < images.shape(0); i++) {
+        // Normalising writes a new matrix, the view itself is only read
+        cv::Mat mat;
+        cv::normalize(cv::Mat(rows, cols, CV_32F, const_cast<float*>(images.slice(i).data())), mat, 0, 255, cv::NORM_MINMAX);
+        mat.convertTo(mat, CV_8U);
+        mats.push_back(mat);
+        cv::namedWindow(imgName[i], cv::WINDOW_AUTOSIZE);
+    }
+
+    for (int i = 0; i < mats.size(); i++) {
+        cv::imshow(imgName[i], mats[i]);
+    }
+
+    while (cv::waitKey(1) != 27);
+}
+
 void ImageUtils::displayPhase(FArray &phase, int rows, int cols, const std::string &imgName)
 {   
     // Create OpenCV matrix
@@ -351,12 +372,14 @@ void ImageUtils::displayPhase(FArray &phase, int rows, int cols, const std::stri
 
 bool ImageUtils::saveImage(const std::string &filename, const FArray &image, int rows, int cols)
 {
-    // 创建OpenCV矩阵
-    cv::Mat mat(rows, cols, CV_32F);
-    memcpy(mat.data, image.data(), rows * cols * sizeof(float));
-    
-    // 归一化到0-255范围并转换为8位无符号整数
-    cv::normalize(mat, mat, 0, 255, cv::NORM_MINMAX);
+    return saveImage(filename, FTensorView(image.data(), {rows, cols}));
+}
+
+bool ImageUtils::saveImage(const std::string &filename, const FTensorView &image)
+{
+    // 归一化到0-255范围并转换为8位无符号整数，视图本身只读
+    cv::Mat mat;
+    cv::normalize(cv::Mat(image.shape(0), image.shape(1), CV_32F, const_cast<float*>(image.data())), mat, 0, 255, cv::NORM_MINMAX);
     mat.convertTo(mat, CV_8U);
     
     // 保存为jpg格式图片
@@ -356,9 +356,47 @@ bool IOUtils::readPhaseGram(const std::string &filename, const std::string &data
     return true;
 }
 
+bool IOUtils::readAngles(const std::string &filename, const std::string &datasetName, FArray &angles)
+{
+    hid_t file_id = H5Fopen(filename.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+    if (file_id < 0) {
+        std::cerr << "Error opening file: " << filename << std::endl;
+        return false;
+    }
+
+    hid_t dataset_id = H5Dopen2(file_id, datasetName.c_str(), H5P_DEFAULT);
+    if (dataset_id < 0) {
+        std::cerr << "Error opening dataset: " << datasetName << std::endl;
+        H5Fclose(file_id);
+        return false;
+    }
+
+    // 角度数据集必须是1D
+    hid_t dataspace_id = H5Dget_space(dataset_id);
+    if (H5Sget_simple_extent_ndims(dataspace_id) != 1) {
+        std::cerr << "Error: DataSet is not 1-dimensional!" << std::endl;
+        H5Sclose(dataspace_id);
+        H5Dclose(dataset_id);
+        H5Fclose(file_id);
+        return false;
+    }
+
+    hsize_t numAngles;
+    H5Sget_simple_extent_dims(dataspace_id, &numAngles, nullptr);
+    angles.resize(numAngles);
+    H5Dread(dataset_id, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT, angles.data());
+
+    H5Sclose(dataspace_id);
+    H5Dclose(dataset_id);
+    H5Fclose(file_id);
+
+    return true;
+}
+
 bool IOUtils::readSingleGram(const std::string &filename, const std::string &datasetName, 
                              U16Array &data, std::vector<hsize_t> &dims, MPI_Comm comm)
 {
+    TRACE_SCOPE("readSingleGram", "io");
     int rank, size;
     MPI_Comm_rank(comm, &rank);
     MPI_Comm_size(comm, &size);
@@ -438,7 +476,80 @@ bool IOUtils::readSingleGram(const std::string &filename, const std::string &dat
     return global_success == 1;
 }
 
+bool IOUtils::readSingleGram(const std::string &filename, const std::string &datasetName,
+                             std::unique_ptr<SharedArray<uint16_t>> &data, std::vector<hsize_t> &dims, MPI_Comm comm)
+{
+    TRACE_SCOPE("readSingleGram", "io");
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+
+    hid_t file_id = H5I_INVALID_HID;
+    hid_t dset_id = H5I_INVALID_HID;
+    hid_t space_id = H5I_INVALID_HID;
+    bool success = true;
+
+    // 只有rank 0进程读取维度信息
+    int ndims = 0;
+    if (rank == 0) {
+        file_id = H5Fopen(filename.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+        if (file_id >= 0) dset_id = H5Dopen2(file_id, datasetName.c_str(), H5P_DEFAULT);
+        if (dset_id >= 0) space_id = H5Dget_space(dset_id);
+        if (space_id >= 0) {
+            ndims = H5Sget_simple_extent_ndims(space_id);
+            dims.resize(ndims);
+            H5Sget_simple_extent_dims(space_id, dims.data(), NULL);
+        } else {
+            std::cerr << "Process 0 Error opening dataset: " << datasetName << std::endl;
+            ndims = -1;
+        }
+    }
+
+    MPI_Bcast(&ndims, 1, MPI_INT, 0, comm);
+    if (ndims < 0) {
+        if (dset_id >= 0) H5Dclose(dset_id);
+        if (file_id >= 0) H5Fclose(file_id);
+        return false;
+    }
+    dims.resize(ndims);
+    MPI_Bcast(dims.data(), ndims, MPI_UNSIGNED_LONG_LONG, 0, comm);
+
+    size_t total_size = 1;
+    for (const auto &dim : dims) {
+        total_size *= dim;
+    }
+
+    // 每个节点只保留一份数据, rank 0直接读入共享内存, 再由各节点的首进程广播
+    data.reset(new SharedArray<uint16_t>(total_size, comm));
+    if (rank == 0) {
+        if (H5Dread(dset_id, H5T_NATIVE_UINT16, H5S_ALL, H5S_ALL, H5P_DEFAULT, data->data()) < 0) {
+            std::cerr << "Process 0 Error reading dataset: " << datasetName << std::endl;
+            success = false;
+        }
+        H5Sclose(space_id);
+        H5Dclose(dset_id);
+        H5Fclose(file_id);
+    }
+
+    MPI_Comm owners = nodeOwnersComm(comm);
+    if (owners != MPI_COMM_NULL) {
+        MPI_Bcast(data->data(), total_size, MPI_UNSIGNED_SHORT, 0, owners);
+        MPI_Comm_free(&owners);
+    }
+    data->sync();
+
+    int local_success = success ? 1 : 0;
+    int global_success;
+    MPI_Allreduce(&local_success, &global_success, 1, MPI_INT, MPI_MIN, comm);
+
+    return global_success == 1;
+}
+
 bool IOUtils::savePhaseGram(const std::string &filename, const std::string &datasetName, const FArray &reconsPhase, int rows, int cols)
+{
+    return savePhaseGram(filename, datasetName, FTensorView(reconsPhase.data(), {rows, cols}));
+}
+
+bool IOUtils::savePhaseGram(const std::string &filename, const std::string &datasetName, const FTensorView &reconsPhase)
 {
     hid_t file_id, dataset_id, dataspace_id;
     herr_t status;
@@ -451,7 +562,7 @@ bool IOUtils::savePhaseGram(const std::string &filename, const std::string &data
     }
 
     // 创建数据空间
-    hsize_t dims[2] {rows, cols};
+    hsize_t dims[2] {static_cast<hsize_t>(reconsPhase.shape(0)), static_cast<hsize_t>(reconsPhase.shape(1))};
     dataspace_id = H5Screate_simple(2, dims, nullptr);
     if (dataspace_id < 0) {
         std::cerr << "Error creating dataspace" << std::endl;
@@ -537,6 +648,7 @@ bool IOUtils::save3DGrams(const std::string &filename, const std::string &datase
 bool IOUtils::read3DimData(const std::string &filename, const std::string &datasetName,
                            FArray &data, hsize_t offset, hsize_t count, MPI_Comm comm)
 {
+    TRACE_SCOPE("read3DimData", "io");
     int rank, size;
     MPI_Comm_rank(comm, &rank);
     MPI_Comm_size(comm, &size);
@@ -598,6 +710,7 @@ bool IOUtils::read3DimData(const std::string &filename, const std::string &datas
 bool IOUtils::read3DimData(const std::string &filename, const std::string &datasetName,
                            U16Array &data, hsize_t offset, hsize_t count)
 {
+    TRACE_SCOPE("read3DimData", "io");
     hid_t file_id = H5I_INVALID_HID;
     hid_t dset_id = H5I_INVALID_HID;
     hid_t filespace = H5I_INVALID_HID;
@@ -650,6 +763,7 @@ bool IOUtils::read3DimData(const std::string &filename, const std::string &datas
 bool IOUtils::read4DimData(const std::string &filename, const std::string &datasetName,
                            U16Array &data, hsize_t offset, hsize_t count)
 {
+    TRACE_SCOPE("read4DimData", "io");
     hid_t file_id = H5I_INVALID_HID;
     hid_t dset_id = H5I_INVALID_HID;
     hid_t filespace = H5I_INVALID_HID;
@@ -699,9 +813,62 @@ bool IOUtils::read4DimData(const std::string &filename, const std::string &datas
     return true;
 }
 
+// Read a rows x cols window of all holograms of one angle, used by the tiled reconstruction
+bool IOUtils::read4DimTile(const std::string &filename, const std::string &datasetName, float *data, hsize_t angle,
+                           hsize_t row, hsize_t col, hsize_t rows, hsize_t cols)
+{
+    TRACE_SCOPE("read4DimTile", "io");
+    hid_t file_id = H5I_INVALID_HID;
+    hid_t dset_id = H5I_INVALID_HID;
+    hid_t filespace = H5I_INVALID_HID;
+    hid_t memspace = H5I_INVALID_HID;
+    bool status = true;
+
+    try {
+        file_id = H5Fopen(filename.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+        if (file_id < 0) throw std::runtime_error("Cannot open file");
+
+        dset_id = H5Dopen2(file_id, datasetName.c_str(), H5P_DEFAULT);
+        if (dset_id < 0) throw std::runtime_error("Cannot open dataset");
+
+        filespace = H5Dget_space(dset_id);
+        if (filespace < 0) throw std::runtime_error("Cannot get dataspace");
+
+        hsize_t dims[4];
+        if (H5Sget_simple_extent_ndims(filespace) != 4) throw std::runtime_error("Dataset is not 4-dimensional");
+        H5Sget_simple_extent_dims(filespace, dims, NULL);
+        if (angle >= dims[0] || row + rows > dims[2] || col + cols > dims[3]) {
+            throw std::runtime_error("Tile exceeds dataset dimensions");
+        }
+
+        hsize_t offset_[4] = {angle, 0, row, col};
+        hsize_t count_[4] = {1, dims[1], rows, cols};
+        H5Sselect_hyperslab(filespace, H5S_SELECT_SET, offset_, NULL, count_, NULL);
+
+        memspace = H5Screate_simple(4, count_, NULL);
+        if (memspace < 0) throw std::runtime_error("Cannot create memory space");
+
+        if (H5Dread(dset_id, H5T_NATIVE_FLOAT, memspace, filespace, H5P_DEFAULT, data) < 0) {
+            throw std::runtime_error("Cannot read dataset");
+        }
+
+    } catch(const std::exception &error) {
+        std::cerr << "Error reading tile: " << error.what() << std::endl;
+        status = false;
+    }
+
+    if (memspace >= 0) H5Sclose(memspace);
+    if (filespace >= 0) H5Sclose(filespace);
+    if (dset_id >= 0) H5Dclose(dset_id);
+    if (file_id >= 0) H5Fclose(file_id);
+
+    return status;
+}
+
 bool IOUtils::read4DimData(const std::string &filename, const std::string &datasetName,
                            FArray &data, hsize_t offset, hsize_t count, MPI_Comm comm)
 {
+    TRACE_SCOPE("read4DimData", "io");
     int rank, size;
     MPI_Comm_rank(comm, &rank);
     MPI_Comm_size(comm, &size);
@@ -763,6 +930,7 @@ bool IOUtils::read4DimData(const std::string &filename, const std::string &datas
 bool IOUtils::read4DimData(const std::string &filename, const std::string &datasetName,
                            U16Array &data, hsize_t offset, hsize_t count, MPI_Comm comm)
 {
+    TRACE_SCOPE("read4DimData", "io");
     int rank, size;
     MPI_Comm_rank(comm, &rank);
     MPI_Comm_size(comm, &size);
@@ -821,12 +989,102 @@ bool IOUtils::read4DimData(const std::string &filename, const std::string &datas
     return true;
 }
 
-bool IOUtils::createFileDataset(const std::string &filename, const std::string &datasetName, const std::vector<hsize_t> &dims, MPI_Comm comm)
+bool IOUtils::createFileDataset(const std::string &filename, const std::string &datasetName, const std::vector<hsize_t> &dims,
+                                MPI_Comm comm, bool resume)
 {
+    TRACE_SCOPE("createFileDataset", "io");
     int rank, size;
     MPI_Comm_rank(comm, &rank);
     MPI_Comm_size(comm, &size);
 
+    hid_t file_id = H5I_INVALID_HID;
+    hid_t dset_id = H5I_INVALID_HID;
+    hid_t done_id = H5I_INVALID_HID;
+    hid_t filespace = H5I_INVALID_HID;
+    hid_t plist_id = H5I_INVALID_HID;
+    hid_t dcpl_id = H5I_INVALID_HID;
+    std::string progressName = datasetName + "_done";
+
+    try {
+        // Create and set parallel access properties
+        plist_id = H5Pcreate(H5P_FILE_ACCESS);
+        H5Pset_fapl_mpio(plist_id, comm, MPI_INFO_NULL);
+
+        // Only rank 0 probes the file so that all processes agree on reopening it
+        int exists = 0;
+        if (resume && rank == 0) {
+            H5E_BEGIN_TRY {
+                exists = H5Fis_hdf5(filename.c_str()) > 0 ? 1 : 0;
+            } H5E_END_TRY;
+        }
+        MPI_Bcast(&exists, 1, MPI_INT, 0, comm);
+
+        // All processes participate in file creation or reopening
+        if (exists) {
+            file_id = H5Fopen(filename.c_str(), H5F_ACC_RDWR, plist_id);
+            if (file_id < 0) throw std::runtime_error("Cannot open file");
+        } else {
+            file_id = H5Fcreate(filename.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, plist_id);
+            if (file_id < 0) throw std::runtime_error("Cannot create file");
+        }
+
+        if (exists && H5Lexists(file_id, datasetName.c_str(), H5P_DEFAULT) > 0) {
+            // Previous output must have the same shape, otherwise its progress is meaningless
+            dset_id = H5Dopen2(file_id, datasetName.c_str(), H5P_DEFAULT);
+            if (dset_id < 0) throw std::runtime_error("Cannot open dataset");
+            filespace = H5Dget_space(dset_id);
+            std::vector<hsize_t> oldDims(H5Sget_simple_extent_ndims(filespace));
+            H5Sget_simple_extent_dims(filespace, oldDims.data(), NULL);
+            if (oldDims != dims) throw std::runtime_error("Existing dataset has different dimensions");
+        } else {
+            // Create file space
+            filespace = H5Screate_simple(dims.size(), dims.data(), NULL);
+            if (filespace < 0) throw std::runtime_error("Cannot create file space");
+
+            // Create dataset
+            dset_id = H5Dcreate2(file_id, datasetName.c_str(), H5T_NATIVE_FLOAT, filespace,
+                                H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+            if (dset_id < 0) throw std::runtime_error("Cannot create dataset");
+        }
+
+        // One flag per slice of the first dimension, filled with zeros when created
+        if (resume && !(exists && H5Lexists(file_id, progressName.c_str(), H5P_DEFAULT) > 0)) {
+            H5Sclose(filespace);
+            filespace = H5Screate_simple(1, dims.data(), NULL);
+            uint8_t fill = 0;
+            dcpl_id = H5Pcreate(H5P_DATASET_CREATE);
+            H5Pset_fill_value(dcpl_id, H5T_NATIVE_UINT8, &fill);
+            done_id = H5Dcreate2(file_id, progressName.c_str(), H5T_NATIVE_UINT8, filespace,
+                                 H5P_DEFAULT, dcpl_id, H5P_DEFAULT);
+            if (done_id < 0) throw std::runtime_error("Cannot create progress dataset");
+        }
+
+        if (rank == 0 && exists) {
+            std::cout << "Resuming output " << filename << ":" << datasetName << std::endl;
+        }
+
+    } catch(const std::exception &error) {
+        std::cerr << "Process " << rank << " Error creating dataset: " << error.what() << std::endl;
+        MPI_Abort(comm, 1);
+    }
+
+    // Clean up resources
+    if (dcpl_id >= 0) H5Pclose(dcpl_id);
+    if (filespace >= 0) H5Sclose(filespace);
+    if (done_id >= 0) H5Dclose(done_id);
+    if (dset_id >= 0) H5Dclose(dset_id);
+    if (file_id >= 0) H5Fclose(file_id);
+    if (plist_id >= 0) H5Pclose(plist_id);
+
+    return true;
+}
+
+bool IOUtils::addFileDataset(const std::string &filename, const std::string &datasetName, const std::vector<hsize_t> &dims,
+                             hid_t type, MPI_Comm comm)
+{
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+
     hid_t file_id = H5I_INVALID_HID;
     hid_t dset_id = H5I_INVALID_HID;
     hid_t filespace = H5I_INVALID_HID;
@@ -837,17 +1095,14 @@ bool IOUtils::createFileDataset(const std::string &filename, const std::string &
         plist_id = H5Pcreate(H5P_FILE_ACCESS);
         H5Pset_fapl_mpio(plist_id, comm, MPI_INFO_NULL);
 
-        // All processes participate in file creation
-        file_id = H5Fcreate(filename.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, plist_id);
-        if (file_id < 0) throw std::runtime_error("Cannot create file");
+        // The file is kept, only a new dataset is added
+        file_id = H5Fopen(filename.c_str(), H5F_ACC_RDWR, plist_id);
+        if (file_id < 0) throw std::runtime_error("Cannot open file");
 
-        // Create file space
         filespace = H5Screate_simple(dims.size(), dims.data(), NULL);
         if (filespace < 0) throw std::runtime_error("Cannot create file space");
 
-        // Create dataset
-        dset_id = H5Dcreate2(file_id, datasetName.c_str(), H5T_NATIVE_FLOAT, filespace,
-                            H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+        dset_id = H5Dcreate2(file_id, datasetName.c_str(), type, filespace, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
         if (dset_id < 0) throw std::runtime_error("Cannot create dataset");
 
     } catch(const std::exception &error) {
@@ -864,12 +1119,54 @@ bool IOUtils::createFileDataset(const std::string &filename, const std::string &
     return true;
 }
 
-bool IOUtils::write3DimData(const std::string &filename, const std::string &datasetName, const FArray &data, 
-                            const std::vector<hsize_t> &dims, hsize_t offset, MPI_Comm comm)
+bool IOUtils::readProgress(const std::string &filename, const std::string &datasetName, U8Array &done, MPI_Comm comm)
 {
-    int rank, size;
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+
+    hid_t file_id = H5I_INVALID_HID;
+    hid_t dset_id = H5I_INVALID_HID;
+    hid_t filespace = H5I_INVALID_HID;
+    hid_t plist_id = H5I_INVALID_HID;
+
+    try {
+        // Create and set parallel access properties
+        plist_id = H5Pcreate(H5P_FILE_ACCESS);
+        H5Pset_fapl_mpio(plist_id, comm, MPI_INFO_NULL);
+
+        file_id = H5Fopen(filename.c_str(), H5F_ACC_RDONLY, plist_id);
+        if (file_id < 0) throw std::runtime_error("Cannot open file");
+        dset_id = H5Dopen2(file_id, (datasetName + "_done").c_str(), H5P_DEFAULT);
+        if (dset_id < 0) throw std::runtime_error("Cannot open progress dataset");
+
+        // The flags are small, every process reads all of them independently
+        filespace = H5Dget_space(dset_id);
+        hsize_t length;
+        H5Sget_simple_extent_dims(filespace, &length, NULL);
+        done.resize(length);
+        if (H5Dread(dset_id, H5T_NATIVE_UINT8, H5S_ALL, H5S_ALL, H5P_DEFAULT, done.data()) < 0) {
+            throw std::runtime_error("Cannot read progress dataset");
+        }
+
+    } catch(const std::exception &error) {
+        std::cerr << "Process " << rank << " Error reading progress: " << error.what() << std::endl;
+        MPI_Abort(comm, 1);
+    }
+
+    // Clean up resources
+    if (filespace >= 0) H5Sclose(filespace);
+    if (dset_id >= 0) H5Dclose(dset_id);
+    if (file_id >= 0) H5Fclose(file_id);
+    if (plist_id >= 0) H5Pclose(plist_id);
+
+    return true;
+}
+
+bool IOUtils::markProgress(const std::string &filename, const std::string &datasetName, hsize_t offset, hsize_t count, MPI_Comm comm)
+{
+    TRACE_SCOPE("markProgress", "io");
+    int rank;
     MPI_Comm_rank(comm, &rank);
-    MPI_Comm_size(comm, &size);
 
     hid_t file_id = H5I_INVALID_HID;
     hid_t dset_id = H5I_INVALID_HID;
@@ -883,37 +1180,27 @@ bool IOUtils::write3DimData(const std::string &filename, const std::string &data
         plist_id = H5Pcreate(H5P_FILE_ACCESS);
         H5Pset_fapl_mpio(plist_id, comm, MPI_INFO_NULL);
 
-        // Open existing file
         file_id = H5Fopen(filename.c_str(), H5F_ACC_RDWR, plist_id);
         if (file_id < 0) throw std::runtime_error("Cannot open file");
-        
-        // Open existing dataset
-        dset_id = H5Dopen2(file_id, datasetName.c_str(), H5P_DEFAULT);
-        if (dset_id < 0) throw std::runtime_error("Cannot open dataset");
-        
-        // Set write region
+        dset_id = H5Dopen2(file_id, (datasetName + "_done").c_str(), H5P_DEFAULT);
+        if (dset_id < 0) throw std::runtime_error("Cannot open progress dataset");
+
+        // Flag slices [offset, offset + count), called after their data is written
         filespace = H5Dget_space(dset_id);
-        if (filespace < 0) throw std::runtime_error("Cannot get file space");
-        
-        hsize_t count_[3] = {data.size() / (dims[1] * dims[2]), dims[1], dims[2]};
-        hsize_t offset_[3] = {offset, 0, 0};
-        H5Sselect_hyperslab(filespace, H5S_SELECT_SET, offset_, NULL, count_, NULL);
-        
-        // Create memory space
-        memspace = H5Screate_simple(3, count_, NULL);
-        if (memspace < 0) throw std::runtime_error("Cannot create memory space");
-        
+        H5Sselect_hyperslab(filespace, H5S_SELECT_SET, &offset, NULL, &count, NULL);
+        memspace = H5Screate_simple(1, &count, NULL);
+        U8Array flags(count, 1);
+
         // Set collective data transfer properties
         xfer_plist = H5Pcreate(H5P_DATASET_XFER);
         H5Pset_dxpl_mpio(xfer_plist, H5FD_MPIO_COLLECTIVE);
-        
-        // Write data
-        if (H5Dwrite(dset_id, H5T_NATIVE_FLOAT, memspace, filespace, xfer_plist, data.data()) < 0) {
-            throw std::runtime_error("Cannot write dataset");
+
+        if (H5Dwrite(dset_id, H5T_NATIVE_UINT8, memspace, filespace, xfer_plist, flags.data()) < 0) {
+            throw std::runtime_error("Cannot write progress dataset");
         }
-        
+
     } catch(const std::exception &error) {
-        std::cerr << "Process " << rank << " Error writing dataset: " << error.what() << std::endl;
+        std::cerr << "Process " << rank << " Error writing progress: " << error.what() << std::endl;
         MPI_Abort(comm, 1);
     }
 
@@ -928,9 +1215,11 @@ bool IOUtils::write3DimData(const std::string &filename, const std::string &data
     return true;
 }
 
-bool IOUtils::write4DimData(const std::string &filename, const std::string &datasetName, const FArray &data, 
-                            const std::vector<hsize_t> &dims, hsize_t offset, MPI_Comm comm)
+// Collective write of slices [offset, offset + slices) of the first dimension, a process without slices selects nothing
+static bool writeSlices(const std::string &filename, const std::string &datasetName, const void *data, hid_t memType,
+                        hsize_t slices, const std::vector<hsize_t> &dims, hsize_t offset, MPI_Comm comm)
 {
+    TRACE_SCOPE("writeSlices", "io");
     int rank, size;
     MPI_Comm_rank(comm, &rank);
     MPI_Comm_size(comm, &size);
@@ -959,20 +1248,27 @@ bool IOUtils::write4DimData(const std::string &filename, const std::string &data
         filespace = H5Dget_space(dset_id);
         if (filespace < 0) throw std::runtime_error("Cannot get file space");
         
-        hsize_t count_[4] = {data.size() / (dims[1] * dims[2] * dims[3]), dims[1], dims[2], dims[3]};
-        hsize_t offset_[4] = {offset, 0, 0, 0};
-        H5Sselect_hyperslab(filespace, H5S_SELECT_SET, offset_, NULL, count_, NULL);
+        std::vector<hsize_t> count_ = dims;
+        std::vector<hsize_t> offset_(dims.size(), 0);
+        count_[0] = slices;
+        offset_[0] = offset;
         
         // Create memory space
-        memspace = H5Screate_simple(4, count_, NULL);
+        memspace = H5Screate_simple(dims.size(), count_.data(), NULL);
         if (memspace < 0) throw std::runtime_error("Cannot create memory space");
+        if (slices > 0) {
+            H5Sselect_hyperslab(filespace, H5S_SELECT_SET, offset_.data(), NULL, count_.data(), NULL);
+        } else {
+            H5Sselect_none(filespace);
+            H5Sselect_none(memspace);
+        }
         
         // Set collective data transfer properties
         xfer_plist = H5Pcreate(H5P_DATASET_XFER);
         H5Pset_dxpl_mpio(xfer_plist, H5FD_MPIO_COLLECTIVE);
         
         // Write data
-        if (H5Dwrite(dset_id, H5T_NATIVE_FLOAT, memspace, filespace, xfer_plist, data.data()) < 0) {
+        if (H5Dwrite(dset_id, memType, memspace, filespace, xfer_plist, data) < 0) {
             throw std::runtime_error("Cannot write dataset");
         }
         
@@ -990,4 +1286,267 @@ bool IOUtils::write4DimData(const std::string &filename, const std::string &data
     if (plist_id >= 0) H5Pclose(plist_id);
 
     return true;
-}
\ No newline at end of file
+}
+
+bool IOUtils::write3DimData(const std::string &filename, const std::string &datasetName, const FArray &data, 
+                            const std::vector<hsize_t> &dims, hsize_t offset, MPI_Comm comm)
+{
+    return writeSlices(filename, datasetName, data.data(), H5T_NATIVE_FLOAT, data.size() / (dims[1] * dims[2]), dims, offset, comm);
+}
+
+bool IOUtils::write3DimData(const std::string &filename, const std::string &datasetName, const U16Array &data, 
+                            const std::vector<hsize_t> &dims, hsize_t offset, MPI_Comm comm)
+{
+    return writeSlices(filename, datasetName, data.data(), H5T_NATIVE_UINT16, data.size() / (dims[1] * dims[2]), dims, offset, comm);
+}
+
+bool IOUtils::write3DimData(const std::string &filename, const std::string &datasetName, const FTensorView &data,
+                            const std::vector<hsize_t> &dims, hsize_t offset, MPI_Comm comm)
+{
+    return writeSlices(filename, datasetName, data.data(), H5T_NATIVE_FLOAT, data.empty() ? 0 : data.shape(0), dims, offset, comm);
+}
+
+bool IOUtils::write4DimData(const std::string &filename, const std::string &datasetName, const FArray &data, 
+                            const std::vector<hsize_t> &dims, hsize_t offset, MPI_Comm comm)
+{
+    return writeSlices(filename, datasetName, data.data(), H5T_NATIVE_FLOAT, data.size() / (dims[1] * dims[2] * dims[3]),
+                       dims, offset, comm);
+}
+
+bool IOUtils::write4DimData(const std::string &filename, const std::string &datasetName, const U16Array &data, 
+                            const std::vector<hsize_t> &dims, hsize_t offset, MPI_Comm comm)
+{
+    return writeSlices(filename, datasetName, data.data(), H5T_NATIVE_UINT16, data.size() / (dims[1] * dims[2] * dims[3]),
+                       dims, offset, comm);
+}
+
+bool IOUtils::writeTrace(const std::string &filename, MPI_Comm comm)
+{
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    std::string fragment = TraceUtils::events();
+    int length = static_cast<int>(fragment.size());
+    IntArray lengths(size), displs(size, 0);
+    MPI_Gather(&length, 1, MPI_INT, lengths.data(), 1, MPI_INT, 0, comm);
+
+    std::string all;
+    if (rank == 0) {
+        for (int r = 1; r < size; r++) {
+            displs[r] = displs[r - 1] + lengths[r - 1];
+        }
+        all.resize(displs[size - 1] + lengths[size - 1]);
+    }
+    MPI_Gatherv(fragment.data(), length, MPI_CHAR, &all[0], lengths.data(), displs.data(), MPI_CHAR, 0, comm);
+
+    // Rank 0 reports the result to all processes
+    int success = 1;
+    if (rank == 0) {
+        std::vector<std::string> fragments;
+        for (int r = 0; r < size; r++) {
+            fragments.push_back(all.substr(displs[r], lengths[r]));
+        }
+        success = TraceUtils::writeTrace(filename, fragments) ? 1 : 0;
+        if (!success) {
+            std::cerr << "Error writing trace file: " << filename << std::endl;
+        }
+    }
+    MPI_Bcast(&success, 1, MPI_INT, 0, comm);
+
+    return success == 1;
+}
+
+void IOUtils::reduceReport(PerfUtils::PerfReport &report, MPI_Comm comm)
+{
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+
+    // Processes which skipped work may miss stages, the stage list of the process with most stages is used by all
+    int local[2] = {static_cast<int>(report.stages.size()), rank}, owner[2];
+    MPI_Allreduce(local, owner, 1, MPI_2INT, MPI_MAXLOC, comm);
+    std::string names;
+    for (const auto &stage: report.stages) {
+        names += stage.name + '\n';
+    }
+    int length = static_cast<int>(names.size());
+    MPI_Bcast(&length, 1, MPI_INT, owner[1], comm);
+    names.resize(length);
+    MPI_Bcast(&names[0], length, MPI_CHAR, owner[1], comm);
+
+    PerfUtils::PerfReport ordered;
+    size_t begin = 0, end;
+    while ((end = names.find('\n', begin)) != std::string::npos) {
+        ordered.stage(names.substr(begin, end - begin));
+        begin = end + 1;
+    }
+    ordered.merge(report);
+    report = ordered;
+
+    for (auto &stage: report.stages) {
+        double counts[4] = {stage.bytes, stage.flops, stage.ffts, stage.passes};
+        MPI_Allreduce(MPI_IN_PLACE, counts, 4, MPI_DOUBLE, MPI_SUM, comm);
+        MPI_Allreduce(MPI_IN_PLACE, &stage.seconds, 1, MPI_DOUBLE, MPI_MAX, comm);
+        stage.bytes = counts[0];
+        stage.flops = counts[1];
+        stage.ffts = counts[2];
+        stage.passes = counts[3];
+    }
+}
+
+bool IOUtils::openStreamDataset(const std::string &filename, const std::string &datasetName, hid_t &file_id, hid_t &dataset_id)
+{
+    // The file or dataset may not exist yet while the acquisition starts, so no error stack is printed
+    file_id = H5I_INVALID_HID;
+    dataset_id = H5I_INVALID_HID;
+    H5E_BEGIN_TRY {
+        file_id = H5Fopen(filename.c_str(), H5F_ACC_RDONLY | H5F_ACC_SWMR_READ, H5P_DEFAULT);
+        if (file_id >= 0) {
+            dataset_id = H5Dopen2(file_id, datasetName.c_str(), H5P_DEFAULT);
+        }
+    } H5E_END_TRY;
+
+    if (dataset_id < 0) {
+        closeStreamDataset(file_id, dataset_id);
+        return false;
+    }
+
+    return true;
+}
+
+bool IOUtils::readStreamDims(hid_t dataset_id, std::vector<hsize_t> &dims)
+{
+    // Loads the metadata the writer flushed since the last call, the extent included
+    if (H5Drefresh(dataset_id) < 0) {
+        std::cerr << "Error refreshing stream dataset" << std::endl;
+        return false;
+    }
+
+    hid_t dataspace_id = H5Dget_space(dataset_id);
+    dims.resize(H5Sget_simple_extent_ndims(dataspace_id));
+    H5Sget_simple_extent_dims(dataspace_id, dims.data(), nullptr);
+    H5Sclose(dataspace_id);
+
+    return true;
+}
+
+bool IOUtils::readStreamSlices(hid_t dataset_id, FArray &data, hsize_t offset, hsize_t count)
+{
+    TRACE_SCOPE("readStreamSlices", "io");
+    // Slices [offset, offset + count) of the first dimension, all of the remaining ones
+    hid_t filespace = H5Dget_space(dataset_id);
+    std::vector<hsize_t> dims(H5Sget_simple_extent_ndims(filespace));
+    H5Sget_simple_extent_dims(filespace, dims.data(), nullptr);
+    if (offset + count > dims[0]) {
+        std::cerr << "Error: slices beyond the current extent of the stream dataset" << std::endl;
+        H5Sclose(filespace);
+        return false;
+    }
+
+    std::vector<hsize_t> offset_(dims.size(), 0), count_ = dims;
+    offset_[0] = offset;
+    count_[0] = count;
+    H5Sselect_hyperslab(filespace, H5S_SELECT_SET, offset_.data(), nullptr, count_.data(), nullptr);
+    hid_t memspace = H5Screate_simple(count_.size(), count_.data(), nullptr);
+
+    hsize_t elements = 1;
+    for (auto extent: count_) elements *= extent;
+    data.resize(elements);
+    herr_t status = H5Dread(dataset_id, H5T_NATIVE_FLOAT, memspace, filespace, H5P_DEFAULT, data.data());
+    if (status < 0) {
+        std::cerr << "Error reading stream dataset" << std::endl;
+    }
+
+    H5Sclose(memspace);
+    H5Sclose(filespace);
+
+    return status >= 0;
+}
+
+bool IOUtils::createStreamDataset(const std::string &filename, const std::string &datasetName, int rows, int cols,
+                                  hid_t &file_id, hid_t &dataset_id)
+{
+    // SWMR needs the latest file format, the dataset is chunked by slice and unlimited along the first dimension
+    hid_t fapl_id = H5Pcreate(H5P_FILE_ACCESS);
+    H5Pset_libver_bounds(fapl_id, H5F_LIBVER_LATEST, H5F_LIBVER_LATEST);
+    file_id = H5Fcreate(filename.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, fapl_id);
+    H5Pclose(fapl_id);
+    dataset_id = H5I_INVALID_HID;
+    if (file_id < 0) {
+        std::cerr << "Error creating file: " << filename << std::endl;
+        return false;
+    }
+
+    hsize_t dims[3] {0, static_cast<hsize_t>(rows), static_cast<hsize_t>(cols)};
+    hsize_t maxDims[3] {H5S_UNLIMITED, dims[1], dims[2]};
+    hsize_t chunk[3] {1, dims[1], dims[2]};
+    hid_t dataspace_id = H5Screate_simple(3, dims, maxDims);
+    hid_t dcpl_id = H5Pcreate(H5P_DATASET_CREATE);
+    H5Pset_chunk(dcpl_id, 3, chunk);
+
+    dataset_id = H5Dcreate2(file_id, datasetName.c_str(), H5T_NATIVE_FLOAT, dataspace_id, H5P_DEFAULT, dcpl_id, H5P_DEFAULT);
+    H5Pclose(dcpl_id);
+    H5Sclose(dataspace_id);
+    if (dataset_id < 0) {
+        std::cerr << "Error creating dataset: " << datasetName << std::endl;
+        H5Fclose(file_id);
+        file_id = H5I_INVALID_HID;
+        return false;
+    }
+
+    // All objects exist now, from here on readers may attach while this process stays the only writer
+    if (H5Fstart_swmr_write(file_id) < 0) {
+        std::cerr << "Error starting SWMR write mode: " << filename << std::endl;
+        closeStreamDataset(file_id, dataset_id);
+        return false;
+    }
+
+    return true;
+}
+
+bool IOUtils::appendStreamSlices(hid_t dataset_id, const FArray &data, hsize_t offset, int rows, int cols)
+{
+    TRACE_SCOPE("appendStreamSlices", "io");
+    // Grow the dataset when the slices reach beyond its extent
+    hsize_t count[3] {data.size() / (static_cast<hsize_t>(rows) * cols), static_cast<hsize_t>(rows), static_cast<hsize_t>(cols)};
+    hsize_t start[3] {offset, 0, 0};
+    hid_t filespace = H5Dget_space(dataset_id);
+    hsize_t dims[3];
+    H5Sget_simple_extent_dims(filespace, dims, nullptr);
+    if (offset + count[0] > dims[0]) {
+        dims[0] = offset + count[0];
+        H5Dset_extent(dataset_id, dims);
+        H5Sclose(filespace);
+        filespace = H5Dget_space(dataset_id);
+    }
+
+    H5Sselect_hyperslab(filespace, H5S_SELECT_SET, start, nullptr, count, nullptr);
+    hid_t memspace = H5Screate_simple(3, count, nullptr);
+    herr_t status = H5Dwrite(dataset_id, H5T_NATIVE_FLOAT, memspace, filespace, H5P_DEFAULT, data.data());
+    if (status < 0) {
+        std::cerr << "Error writing stream dataset" << std::endl;
+    } else {
+        // Makes the new extent and slices visible to SWMR readers
+        status = H5Dflush(dataset_id);
+        if (status < 0) {
+            std::cerr << "Error flushing stream dataset" << std::endl;
+        }
+    }
+
+    H5Sclose(memspace);
+    H5Sclose(filespace);
+
+    return status >= 0;
+}
+
+void IOUtils::closeStreamDataset(hid_t &file_id, hid_t &dataset_id)
+{
+    if (dataset_id >= 0) {
+        H5Dclose(dataset_id);
+        dataset_id = H5I_INVALID_HID;
+    }
+    if (file_id >= 0) {
+        H5Fclose(file_id);
+        file_id = H5I_INVALID_HID;
+    }
+}
@@ -0,0 +1,238 @@
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+#include "perf_utils.h"
+
+namespace PerfUtils
+{
+    double Stage::bandwidth() const
+    {
+        return seconds > 0.0 ? bytes / seconds * 1e-9 : 0.0;
+    }
+
+    double Stage::flopRate() const
+    {
+        return seconds > 0.0 ? flops / seconds * 1e-9 : 0.0;
+    }
+
+    double Stage::fftRate() const
+    {
+        return seconds > 0.0 ? ffts / seconds : 0.0;
+    }
+
+    Stage &PerfReport::stage(const std::string &name)
+    {
+        for (auto &existing: stages) {
+            if (existing.name == name)
+                return existing;
+        }
+        stages.push_back(Stage());
+        stages.back().name = name;
+        return stages.back();
+    }
+
+    Stage PerfReport::total() const
+    {
+        Stage sum;
+        sum.name = "total";
+        for (const auto &stage: stages) {
+            sum.bytes += stage.bytes;
+            sum.flops += stage.flops;
+            sum.ffts += stage.ffts;
+            sum.passes += stage.passes;
+            sum.seconds += stage.seconds;
+        }
+        return sum;
+    }
+
+    void PerfReport::merge(const PerfReport &report)
+    {
+        for (const auto &other: report.stages) {
+            Stage &own = stage(other.name);
+            own.bytes += other.bytes;
+            own.flops += other.flops;
+            own.ffts += other.ffts;
+            own.passes += other.passes;
+            own.seconds += other.seconds;
+            if (own.fftSize.empty())
+                own.fftSize = other.fftSize;
+        }
+    }
+
+    static void writeStage(std::ostream &os, const Stage &stage)
+    {
+        os << "{\"name\": \"" << stage.name << "\", \"seconds\": " << stage.seconds << ", \"bytes\": " << stage.bytes
+           << ", \"flops\": " << stage.flops << ", \"ffts\": " << stage.ffts << ", \"fft_size\": [";
+        for (size_t i = 0; i < stage.fftSize.size(); i++) {
+            os << (i ? ", " : "") << stage.fftSize[i];
+        }
+        os << "], \"passes\": " << stage.passes << ", \"gb_per_s\": " << stage.bandwidth() << ", \"gflop_per_s\": "
+           << stage.flopRate() << ", \"ffts_per_s\": " << stage.fftRate() << "}";
+    }
+
+    std::string PerfReport::toJson() const
+    {
+        std::ostringstream os;
+        os << std::setprecision(6) << "{\"stages\": [";
+        for (size_t i = 0; i < stages.size(); i++) {
+            if (i)
+                os << ", ";
+            writeStage(os, stages[i]);
+        }
+        os << "], \"total\": ";
+        writeStage(os, total());
+        os << "}";
+        return os.str();
+    }
+
+    void PerfReport::print(std::ostream &os) const
+    {
+        std::ios state(nullptr);
+        state.copyfmt(os);
+        os << std::left << std::setw(10) << "stage" << std::right << std::setw(10) << "seconds" << std::setw(10) << "GB"
+           << std::setw(10) << "GB/s" << std::setw(10) << "GFLOP" << std::setw(10) << "GFLOP/s" << std::setw(10) << "FFTs"
+           << std::setw(12) << "FFTs/s" << std::setw(10) << "passes" << std::endl;
+
+        auto printStage = [&os](const Stage &stage) {
+            os << std::left << std::setw(10) << stage.name << std::right << std::fixed << std::setprecision(3)
+               << std::setw(10) << stage.seconds << std::setw(10) << stage.bytes * 1e-9 << std::setw(10) << stage.bandwidth()
+               << std::setw(10) << stage.flops * 1e-9 << std::setw(10) << stage.flopRate() << std::setprecision(0)
+               << std::setw(10) << stage.ffts << std::setw(12) << stage.fftRate() << std::setw(10) << stage.passes << std::endl;
+        };
+        for (const auto &stage: stages) {
+            printStage(stage);
+        }
+        printStage(total());
+        os.copyfmt(state);
+    }
+
+    void addFFTs(Stage &stage, const IntArray &size, double count)
+    {
+        double points = static_cast<double>(size[0]) * size[1];
+        stage.ffts += count;
+        stage.flops += count * 5.0 * points * std::log2(points);
+        stage.bytes += count * 2.0 * sizeof(cuFloatComplex) * points;
+        stage.fftSize = size;
+    }
+
+    void addPasses(Stage &stage, double elements, double bytesPerElement, double flopsPerElement, double count)
+    {
+        stage.passes += count;
+        stage.bytes += count * elements * bytesPerElement;
+        stage.flops += count * elements * flopsPerElement;
+    }
+
+    // Host transfer and padding of the input images of a batch
+    static void addUpload(PerfReport &report, const IntArray &imSize, const IntArray &newSize, int batchSize, double images)
+    {
+        double pixels = static_cast<double>(imSize[0]) * imSize[1];
+        report.stage("upload").bytes += images * batchSize * pixels * sizeof(float);
+        if (newSize != imSize) {
+            addPasses(report.stage("padding"), static_cast<double>(newSize[0]) * newSize[1], 2 * sizeof(float), 0.0, images * batchSize);
+        }
+    }
+
+    // Cropping and host transfer of the phases of a batch
+    static void addDownload(PerfReport &report, const IntArray &imSize, const IntArray &newSize, int batchSize)
+    {
+        double pixels = static_cast<double>(imSize[0]) * imSize[1];
+        if (newSize != imSize) {
+            addPasses(report.stage("crop"), pixels, 2 * sizeof(float), 0.0, batchSize);
+        }
+        report.stage("download").bytes += batchSize * pixels * sizeof(float);
+    }
+
+    void addCTFBatch(PerfReport &report, const IntArray &imSize, const IntArray &newSize, int numImages, int batchSize)
+    {
+        addUpload(report, imSize, newSize, batchSize, numImages);
+
+        // Passes of CUDAUtils::ctf_recons_kernel, per hologram and per angle
+        double points = static_cast<double>(newSize[0]) * newSize[1];
+        double images = static_cast<double>(batchSize) * numImages;
+        Stage &ctf = report.stage("ctf");
+        addPasses(ctf, points, 4.0, 2.0, images);
+        addPasses(ctf, points, 8.0, 2.0, images);
+        addPasses(ctf, points, 12.0, 0.0, images);
+        addPasses(ctf, points, 20.0, 2.0, images);
+        addPasses(ctf, points, 24.0, 2.0, images);
+        addPasses(ctf, points, 12.0, 2.0, images);
+        addFFTs(ctf, newSize, images + batchSize);
+
+        // Weights copy, initialisation, regularisation, division and extraction of the phase
+        addPasses(ctf, points, 8.0, 0.0, batchSize);
+        addPasses(ctf, points, 12.0, 0.0, batchSize);
+        addPasses(ctf, points, 8.0, 1.0, batchSize);
+        addPasses(ctf, points, 12.0, 1.0, batchSize);
+        addPasses(ctf, points, 20.0, 2.0, batchSize);
+        addPasses(ctf, points, 12.0, 0.0, batchSize);
+
+        addDownload(report, imSize, newSize, batchSize);
+    }
+
+    // Propagation, amplitude constraint and back propagation of count PMagnitudeCons::projectStep calls on b images
+    static void addMagnitudeStep(Stage &stage, const IntArray &size, int b, double count)
+    {
+        double points = static_cast<double>(size[0]) * size[1];
+        addFFTs(stage, size, count * 2 * (b + 1));
+        addPasses(stage, b * points, 24.0, 6.0, count);
+        addPasses(stage, b * points, 12.0, 3.0, count);
+        addPasses(stage, b * points, 24.0, 4.0, count);
+        addPasses(stage, b * points + points, 16.0, 8.0, count);
+    }
+
+    void addIterBatch(PerfReport &report, const IntArray &imSize, const IntArray &newSize, int numImages, int batchSize, int iterations,
+                      ProjectionSolver::Algorithm algorithm, PMagnitudeCons::Type projectionType, bool multiObject, bool initialPhase)
+    {
+        addUpload(report, imSize, newSize, batchSize, numImages + (initialPhase ? 1 : 0));
+
+        double points = static_cast<double>(newSize[0]) * newSize[1];
+        Stage &init = report.stage("init");
+        addPasses(init, numImages * points, 8.0, 1.0, batchSize);
+        addPasses(init, points, initialPhase ? 12.0 : 8.0, initialPhase ? 2.0 : 0.0, batchSize);
+
+        // ProjectionSolver::execute projects once more after the last iteration
+        double projections = static_cast<double>(batchSize) * (iterations + 1);
+        Stage &solver = report.stage("solver");
+        if (projectionType == PMagnitudeCons::Averaged) {
+            addMagnitudeStep(solver, newSize, numImages, projections);
+            addPasses(solver, points, 16.0, 2.0, projections);
+        } else if (projectionType == PMagnitudeCons::Sequential) {
+            addMagnitudeStep(solver, newSize, 1, projections * numImages);
+        } else {
+            addMagnitudeStep(solver, newSize, 1, projections);
+        }
+        // Copies of the wave field into and out of the projectors
+        addPasses(solver, points, 16.0, 0.0, 3.0 * projections);
+        addPasses(solver, points, 16.0, 4.0, (multiObject ? 3.0 : 1.0) * projections);
+
+        // Elementwise wave field arithmetic of the update rule, reflections included
+        int updatePasses = 1;
+        if (algorithm == ProjectionSolver::RAAR || algorithm == ProjectionSolver::DRAP) {
+            updatePasses = 6;
+        } else if (algorithm == ProjectionSolver::HIO) {
+            updatePasses = 7;
+        }
+        addPasses(solver, points, 24.0, 2.0, static_cast<double>(batchSize) * iterations * updatePasses);
+        addPasses(solver, points, 12.0, 1.0, batchSize);
+
+        addDownload(report, imSize, newSize, batchSize);
+    }
+
+    StageTimer::StageTimer(PerfReport *perfReport): report(perfReport)
+    {
+        if (report) {
+            cudaDeviceSynchronize();
+            last = std::chrono::steady_clock::now();
+        }
+    }
+
+    void StageTimer::lap(const std::string &name)
+    {
+        if (!report)
+            return;
+        cudaDeviceSynchronize();
+        auto now = std::chrono::steady_clock::now();
+        report->stage(name).seconds += std::chrono::duration<double>(now - last).count();
+        last = now;
+    }
+}
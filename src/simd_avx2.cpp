@@ -0,0 +1,68 @@
+// Compiled with -mavx2 -mfma, only called when the CPU supports both
+#include <immintrin.h>
+#define SIMD_ISA AVX2
+#include "simd_kernels.h"
+
+namespace SIMDUtils
+{
+namespace AVX2
+{
+    struct Vec
+    {
+        typedef __m256 Reg;
+        typedef __m256 Mask;
+        static const int width = 8;
+
+        static Reg set(float value) {return _mm256_set1_ps(value);}
+        static Reg load(const float *p) {return _mm256_loadu_ps(p);}
+        static void store(float *p, Reg v) {_mm256_storeu_ps(p, v);}
+        static void loadComplex(const Complex *p, Reg &re, Reg &im)
+        {
+            const float *f = reinterpret_cast<const float*>(p);
+            Reg lo = _mm256_loadu_ps(f);
+            Reg hi = _mm256_loadu_ps(f + 8);
+            // The shuffles work within 128 bit lanes, the permutation restores the element order
+            re = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_shuffle_ps(lo, hi, 0x88)), 0xD8));
+            im = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_shuffle_ps(lo, hi, 0xDD)), 0xD8));
+        }
+        static void storeComplex(Complex *p, Reg re, Reg im)
+        {
+            float *f = reinterpret_cast<float*>(p);
+            Reg lo = _mm256_unpacklo_ps(re, im);
+            Reg hi = _mm256_unpackhi_ps(re, im);
+            _mm256_storeu_ps(f, _mm256_permute2f128_ps(lo, hi, 0x20));
+            _mm256_storeu_ps(f + 8, _mm256_permute2f128_ps(lo, hi, 0x31));
+        }
+
+        static Reg add(Reg a, Reg b) {return _mm256_add_ps(a, b);}
+        static Reg sub(Reg a, Reg b) {return _mm256_sub_ps(a, b);}
+        static Reg mul(Reg a, Reg b) {return _mm256_mul_ps(a, b);}
+        static Reg div(Reg a, Reg b) {return _mm256_div_ps(a, b);}
+        static Reg fma(Reg a, Reg b, Reg c) {return _mm256_fmadd_ps(a, b, c);}
+        static Reg sqrt(Reg a) {return _mm256_sqrt_ps(a);}
+        static Reg abs(Reg a) {return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a);}
+        static Reg min(Reg a, Reg b) {return _mm256_min_ps(b, a);}
+        static Reg max(Reg a, Reg b) {return _mm256_max_ps(b, a);}
+        static Reg round(Reg a) {return _mm256_round_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);}
+        static Reg floor(Reg a) {return _mm256_floor_ps(a);}
+        static Reg copySign(Reg magnitude, Reg sign)
+        {
+            Reg mask = _mm256_set1_ps(-0.0f);
+            return _mm256_or_ps(_mm256_andnot_ps(mask, magnitude), _mm256_and_ps(mask, sign));
+        }
+
+        static Mask lt(Reg a, Reg b) {return _mm256_cmp_ps(a, b, _CMP_LT_OQ);}
+        static Mask gt(Reg a, Reg b) {return _mm256_cmp_ps(a, b, _CMP_GT_OQ);}
+        static Mask ge(Reg a, Reg b) {return _mm256_cmp_ps(a, b, _CMP_GE_OQ);}
+        static Mask eq(Reg a, Reg b) {return _mm256_cmp_ps(a, b, _CMP_EQ_OQ);}
+        static Mask both(Mask a, Mask b) {return _mm256_and_ps(a, b);}
+        static Mask either(Mask a, Mask b) {return _mm256_or_ps(a, b);}
+        static Reg select(Mask m, Reg a, Reg b) {return _mm256_blendv_ps(b, a, m);}
+    };
+
+    const KernelTable &kernels()
+    {
+        return kernelTable<Vec>("avx2");
+    }
+}
+}
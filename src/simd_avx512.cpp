@@ -0,0 +1,72 @@
+// Compiled with -mavx512f -mfma, only called when the CPU supports AVX-512F
+#include <immintrin.h>
+#define SIMD_ISA AVX512
+#include "simd_kernels.h"
+
+namespace SIMDUtils
+{
+namespace AVX512
+{
+    struct Vec
+    {
+        typedef __m512 Reg;
+        typedef __mmask16 Mask;
+        static const int width = 16;
+
+        static Reg set(float value) {return _mm512_set1_ps(value);}
+        static Reg load(const float *p) {return _mm512_loadu_ps(p);}
+        static void store(float *p, Reg v) {_mm512_storeu_ps(p, v);}
+        static void loadComplex(const Complex *p, Reg &re, Reg &im)
+        {
+            const float *f = reinterpret_cast<const float*>(p);
+            Reg lo = _mm512_loadu_ps(f);
+            Reg hi = _mm512_loadu_ps(f + 16);
+            const __m512i even = _mm512_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30);
+            const __m512i odd = _mm512_setr_epi32(1, 3, 5, 7, 9, 11, 13, 15, 17, 19, 21, 23, 25, 27, 29, 31);
+            re = _mm512_permutex2var_ps(lo, even, hi);
+            im = _mm512_permutex2var_ps(lo, odd, hi);
+        }
+        static void storeComplex(Complex *p, Reg re, Reg im)
+        {
+            float *f = reinterpret_cast<float*>(p);
+            const __m512i first = _mm512_setr_epi32(0, 16, 1, 17, 2, 18, 3, 19, 4, 20, 5, 21, 6, 22, 7, 23);
+            const __m512i second = _mm512_setr_epi32(8, 24, 9, 25, 10, 26, 11, 27, 12, 28, 13, 29, 14, 30, 15, 31);
+            _mm512_storeu_ps(f, _mm512_permutex2var_ps(re, first, im));
+            _mm512_storeu_ps(f + 16, _mm512_permutex2var_ps(re, second, im));
+        }
+
+        static Reg add(Reg a, Reg b) {return _mm512_add_ps(a, b);}
+        static Reg sub(Reg a, Reg b) {return _mm512_sub_ps(a, b);}
+        static Reg mul(Reg a, Reg b) {return _mm512_mul_ps(a, b);}
+        static Reg div(Reg a, Reg b) {return _mm512_div_ps(a, b);}
+        static Reg fma(Reg a, Reg b, Reg c) {return _mm512_fmadd_ps(a, b, c);}
+        static Reg sqrt(Reg a) {return _mm512_sqrt_ps(a);}
+        static Reg abs(Reg a) {return _mm512_abs_ps(a);}
+        static Reg min(Reg a, Reg b) {return _mm512_min_ps(b, a);}
+        static Reg max(Reg a, Reg b) {return _mm512_max_ps(b, a);}
+        static Reg round(Reg a) {return _mm512_roundscale_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);}
+        static Reg floor(Reg a) {return _mm512_roundscale_ps(a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);}
+        static Reg copySign(Reg magnitude, Reg sign)
+        {
+            // Bitwise float operations need AVX512DQ, the integer ones only AVX512F
+            const __m512i mask = _mm512_set1_epi32(0x80000000);
+            __m512i bits = _mm512_or_si512(_mm512_andnot_si512(mask, _mm512_castps_si512(magnitude)),
+                                           _mm512_and_si512(mask, _mm512_castps_si512(sign)));
+            return _mm512_castsi512_ps(bits);
+        }
+
+        static Mask lt(Reg a, Reg b) {return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ);}
+        static Mask gt(Reg a, Reg b) {return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ);}
+        static Mask ge(Reg a, Reg b) {return _mm512_cmp_ps_mask(a, b, _CMP_GE_OQ);}
+        static Mask eq(Reg a, Reg b) {return _mm512_cmp_ps_mask(a, b, _CMP_EQ_OQ);}
+        static Mask both(Mask a, Mask b) {return a & b;}
+        static Mask either(Mask a, Mask b) {return a | b;}
+        static Reg select(Mask m, Reg a, Reg b) {return _mm512_mask_blend_ps(m, b, a);}
+    };
+
+    const KernelTable &kernels()
+    {
+        return kernelTable<Vec>("avx512");
+    }
+}
+}
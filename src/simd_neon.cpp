@@ -0,0 +1,60 @@
+// Built on AArch64 only, where Advanced SIMD is always present
+#include <arm_neon.h>
+#define SIMD_ISA NEON
+#include "simd_kernels.h"
+
+namespace SIMDUtils
+{
+namespace NEON
+{
+    struct Vec
+    {
+        typedef float32x4_t Reg;
+        typedef uint32x4_t Mask;
+        static const int width = 4;
+
+        static Reg set(float value) {return vdupq_n_f32(value);}
+        static Reg load(const float *p) {return vld1q_f32(p);}
+        static void store(float *p, Reg v) {vst1q_f32(p, v);}
+        static void loadComplex(const Complex *p, Reg &re, Reg &im)
+        {
+            float32x4x2_t v = vld2q_f32(reinterpret_cast<const float*>(p));
+            re = v.val[0];
+            im = v.val[1];
+        }
+        static void storeComplex(Complex *p, Reg re, Reg im)
+        {
+            float32x4x2_t v;
+            v.val[0] = re;
+            v.val[1] = im;
+            vst2q_f32(reinterpret_cast<float*>(p), v);
+        }
+
+        static Reg add(Reg a, Reg b) {return vaddq_f32(a, b);}
+        static Reg sub(Reg a, Reg b) {return vsubq_f32(a, b);}
+        static Reg mul(Reg a, Reg b) {return vmulq_f32(a, b);}
+        static Reg div(Reg a, Reg b) {return vdivq_f32(a, b);}
+        static Reg fma(Reg a, Reg b, Reg c) {return vfmaq_f32(c, a, b);}
+        static Reg sqrt(Reg a) {return vsqrtq_f32(a);}
+        static Reg abs(Reg a) {return vabsq_f32(a);}
+        static Reg min(Reg a, Reg b) {return vminq_f32(a, b);}
+        static Reg max(Reg a, Reg b) {return vmaxq_f32(a, b);}
+        static Reg round(Reg a) {return vrndnq_f32(a);}
+        static Reg floor(Reg a) {return vrndmq_f32(a);}
+        static Reg copySign(Reg magnitude, Reg sign) {return vbslq_f32(vdupq_n_u32(0x80000000), sign, magnitude);}
+
+        static Mask lt(Reg a, Reg b) {return vcltq_f32(a, b);}
+        static Mask gt(Reg a, Reg b) {return vcgtq_f32(a, b);}
+        static Mask ge(Reg a, Reg b) {return vcgeq_f32(a, b);}
+        static Mask eq(Reg a, Reg b) {return vceqq_f32(a, b);}
+        static Mask both(Mask a, Mask b) {return vandq_u32(a, b);}
+        static Mask either(Mask a, Mask b) {return vorrq_u32(a, b);}
+        static Reg select(Mask m, Reg a, Reg b) {return vbslq_f32(m, a, b);}
+    };
+
+    const KernelTable &kernels()
+    {
+        return kernelTable<Vec>("neon");
+    }
+}
+}
@@ -0,0 +1,176 @@
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "simd_utils.h"
+#define SIMD_ISA Generic
+#include "simd_kernels.h"
+
+namespace SIMDUtils
+{
+    namespace Generic
+    {
+        const KernelTable &kernels()
+        {
+            return kernelTable<Single>("generic");
+        }
+    }
+
+    // Implementations usable on this CPU, the preferred first
+    static std::vector<const KernelTable*> supported()
+    {
+        std::vector<const KernelTable*> tables;
+    #if defined(__x86_64__) || defined(__i386__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f"))
+            tables.push_back(&AVX512::kernels());
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+            tables.push_back(&AVX2::kernels());
+    #elif defined(__aarch64__)
+        tables.push_back(&NEON::kernels());
+    #endif
+        tables.push_back(&Generic::kernels());
+        return tables;
+    }
+
+    static const KernelTable &select()
+    {
+        auto tables = supported();
+        if (const char *forced = std::getenv("HIHOLO_SIMD")) {
+            for (auto table: tables) {
+                if (forced == std::string(table->name))
+                    return *table;
+            }
+            std::cerr << "HIHOLO_SIMD=" << forced << " is not supported here, using " << tables[0]->name << std::endl;
+        }
+        return *tables[0];
+    }
+
+    static const KernelTable &active()
+    {
+        static const KernelTable &table = select();
+        return table;
+    }
+
+    std::string activeISA()
+    {
+        return active().name;
+    }
+
+    void scaleComplexData(std::complex<float> *data, int numel, float scale)
+    {
+        active().scaleComplexData(data, numel, scale);
+    }
+
+    void computeComplexData(std::complex<float> *complexData, const float *amplitude, const float *phase, int numel)
+    {
+        active().computeComplexData(complexData, amplitude, phase, numel);
+    }
+
+    void computeAmplitude(const std::complex<float> *complexWave, float *amplitude, int numel)
+    {
+        active().computeAmplitude(complexWave, amplitude, numel);
+    }
+
+    void computePhase(const std::complex<float> *complexWave, float *phase, int numel)
+    {
+        active().computePhase(complexWave, phase, numel);
+    }
+
+    void initByPhase(std::complex<float> *data, const float *phase, int numel)
+    {
+        active().initByPhase(data, phase, numel);
+    }
+
+    void setAmplitude(std::complex<float> *complexWave, const float *targetAmplitude, int numel)
+    {
+        active().setAmplitude(complexWave, targetAmplitude, numel);
+    }
+
+    void setPhase(std::complex<float> *complexWave, const float *targetPhase, int numel)
+    {
+        active().setPhase(complexWave, targetPhase, numel);
+    }
+
+    void setPhaseAmp1(std::complex<float> *complexWave, const float *targetPhase, int numel)
+    {
+        active().setPhaseAmp1(complexWave, targetPhase, numel);
+    }
+
+    void setAmpPhase0(std::complex<float> *complexWave, const float *targetAmplitude, int numel)
+    {
+        active().setAmpPhase0(complexWave, targetAmplitude, numel);
+    }
+
+    void limitAmplitude(std::complex<float> *complexWave, const float *amplitude, const float *targetAmplitude, int numel)
+    {
+        active().limitAmplitude(complexWave, amplitude, targetAmplitude, numel);
+    }
+
+    void adjustAmplitude(float *amplitude, float maxAmplitude, float minAmplitude, int numel)
+    {
+        active().adjustAmplitude(amplitude, maxAmplitude, minAmplitude, numel);
+    }
+
+    void adjustPhase(float *phase, float maxPhase, float minPhase, int numel)
+    {
+        active().adjustPhase(phase, maxPhase, minPhase, numel);
+    }
+
+    void adjustComplexWave(std::complex<float> *complexWave, const float *support, float outsideValue, int numel)
+    {
+        active().adjustComplexWave(complexWave, support, outsideValue, numel);
+    }
+
+    void sqrtIntensity(float *amplitude, int numel)
+    {
+        active().sqrtIntensity(amplitude, numel);
+    }
+
+    void computeSquError(float *error, const std::complex<float> *propedWave, const float *measuredHologram, int numel)
+    {
+        active().computeSquError(error, propedWave, measuredHologram, numel);
+    }
+
+    void subNormComplex(float *result, const std::complex<float> *cmpData1, const std::complex<float> *cmpData2, int numel)
+    {
+        active().subNormComplex(result, cmpData1, cmpData2, numel);
+    }
+
+    void addWaveField(std::complex<float> *complexWave, const std::complex<float> *waveField, int numel)
+    {
+        active().addWaveField(complexWave, waveField, numel);
+    }
+
+    void subWaveField(std::complex<float> *complexWave, const std::complex<float> *waveField, int numel)
+    {
+        active().subWaveField(complexWave, waveField, numel);
+    }
+
+    void multiplyWaveField(std::complex<float> *result, const std::complex<float> *wf1, const std::complex<float> *wf2, int numel)
+    {
+        active().multiplyWaveField(result, wf1, wf2, numel);
+    }
+
+    void reflectWaveField(std::complex<float> *reflectedWave, const std::complex<float> *waveField, int numel)
+    {
+        active().reflectWaveField(reflectedWave, waveField, numel);
+    }
+
+    void updateDM(std::complex<float> *probe, const std::complex<float> *probeWave, const std::complex<float> *complexWave, int numel)
+    {
+        active().updateDM(probe, probeWave, complexWave, numel);
+    }
+
+    void propProcess(std::complex<float> *propagatedWave, const std::complex<float> *complexWave, const std::complex<float> *kernel,
+                     int numel, int batchSize)
+    {
+        active().propProcess(propagatedWave, complexWave, kernel, numel, batchSize);
+    }
+
+    void backPropProcess(std::complex<float> *complexWave, const std::complex<float> *propagatedWave, const std::complex<float> *kernel,
+                         int numel, int batchSize)
+    {
+        active().backPropProcess(complexWave, propagatedWave, kernel, numel, batchSize);
+    }
+}
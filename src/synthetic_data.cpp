@@ -0,0 +1,192 @@
+#include <cmath>
+#include <stdexcept>
+#include "synthetic_data.h"
+#include "art_utils.h"
+
+namespace SyntheticData
+{
+    FArray spherePhantom(int nx, int nz, int numSpheres, unsigned seed)
+    {
+        if (nx <= 0 || nz <= 0 || numSpheres < 0) {
+            throw std::invalid_argument("Invalid size or number of spheres of the phantom!");
+        }
+
+        // Spheres stay inside the cylinder seen by every angle and away from the first and last slices
+        std::mt19937 generator(seed);
+        std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+        FArray grid(static_cast<size_t>(nx) * nx * nz, 0.0f);
+        float center = 0.5f * (nx - 1);
+        for (int s = 0; s < numSpheres; s++) {
+            float radius = (0.03f + 0.09f * uniform(generator)) * std::min(nx, 2 * nz);
+            float distance = (0.45f * nx - radius) * std::sqrt(uniform(generator));
+            float direction = 2.0f * static_cast<float>(M_PI) * uniform(generator);
+            float cx = center + distance * std::cos(direction);
+            float cy = center + distance * std::sin(direction);
+            float cz = radius + (nz - 1 - 2.0f * radius) * uniform(generator);
+            float density = 0.5f + 0.5f * uniform(generator);
+
+            for (int y = 0; y < nx; y++) {
+                for (int x = 0; x < nx; x++) {
+                    float planar = (x - cx) * (x - cx) + (y - cy) * (y - cy);
+                    if (planar > radius * radius)
+                        continue;
+                    float *column = grid.data() + (static_cast<size_t>(y) * nx + x) * nz;
+                    for (int z = 0; z < nz; z++) {
+                        if (planar + (z - cz) * (z - cz) <= radius * radius)
+                            column[z] += density;
+                    }
+                }
+            }
+        }
+
+        return grid;
+    }
+
+    FArray projectPhantom(const FArray &grid, int nx, int nz, const FArray &angles, float phaseScale)
+    {
+        // Projections [nx][nz] of the ART projector to phase maps [nz][nx] with the rotation axis along the rows
+        FArray project(static_cast<size_t>(nx) * nz);
+        FArray phases(angles.size() * project.size());
+        for (size_t i = 0; i < angles.size(); i++) {
+            ARTUtils::gridProject(grid.data(), project.data(), nx, nx, nz, angles[i]);
+            float *phase = phases.data() + i * project.size();
+            for (int x = 0; x < nx; x++) {
+                for (int z = 0; z < nz; z++) {
+                    phase[z * nx + x] = -phaseScale * project[x * nz + z];
+                }
+            }
+        }
+
+        return phases;
+    }
+
+    FArray propagateObject(const FArray &phase, float betaDeltaRatio, const IntArray &imSize, const F2DArray &fresnelNumbers)
+    {
+        int numPixels = imSize[0] * imSize[1];
+        int numImages = static_cast<int>(fresnelNumbers.size());
+        if (static_cast<int>(phase.size()) != numPixels) {
+            throw std::invalid_argument("Phase map does not match the image size!");
+        }
+
+        // Fresnel numbers of both dimensions as in the reconstructors
+        F2DArray fresnel = fresnelNumbers;
+        for (auto &fresnelNumber: fresnel) {
+            if (fresnelNumber.size() == 1)
+                fresnelNumber.push_back(fresnelNumber[0]);
+        }
+
+        std::vector<cuFloatComplex> wave(numPixels);
+        for (int i = 0; i < numPixels; i++) {
+            float amplitude = std::exp(betaDeltaRatio * phase[i]);
+            wave[i] = make_cuFloatComplex(amplitude * std::cos(phase[i]), amplitude * std::sin(phase[i]));
+        }
+
+        cuFloatComplex *d_wave, *d_propagated;
+        cudaMalloc(&d_wave, numPixels * sizeof(cuFloatComplex));
+        cudaMalloc(&d_propagated, static_cast<size_t>(numImages) * numPixels * sizeof(cuFloatComplex));
+        cudaMemcpy(d_wave, wave.data(), numPixels * sizeof(cuFloatComplex), cudaMemcpyHostToDevice);
+        {
+            Propagator propagator(imSize, fresnel, CUDAPropKernel::Fourier);
+            propagator.propagate(d_wave, d_propagated);
+        }
+
+        std::vector<cuFloatComplex> propagated(static_cast<size_t>(numImages) * numPixels);
+        cudaMemcpy(propagated.data(), d_propagated, propagated.size() * sizeof(cuFloatComplex), cudaMemcpyDeviceToHost);
+        cudaFree(d_wave);
+        cudaFree(d_propagated);
+
+        FArray intensities(propagated.size());
+        for (size_t i = 0; i < propagated.size(); i++) {
+            intensities[i] = propagated[i].x * propagated[i].x + propagated[i].y * propagated[i].y;
+        }
+
+        return intensities;
+    }
+
+    FArray beamProfile(const IntArray &imSize, float beamWidth)
+    {
+        FArray profile(static_cast<size_t>(imSize[0]) * imSize[1], 1.0f);
+        if (beamWidth <= 0.0f)
+            return profile;
+
+        float sigmaRows = beamWidth * imSize[0], sigmaCols = beamWidth * imSize[1];
+        for (int r = 0; r < imSize[0]; r++) {
+            float dr = (r - 0.5f * (imSize[0] - 1)) / sigmaRows;
+            for (int c = 0; c < imSize[1]; c++) {
+                float dc = (c - 0.5f * (imSize[1] - 1)) / sigmaCols;
+                profile[r * imSize[1] + c] = std::exp(-0.5f * (dr * dr + dc * dc));
+            }
+        }
+
+        return profile;
+    }
+
+    // Dark counts with read-out noise, the deviation is only a placeholder when there is no noise to draw
+    static std::normal_distribution<float> readoutNoise(const DetectorModel &model)
+    {
+        return std::normal_distribution<float>(model.darkLevel, model.readNoise > 0.0f ? model.readNoise : 1.0f);
+    }
+
+    // Counts of one pixel, clamped to the range of the detector
+    static uint16_t recordPixel(float photons, const DetectorModel &model, std::normal_distribution<float> &readout,
+                                std::mt19937 &generator)
+    {
+        double signal = photons > 0.0f ? std::poisson_distribution<long>(photons)(generator) : 0.0;
+        double dark = model.readNoise > 0.0f ? readout(generator) : model.darkLevel;
+        double counts = std::round(signal + dark);
+        return static_cast<uint16_t>(std::min(std::max(counts, 0.0), 65535.0));
+    }
+
+    void detectorFields(const IntArray &imSize, int numImages, const DetectorModel &model, U16Array &dark, U16Array &flat,
+                        std::mt19937 &generator)
+    {
+        if (model.flux <= 0.0f) {
+            throw std::invalid_argument("Detector fields need a positive flux!");
+        }
+
+        FArray profile = beamProfile(imSize, model.beamWidth);
+        auto readout = readoutNoise(model);
+        dark.resize(profile.size());
+        for (auto &pixel: dark) {
+            pixel = recordPixel(0.0f, model, readout, generator);
+        }
+
+        flat.resize(static_cast<size_t>(numImages) * profile.size());
+        for (size_t i = 0; i < flat.size(); i++) {
+            flat[i] = recordPixel(model.flux * profile[i % profile.size()], model, readout, generator);
+        }
+    }
+
+    U16Array detectorCounts(const FArray &intensities, const FArray &profile, const DetectorModel &model, std::mt19937 &generator)
+    {
+        if (model.flux <= 0.0f) {
+            throw std::invalid_argument("Detector counts need a positive flux!");
+        }
+
+        auto readout = readoutNoise(model);
+        U16Array counts(intensities.size());
+        for (size_t i = 0; i < counts.size(); i++) {
+            counts[i] = recordPixel(model.flux * profile[i % profile.size()] * intensities[i], model, readout, generator);
+        }
+
+        return counts;
+    }
+
+    FArray flatFieldCorrect(const U16Array &counts, const U16Array &dark, const U16Array &flat, int numImages)
+    {
+        size_t numPixels = dark.size();
+        if (flat.size() != numImages * numPixels || counts.size() % (numImages * numPixels) != 0) {
+            throw std::invalid_argument("Counts, dark and flat fields do not match!");
+        }
+
+        FArray holograms(counts.size());
+        for (size_t i = 0; i < counts.size(); i++) {
+            size_t pixel = i % numPixels;
+            size_t image = (i / numPixels) % numImages;
+            float open = std::max(static_cast<float>(flat[image * numPixels + pixel]) - dark[pixel], 1.0f);
+            holograms[i] = (static_cast<float>(counts[i]) - dark[pixel]) / open;
+        }
+
+        return holograms;
+    }
+}
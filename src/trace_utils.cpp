@@ -0,0 +1,135 @@
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include "trace_utils.h"
+
+namespace TraceUtils
+{
+    std::atomic<bool> active(false);
+
+    namespace
+    {
+        struct Event
+        {
+            const char *name;
+            const char *category;
+            int64_t start;
+            int64_t duration;
+        };
+
+        // Buffers stay registered after their thread exits, so the events of finished workers are kept
+        struct Buffer
+        {
+            int thread;
+            std::vector<Event> events;
+        };
+
+        std::mutex registryMutex;
+        std::vector<std::unique_ptr<Buffer>> buffers;
+        // Read by the spans of every thread without locking
+        std::atomic<std::chrono::steady_clock::rep> epoch(std::chrono::steady_clock::now().time_since_epoch().count());
+        std::atomic<int> processIndex(0);
+        std::atomic<void (*)()> synchronizer(nullptr);
+
+        Buffer &threadBuffer()
+        {
+            thread_local Buffer *buffer = nullptr;
+            if (!buffer) {
+                std::lock_guard<std::mutex> lock(registryMutex);
+                buffers.emplace_back(new Buffer {static_cast<int>(buffers.size()), {}});
+                buffer = buffers.back().get();
+            }
+            return *buffer;
+        }
+
+        // Span names are literals, only quotes and backslashes need escaping
+        void writeString(std::ostream &os, const char *text)
+        {
+            os << '"';
+            for (const char *c = text; *c; c++) {
+                if (*c == '"' || *c == '\\')
+                    os << '\\';
+                os << *c;
+            }
+            os << '"';
+        }
+    }
+
+    void enable(int process, void (*synchronize)())
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        for (auto &buffer: buffers) {
+            buffer->events.clear();
+        }
+        processIndex.store(process);
+        synchronizer.store(synchronize);
+        epoch.store(std::chrono::steady_clock::now().time_since_epoch().count());
+        active.store(true);
+    }
+
+    void disable()
+    {
+        active.store(false);
+    }
+
+    int64_t now()
+    {
+        std::chrono::steady_clock::duration elapsed(std::chrono::steady_clock::now().time_since_epoch().count() - epoch.load());
+        return std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+    }
+
+    void record(const char *name, const char *category, int64_t start, int64_t end)
+    {
+        threadBuffer().events.push_back({name, category, start, end - start});
+    }
+
+    void synchronize()
+    {
+        if (auto function = synchronizer.load())
+            function();
+    }
+
+    std::string events()
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        std::ostringstream os;
+        int process = processIndex.load();
+        os << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": " << process
+           << ", \"args\": {\"name\": \"rank " << process << "\"}}";
+        for (const auto &buffer: buffers) {
+            for (const auto &event: buffer->events) {
+                os << ",\n{\"name\": ";
+                writeString(os, event.name);
+                os << ", \"cat\": ";
+                writeString(os, event.category);
+                os << ", \"ph\": \"X\", \"ts\": " << event.start << ", \"dur\": " << event.duration
+                   << ", \"pid\": " << process << ", \"tid\": " << buffer->thread << "}";
+            }
+        }
+        return os.str();
+    }
+
+    bool writeTrace(const std::string &filename, const std::vector<std::string> &fragments)
+    {
+        std::ofstream out(filename);
+        if (!out) {
+            return false;
+        }
+
+        out << "{\"traceEvents\": [\n";
+        bool first = true;
+        for (const auto &fragment: fragments) {
+            if (fragment.empty())
+                continue;
+            if (!first)
+                out << ",\n";
+            out << fragment;
+            first = false;
+        }
+        out << "\n], \"displayTimeUnit\": \"ms\"}\n";
+
+        return static_cast<bool>(out);
+    }
+}
@@ -0,0 +1,148 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include "tune_utils.h"
+
+namespace TuneUtils
+{
+    void scoreTrial(Trial &trial, const std::vector<double> &times, const FArray &errors)
+    {
+        trial.iterationSeconds = 0.0;
+        trial.errorDecrease = 0.0;
+        if (times.size() < 2 || times.size() != errors.size())
+            return;
+
+        double elapsed = times.back() - times.front();
+        trial.iterationSeconds = elapsed / (times.size() - 1);
+        double decrease = static_cast<double>(errors.front()) - errors.back();
+        if (elapsed > 0.0 && std::isfinite(decrease) && decrease > 0.0) {
+            trial.errorDecrease = decrease / elapsed;
+        }
+    }
+
+    const Trial &bestTrial(const std::vector<Trial> &trials)
+    {
+        if (trials.empty())
+            throw std::invalid_argument("No trials to choose from!");
+
+        const Trial *best = &trials[0];
+        for (const auto &trial: trials) {
+            if (trial.errorDecrease > best->errorDecrease || (trial.errorDecrease == best->errorDecrease &&
+                trial.iterationSeconds < best->iterationSeconds)) {
+                best = &trial;
+            }
+        }
+        return *best;
+    }
+
+    static const char *projectionNames[] {"Averaged", "Sequential", "Cyclic"};
+    static const char *kernelNames[] {"Fourier", "Chirp", "ChirpLimited"};
+
+    const char *projectionName(PMagnitudeCons::Type type)
+    {
+        return projectionNames[type];
+    }
+
+    const char *kernelName(CUDAPropKernel::Type type)
+    {
+        return kernelNames[type];
+    }
+
+    // Index of name in names, -1 if it is unknown
+    static int findName(const char *const *names, int count, const std::string &name)
+    {
+        for (int i = 0; i < count; i++) {
+            if (name == names[i])
+                return i;
+        }
+        return -1;
+    }
+
+    std::string defaultCachePath()
+    {
+        if (const char *path = std::getenv("HIHOLO_TUNE_CACHE"))
+            return path;
+        if (const char *home = std::getenv("HOME"))
+            return std::string(home) + "/.hiholo_tune";
+        return "hiholo_tune";
+    }
+
+    // Parses one cache line, false for comments and malformed lines
+    static bool parseLine(const std::string &line, IntArray &imSize, int &numImages, Trial &config)
+    {
+        if (line.empty() || line[0] == '#')
+            return false;
+
+        std::istringstream is(line);
+        imSize.assign(2, 0);
+        std::string projection, kernel;
+        if (!(is >> imSize[0] >> imSize[1] >> numImages >> projection >> kernel >> config.batchSize
+                 >> config.iterationSeconds >> config.errorDecrease)) {
+            return false;
+        }
+
+        int projectionType = findName(projectionNames, 3, projection);
+        int kernelType = findName(kernelNames, 3, kernel);
+        if (projectionType < 0 || kernelType < 0 || config.batchSize <= 0)
+            return false;
+        config.projectionType = static_cast<PMagnitudeCons::Type>(projectionType);
+        config.kernelType = static_cast<CUDAPropKernel::Type>(kernelType);
+        return true;
+    }
+
+    bool loadConfig(const std::string &filename, const IntArray &imSize, int numImages, Trial &config)
+    {
+        std::ifstream in(filename);
+        std::string line;
+        while (std::getline(in, line)) {
+            IntArray size;
+            int images;
+            Trial entry;
+            if (parseLine(line, size, images, entry) && size == imSize && images == numImages) {
+                config = entry;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool saveConfig(const std::string &filename, const IntArray &imSize, int numImages, const Trial &config)
+    {
+        std::vector<std::string> lines;
+        std::ifstream in(filename);
+        std::string line;
+        while (std::getline(in, line)) {
+            IntArray size;
+            int images;
+            Trial entry;
+            if (!parseLine(line, size, images, entry) || size != imSize || images != numImages) {
+                lines.push_back(line);
+            }
+        }
+        in.close();
+        if (lines.empty()) {
+            lines.push_back("# rows cols images projection kernel batch seconds_per_iteration error_decrease_per_second");
+        }
+
+        std::ostringstream entry;
+        entry << imSize[0] << " " << imSize[1] << " " << numImages << " " << projectionName(config.projectionType) << " "
+              << kernelName(config.kernelType) << " " << config.batchSize << " " << config.iterationSeconds << " " << config.errorDecrease;
+        lines.push_back(entry.str());
+
+        // Written aside and renamed, so that concurrent readers never see a partial file
+        std::string temporary = filename + ".tmp";
+        std::ofstream out(temporary);
+        if (!out)
+            return false;
+        for (const auto &text: lines) {
+            out << text << "\n";
+        }
+        out.close();
+        if (!out)
+            return false;
+        return std::rename(temporary.c_str(), filename.c_str()) == 0;
+    }
+}
@@ -0,0 +1,93 @@
+#include <cmath>
+#include <chrono>
+#include <iostream>
+#include "art_utils.h"
+
+// Reconstruct a cylinder phantom with the host ART engine, no GPU is needed
+int main()
+{
+    const int nx = 64, nz = 16, numAngles = 90;
+
+    FArray phantom(nx * nx * nz, 0.0f);
+    for (int y = 0; y < nx; y++) {
+        for (int x = 0; x < nx; x++) {
+            float r = std::hypot(x - 0.5f * (nx - 1), y - 0.5f * (nx - 1));
+            for (int z = 0; z < nz; z++) {
+                if (r < 0.3f * nx)
+                    phantom[(y * nx + x) * nz + z] = 1.0f + 0.05f * z;
+            }
+        }
+    }
+
+    FArray angles(numAngles);
+    for (int i = 0; i < numAngles; i++) {
+        angles[i] = i * static_cast<float>(M_PI) / numAngles;
+    }
+
+    FArray measured(numAngles * nx * nz);
+    for (int i = 0; i < numAngles; i++) {
+        ARTUtils::gridProject(phantom.data(), measured.data() + i * nx * nz, nx, nx, nz, angles[i]);
+    }
+
+    ARTOptions options = {10, 10, ARTOptions::BitReversal};
+    options.device = ARTOptions::CPU;
+
+    FArray serialGrid(phantom.size()), parallelGrid(phantom.size()), cachedGrid(phantom.size());
+    FArray serialProjs = measured, parallelProjs = measured, cachedProjs = measured;
+
+    options.numThreads = 1;
+    auto start = std::chrono::high_resolution_clock::now();
+    ARTUtils::reprojectART(serialGrid, serialProjs, nx, nx, nz, angles, options);
+    auto middle = std::chrono::high_resolution_clock::now();
+    options.numThreads = 0;
+    ARTUtils::reprojectART(parallelGrid, parallelProjs, nx, nx, nz, angles, options);
+    auto end = std::chrono::high_resolution_clock::now();
+    options.cacheMatrix = true;
+    ARTUtils::reprojectART(cachedGrid, cachedProjs, nx, nx, nz, angles, options);
+    auto cached = std::chrono::high_resolution_clock::now();
+
+    // Error after a single ART pass from the max map and from the filtered back projection
+    ARTOptions shortOptions = {1, 10, ARTOptions::BitReversal};
+    shortOptions.device = ARTOptions::CPU;
+    FArray maxMapGrid(phantom.size()), fbpGrid(phantom.size());
+    FArray maxMapProjs = measured, fbpProjs = measured;
+    ARTUtils::reprojectART(maxMapGrid, maxMapProjs, nx, nx, nz, angles, shortOptions);
+    shortOptions.init = ARTOptions::FilteredBackProjection;
+    ARTUtils::reprojectART(fbpGrid, fbpProjs, nx, nx, nz, angles, shortOptions);
+
+    double error = 0.0, norm = 0.0, difference = 0.0, maxMapError = 0.0, fbpError = 0.0;
+    for (size_t i = 0; i < phantom.size(); i++) {
+        error += (serialGrid[i] - phantom[i]) * (serialGrid[i] - phantom[i]);
+        norm += phantom[i] * phantom[i];
+        maxMapError += (maxMapGrid[i] - phantom[i]) * (maxMapGrid[i] - phantom[i]);
+        fbpError += (fbpGrid[i] - phantom[i]) * (fbpGrid[i] - phantom[i]);
+        difference = std::max(difference, static_cast<double>(std::abs(serialGrid[i] - parallelGrid[i])));
+        difference = std::max(difference, static_cast<double>(std::abs(serialGrid[i] - cachedGrid[i])));
+    }
+
+    std::cout << "Relative error: " << std::sqrt(error / norm) << std::endl;
+    std::cout << "Relative error after 1 pass from max map: " << std::sqrt(maxMapError / norm)
+              << ", from filtered back projection: " << std::sqrt(fbpError / norm) << std::endl;
+    std::cout << "Max difference between 1 thread, all threads and cached matrix: " << difference << std::endl;
+    std::cout << "1 thread: " << std::chrono::duration<double>(middle - start).count() << " s, all threads: "
+              << std::chrono::duration<double>(end - middle).count() << " s, cached matrix: "
+              << std::chrono::duration<double>(cached - end).count() << " s" << std::endl;
+
+    // Serial, parallel and cached results are identical, the reconstruction is close to the phantom and one pass
+    // from the filtered back projection beats one from the max map
+    int failures = 0;
+    if (difference != 0.0) {
+        std::cerr << "FAILED: thread counts or the cached matrix change the result" << std::endl;
+        failures++;
+    }
+    if (!(std::sqrt(error / norm) < 0.07)) {
+        std::cerr << "FAILED: relative error above 0.07" << std::endl;
+        failures++;
+    }
+    if (!(fbpError < maxMapError)) {
+        std::cerr << "FAILED: filtered back projection does not improve on the max map" << std::endl;
+        failures++;
+    }
+
+    return failures == 0 ? 0 : 1;
+}
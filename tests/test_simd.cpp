@@ -0,0 +1,256 @@
+#include <cmath>
+#include <complex>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <sys/wait.h>
+#include "simd_utils.h"
+
+typedef std::complex<float> Complex;
+
+// Inputs of every kernel, the same in every process
+struct Inputs
+{
+    int numel;
+    std::vector<Complex> wave, otherWave, kernel;
+    std::vector<float> phase, amplitude, support;
+};
+
+static Inputs makeInputs()
+{
+    // Not a multiple of any register width, so the single lane tail runs as well
+    Inputs in;
+    in.numel = 4099;
+    std::mt19937 gen(7);
+    std::uniform_real_distribution<float> value(-3.0f, 3.0f), angle(-8192.0f, 8192.0f), positive(0.0f, 2.0f);
+    std::uniform_real_distribution<float> exponent(-19.0f, 18.0f), mantissa(1.0f, 10.0f);
+    for (int i = 0; i < in.numel; i++) {
+        in.wave.push_back(Complex(value(gen), value(gen)));
+        in.otherWave.push_back(Complex(value(gen), value(gen)));
+        in.phase.push_back(angle(gen));
+        in.amplitude.push_back(positive(gen));
+        in.support.push_back(i % 3 == 0 ? 0.0f : 1.0f);
+    }
+    // Magnitudes over the documented range of hypot, the worst case of the former form and zeros
+    for (int i = 0; i < in.numel / 4; i++) {
+        float re = mantissa(gen) * std::pow(10.0f, exponent(gen));
+        float im = mantissa(gen) * std::pow(10.0f, exponent(gen));
+        in.wave[4 * i] = Complex(i % 2 ? re : -re, i % 3 ? im : -im);
+    }
+    in.wave[1] = Complex(9.39e7f, 3.14e9f);
+    in.wave[2] = Complex(0.0f, 0.0f);
+    in.wave[3] = Complex(-1.0f, 0.0f);
+    in.wave[5] = Complex(0.0f, -2.0f);
+    in.kernel.assign(in.wave.begin() + 1, in.wave.begin() + 1 + in.numel / 2);
+    for (auto &k: in.kernel) {
+        k /= std::abs(k);
+    }
+    return in;
+}
+
+static void append(std::vector<float> &out, const std::vector<Complex> &data)
+{
+    const float *p = reinterpret_cast<const float*>(data.data());
+    out.insert(out.end(), p, p + 2 * data.size());
+}
+
+static void append(std::vector<float> &out, const std::vector<float> &data)
+{
+    out.insert(out.end(), data.begin(), data.end());
+}
+
+// Runs every kernel once with the implementation in use and checks the documented bounds
+static int runKernels(const Inputs &in, std::vector<float> &out)
+{
+    int n = in.numel, failures = 0;
+    std::vector<Complex> wave;
+    std::vector<float> values(n);
+
+    SIMDUtils::computeAmplitude(in.wave.data(), values.data(), n);
+    double hypotUlps = 0.0;
+    for (int i = 0; i < n; i++) {
+        double reference = std::hypot(static_cast<double>(in.wave[i].real()), static_cast<double>(in.wave[i].imag()));
+        float rounded = static_cast<float>(reference);
+        double ulp = std::nextafter(rounded, INFINITY) - rounded;
+        hypotUlps = std::max(hypotUlps, std::abs(values[i] - reference) / ulp);
+    }
+    append(out, values);
+
+    SIMDUtils::computePhase(in.wave.data(), values.data(), n);
+    double atan2Error = 0.0;
+    for (int i = 0; i < n; i++) {
+        double reference = std::atan2(static_cast<double>(in.wave[i].imag()), static_cast<double>(in.wave[i].real()));
+        atan2Error = std::max(atan2Error, std::abs(values[i] - reference));
+    }
+    if (values[2] != 0.0f) {
+        std::cerr << "FAILED: atan2(0, 0) is " << values[2] << std::endl;
+        failures++;
+    }
+    append(out, values);
+
+    wave.assign(n, Complex());
+    SIMDUtils::initByPhase(wave.data(), in.phase.data(), n);
+    double sincosError = 0.0;
+    for (int i = 0; i < n; i++) {
+        std::complex<double> reference = std::polar(1.0, static_cast<double>(in.phase[i]));
+        sincosError = std::max(sincosError, std::abs(std::complex<double>(wave[i]) - reference));
+    }
+    append(out, wave);
+
+    std::cout << SIMDUtils::activeISA() << ": hypot " << hypotUlps << " ulp, atan2 " << atan2Error << " rad, sincos "
+              << sincosError << std::endl;
+    if (!(hypotUlps <= 1.0)) {
+        std::cerr << "FAILED: hypot is more than 1 ulp off" << std::endl;
+        failures++;
+    }
+    if (!(atan2Error <= 3e-7)) {
+        std::cerr << "FAILED: atan2 is more than 3e-7 off" << std::endl;
+        failures++;
+    }
+    // Both the cosine and the sine are within the bound
+    if (!(sincosError <= 2e-7 * std::sqrt(2.0))) {
+        std::cerr << "FAILED: sincos is more than 2e-7 off" << std::endl;
+        failures++;
+    }
+
+    // The remaining kernels only have to agree between the implementations
+    wave = in.wave;
+    SIMDUtils::scaleComplexData(wave.data(), n, 0.37f);
+    append(out, wave);
+    SIMDUtils::computeComplexData(wave.data(), in.amplitude.data(), in.phase.data(), n);
+    append(out, wave);
+
+    std::vector<void (*)(Complex*, const float*, int)> waveByValues = {SIMDUtils::setAmplitude, SIMDUtils::setPhase,
+        SIMDUtils::setPhaseAmp1, SIMDUtils::setAmpPhase0};
+    for (auto kernel: waveByValues) {
+        wave = in.otherWave;
+        kernel(wave.data(), in.amplitude.data(), n);
+        append(out, wave);
+    }
+    wave = in.otherWave;
+    std::vector<float> amplitude(n);
+    for (int i = 0; i < n; i++) {
+        amplitude[i] = std::abs(wave[i]);
+    }
+    SIMDUtils::limitAmplitude(wave.data(), amplitude.data(), in.amplitude.data(), n);
+    append(out, wave);
+
+    values = in.phase;
+    SIMDUtils::adjustAmplitude(values.data(), 1.5f, 0.2f, n);
+    append(out, values);
+    values = in.phase;
+    SIMDUtils::adjustPhase(values.data(), 100.0f, -100.0f, n);
+    append(out, values);
+    wave = in.otherWave;
+    SIMDUtils::adjustComplexWave(wave.data(), in.support.data(), 5.0f, n);
+    append(out, wave);
+    values = in.amplitude;
+    SIMDUtils::sqrtIntensity(values.data(), n);
+    append(out, values);
+
+    SIMDUtils::computeSquError(values.data(), in.otherWave.data(), in.amplitude.data(), n);
+    append(out, values);
+    SIMDUtils::subNormComplex(values.data(), in.otherWave.data(), in.kernel.data(), n / 2);
+    append(out, values);
+
+    std::vector<void (*)(Complex*, const Complex*, int)> waveByWave = {SIMDUtils::addWaveField, SIMDUtils::subWaveField,
+        SIMDUtils::reflectWaveField};
+    for (auto kernel: waveByWave) {
+        wave = in.otherWave;
+        kernel(wave.data(), in.kernel.data(), n / 2);
+        append(out, wave);
+    }
+    SIMDUtils::multiplyWaveField(wave.data(), in.otherWave.data(), in.kernel.data(), n / 2);
+    append(out, wave);
+    // The wave with zeros is the one divided by
+    wave = in.otherWave;
+    SIMDUtils::updateDM(wave.data(), in.kernel.data(), in.wave.data(), n / 2);
+    append(out, wave);
+
+    int numel = n / 4, batchSize = 2;
+    std::vector<Complex> propagated(numel * batchSize), backPropagated(numel);
+    SIMDUtils::propProcess(propagated.data(), in.otherWave.data(), in.kernel.data(), numel, batchSize);
+    append(out, propagated);
+    SIMDUtils::backPropProcess(backPropagated.data(), propagated.data(), in.kernel.data(), numel, batchSize);
+    append(out, backPropagated);
+
+    return failures;
+}
+
+// Run by main in a process of its own for every implementation, as the choice is made once per process
+static int runChild(const std::string &isa, const std::string &path)
+{
+    if (SIMDUtils::activeISA() != isa) {
+        std::cout << isa << ": not supported here, skipped" << std::endl;
+        return 2;
+    }
+    std::vector<float> out;
+    int failures = runKernels(makeInputs(), out);
+    std::ofstream file(path, std::ios::binary);
+    file.write(reinterpret_cast<const char*>(out.data()), out.size() * sizeof(float));
+    return failures == 0 ? 0 : 1;
+}
+
+// Every kernel of every implementation this CPU supports, selected by HIHOLO_SIMD
+int main(int argc, char **argv)
+{
+    if (argc == 3) {
+        return runChild(argv[1], argv[2]);
+    }
+
+    const std::vector<std::string> isas = {"generic", "avx2", "avx512", "neon"};
+    std::vector<std::vector<float>> results;
+    std::vector<std::string> names;
+    int failures = 0;
+    for (const auto &isa: isas) {
+        std::string path = "test_simd_" + isa + ".bin";
+        setenv("HIHOLO_SIMD", isa.c_str(), 1);
+        int status = std::system(("\"" + std::string(argv[0]) + "\" " + isa + " " + path).c_str());
+        if (status == -1 || !WIFEXITED(status)) {
+            std::cerr << "FAILED: could not run " << isa << std::endl;
+            failures++;
+            continue;
+        }
+        if (WEXITSTATUS(status) == 2)
+            continue;
+        if (WEXITSTATUS(status) != 0)
+            failures++;
+
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        std::vector<float> out(file.tellg() / sizeof(float));
+        file.seekg(0);
+        file.read(reinterpret_cast<char*>(out.data()), out.size() * sizeof(float));
+        std::remove(path.c_str());
+        results.push_back(out);
+        names.push_back(isa);
+    }
+
+    // Implementations differ in rounding only, fused or not, so they agree to a few ulps
+    for (size_t k = 1; k < results.size(); k++) {
+        double difference = 0.0;
+        if (results[k].size() != results[0].size()) {
+            difference = INFINITY;
+        }
+        for (size_t i = 0; i < results[k].size() && i < results[0].size(); i++) {
+            float a = results[0][i], b = results[k][i];
+            if (a == b) {
+                continue;
+            } else if (std::isnan(a) != std::isnan(b) || std::isinf(a) || std::isinf(b)) {
+                difference = INFINITY;
+            } else if (!std::isnan(a)) {
+                difference = std::max(difference, std::abs(a - b) / std::max(1.0, std::abs(static_cast<double>(a))));
+            }
+        }
+        std::cout << "Max relative difference " << names[0] << " - " << names[k] << ": " << difference << std::endl;
+        if (!(difference <= 1e-5)) {
+            std::cerr << "FAILED: " << names[k] << " does not agree with " << names[0] << std::endl;
+            failures++;
+        }
+    }
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,64 @@
+#include <cmath>
+#include <iostream>
+#include "StreamingTomography.h"
+
+// Back project a cylinder phantom angle by angle and as a whole, no GPU is needed
+int main()
+{
+    const int nx = 48, nz = 12, numAngles = 60, zStart = 3, zEnd = 10;
+
+    FArray phantom(nx * nx * nz, 0.0f);
+    for (int y = 0; y < nx; y++) {
+        for (int x = 0; x < nx; x++) {
+            float r = std::hypot(x - 0.5f * (nx - 1), y - 0.5f * (nx - 1));
+            for (int z = 0; z < nz; z++) {
+                if (r < 0.3f * nx)
+                    phantom[(y * nx + x) * nz + z] = 1.0f + 0.05f * z;
+            }
+        }
+    }
+
+    FArray angles(numAngles);
+    for (int i = 0; i < numAngles; i++) {
+        angles[i] = i * static_cast<float>(M_PI) / numAngles;
+    }
+
+    FArray projects(numAngles * nx * nz);
+    for (int i = 0; i < numAngles; i++) {
+        ARTUtils::gridProject(phantom.data(), projects.data() + i * nx * nz, nx, nx, nz, angles[i]);
+    }
+
+    FArray reference(phantom.size());
+    ARTUtils::filteredBackProject(reference, projects, nx, nx, nz, angles);
+
+    // Phase maps [z][x] of the slab, added in reverse order with a short queue
+    int depth = zEnd - zStart;
+    StreamingTomography tomography(nx, zStart, zEnd, angles, 0, 4);
+    FArray rows(depth * nx);
+    for (int i = numAngles - 1; i >= 0; i--) {
+        for (int z = 0; z < depth; z++) {
+            for (int x = 0; x < nx; x++) {
+                rows[z * nx + x] = projects[(i * nx + x) * nz + zStart + z];
+            }
+        }
+        tomography.addProjection(i, rows.data());
+    }
+    FArray slices = tomography.finish();
+
+    double difference = 0.0, norm = 0.0;
+    for (int z = 0; z < depth; z++) {
+        for (int c = 0; c < nx * nx; c++) {
+            float expected = reference[c * nz + zStart + z];
+            difference = std::max(difference, static_cast<double>(std::abs(slices[z * nx * nx + c] - expected)));
+            norm = std::max(norm, static_cast<double>(std::abs(expected)));
+        }
+    }
+
+    std::cout << "Max difference to the filtered back projection: " << difference << " of " << norm << std::endl;
+    if (!(slices.size() == static_cast<size_t>(depth) * nx * nx && difference <= 1e-5 * norm)) {
+        std::cerr << "FAILED: streamed slices differ from the filtered back projection" << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,88 @@
+#include <cmath>
+#include <iostream>
+#include "TiledReconstructor.h"
+
+using PhaseRetrieval::TiledReconstructor;
+
+// Tiling of the host side, the reconstruction is replaced by methods with a known result, no GPU is needed
+int main()
+{
+    int failures = 0;
+
+    // Smallest Fresnel number of all distances and directions, sqrt(numZones / F) capped by 1 / (2F)
+    struct GuardCase {F2DArray fresnelNumbers; float numZones; int expected;};
+    GuardCase guardCases[] = {{{{0.01f}}, 4.0f, 20}, {{{0.001f}}, 4.0f, 64}, {{{0.02f, 0.01f}, {0.05f}}, 4.0f, 20},
+                              {{{1.0f}}, 4.0f, 1}, {{{0.01f}}, 1.0f, 10}};
+    for (const auto &guardCase: guardCases) {
+        int guard = TiledReconstructor::guardBand(guardCase.fresnelNumbers, guardCase.numZones);
+        if (guard != guardCase.expected) {
+            std::cerr << "FAILED: guard band " << guard << " instead of " << guardCase.expected << std::endl;
+            failures++;
+        }
+    }
+
+    // Cores that do not divide the image, with and without blending
+    const int rows = 100, cols = 75, numImages = 2;
+    IntArray imSize {rows, cols};
+    F2DArray fresnelNumbers {{0.04f}, {0.02f}};
+    FArray holograms(numImages * rows * cols);
+    for (int i = 0; i < numImages; i++) {
+        for (int r = 0; r < rows; r++) {
+            for (int c = 0; c < cols; c++) {
+                holograms[(i * rows + r) * cols + c] = std::sin(0.1f * r) * std::cos(0.07f * c) + i;
+            }
+        }
+    }
+
+    for (int blendWidth: {-1, 0, 6}) {
+        TiledReconstructor tiler(imSize, numImages, fresnelNumbers, {32, 24}, 3, blendWidth);
+        const IntArray &windowSize = tiler.getWindowSize();
+        int windowNumel = windowSize[0] * windowSize[1];
+
+        double weightError = 0.0;
+        FArray weights = tiler.blendWeights();
+        for (float weight: weights) {
+            weightError = std::max(weightError, static_cast<double>(std::abs(weight - 1.0f)));
+        }
+
+        // The identity returns the first distance of every window, a shifted one adds another constant per tile
+        int calls = 0;
+        auto identity = [&](const FArray &windows, const FArray &, float shift) {
+            FArray phases(tiler.getTileBatch() * windowNumel);
+            for (int t = 0; t < tiler.getTileBatch(); t++) {
+                for (int i = 0; i < windowNumel; i++) {
+                    phases[t * windowNumel + i] = windows[t * numImages * windowNumel + i] + shift * (calls + t);
+                }
+            }
+            calls++;
+            return phases;
+        };
+
+        double identityError = 0.0, shiftedError = 0.0;
+        FArray result = tiler.reconstruct(holograms, FArray(), [&](const FArray &w, const FArray &p) {return identity(w, p, 0.0f);});
+        calls = 0;
+        FArray shifted = tiler.reconstruct(holograms, FArray(), [&](const FArray &w, const FArray &p) {return identity(w, p, 0.5f);});
+        for (int i = 0; i < rows * cols; i++) {
+            identityError = std::max(identityError, static_cast<double>(std::abs(result[i] - holograms[i])));
+            shiftedError = std::max(shiftedError, static_cast<double>(std::abs(shifted[i] - holograms[i])));
+        }
+
+        std::cout << "Blend width " << blendWidth << ", guard band " << tiler.getGuardBand() << ", " << tiler.getTiles().size()
+                  << " tiles: weight error " << weightError << ", identity error " << identityError << ", shifted tiles error "
+                  << shiftedError << std::endl;
+        if (!(weightError < 1e-6)) {
+            std::cerr << "FAILED: blend weights do not sum to 1" << std::endl;
+            failures++;
+        }
+        if (!(identityError < 1e-5)) {
+            std::cerr << "FAILED: the identity method does not return its input" << std::endl;
+            failures++;
+        }
+        if (!(shiftedError < 1e-5)) {
+            std::cerr << "FAILED: constant offsets of the tiles are not removed" << std::endl;
+            failures++;
+        }
+    }
+
+    return failures == 0 ? 0 : 1;
+}